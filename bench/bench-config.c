@@ -0,0 +1,227 @@
+/*
+ *
+ *  Copyright (C) 2005-2014 Kemal Ilgar Eroglu <ilgar_eroglu@yahoo.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * Saves and loads the rc file with 1k, 10k and 100k alarms, each size
+ * in a child process of its own so that its peak RSS can be told
+ * apart, and fails if time or memory grows faster than linearly.
+ **/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "timerconfig.h"
+
+
+
+/* Allowed excess over linear growth between two sizes */
+#define SLACK 2.5
+
+/* Below these the numbers are mostly noise and not compared */
+#define MIN_TIME_US 2000
+#define MIN_RSS_KB  1024
+
+typedef struct
+{
+  gint64 save_us, load_us;
+  glong rss_kb; /* Peak RSS growth over the start of the run */
+} Result;
+
+
+
+static glong
+peak_rss_kb (void)
+{
+  struct rusage usage;
+
+  getrusage (RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+
+
+static void
+keep_alarm (const TimerConfigAlarm *alarm, gpointer data)
+{
+  g_array_append_val ((GArray *) data, *alarm);
+}
+
+
+
+static Result
+run (guint n_alarms, const gchar *path)
+{
+  TimerConfigWriter *writer;
+  TimerConfigAlarm alarm;
+  TimerConfigOptions options = { .repetitions = 1, .repeat_interval = 10 };
+  GArray *alarms;
+  gchar *contents;
+  Result result;
+  glong rss_start;
+  gint64 start;
+  guint i;
+
+  rss_start = peak_rss_kb ();
+
+  start = g_get_monotonic_time ();
+  writer = timer_config_writer_new ();
+  for (i = 0; i < n_alarms; i++)
+    {
+      alarm.name = g_strdup_printf ("Alarm number %u", i);
+      alarm.info = g_strdup_printf ("%um %us", i / 60 % 60, i % 60);
+      alarm.command = g_strdup_printf ("notify-send \"Alarm %u\"", i);
+      alarm.time = i;
+      alarm.is_countdown = i % 2;
+      alarm.is_recurring = i % 3 == 0;
+      alarm.is_auto_start = FALSE;
+      timer_config_writer_add_alarm (writer, &alarm);
+      g_free (alarm.name);
+      g_free (alarm.info);
+      g_free (alarm.command);
+    }
+  if (!timer_config_writer_finish (writer, &options, path, NULL))
+    g_error ("Could not write %s", path);
+  result.save_us = g_get_monotonic_time () - start;
+
+  start = g_get_monotonic_time ();
+  if (!g_file_get_contents (path, &contents, NULL, NULL))
+    g_error ("Could not read %s", path);
+  alarms = g_array_new (FALSE, FALSE, sizeof (TimerConfigAlarm));
+  timer_config_parse (contents, &options, keep_alarm, alarms);
+  result.load_us = g_get_monotonic_time () - start;
+
+  if (alarms->len != n_alarms)
+    g_error ("Read %u alarms back instead of %u", alarms->len, n_alarms);
+
+  result.rss_kb = peak_rss_kb () - rss_start;
+
+  g_array_free (alarms, TRUE);
+  g_free (contents);
+
+  return result;
+}
+
+
+
+/* Runs one size in a child process, so peak RSS is its own */
+static gboolean
+run_forked (guint n_alarms, const gchar *path, Result *result)
+{
+  gint fds[2], status;
+  pid_t pid;
+
+  if (pipe (fds) != 0)
+    return FALSE;
+
+  pid = fork ();
+  if (pid < 0)
+    return FALSE;
+
+  if (pid == 0)
+    {
+      Result r = run (n_alarms, path);
+
+      close (fds[0]);
+      _exit (write (fds[1], &r, sizeof (r)) == sizeof (r) ? 0 : 1);
+    }
+
+  close (fds[1]);
+  if (read (fds[0], result, sizeof (*result)) != sizeof (*result))
+    result = NULL;
+  close (fds[0]);
+
+  return waitpid (pid, &status, 0) == pid && WIFEXITED (status)
+         && WEXITSTATUS (status) == 0 && result != NULL;
+}
+
+
+
+static gboolean
+linear (const gchar *what, gdouble small, gdouble large, gdouble ratio,
+        gdouble min)
+{
+  if (small < min)
+    return TRUE;
+  if (large / small <= ratio * SLACK)
+    return TRUE;
+
+  g_printerr ("%s grew %.1fx for %.0fx the alarms\n", what, large / small,
+              ratio);
+  return FALSE;
+}
+
+
+
+int
+main (int argc, char **argv)
+{
+  static const guint sizes[] = { 1000, 10000, 100000 };
+  Result results[G_N_ELEMENTS (sizes)];
+  gboolean ok = TRUE;
+  gchar *path;
+  gint fd;
+  guint i;
+
+  fd = g_file_open_tmp ("bench-config-XXXXXX.rc", &path, NULL);
+  if (fd < 0)
+    return 1;
+  close (fd);
+
+  g_print ("%8s %12s %12s %12s\n", "alarms", "save (ms)", "load (ms)",
+           "rss (kB)");
+
+  for (i = 0; i < G_N_ELEMENTS (sizes); i++)
+    {
+      if (!run_forked (sizes[i], path, &results[i]))
+        {
+          g_printerr ("Run with %u alarms failed\n", sizes[i]);
+          ok = FALSE;
+          break;
+        }
+
+      g_print ("%8u %12.2f %12.2f %12ld\n", sizes[i],
+               results[i].save_us / 1000.0, results[i].load_us / 1000.0,
+               results[i].rss_kb);
+
+      if (i == 0)
+        continue;
+
+      ok &= linear ("Save time", results[i - 1].save_us, results[i].save_us,
+                    (gdouble) sizes[i] / sizes[i - 1], MIN_TIME_US);
+      ok &= linear ("Load time", results[i - 1].load_us, results[i].load_us,
+                    (gdouble) sizes[i] / sizes[i - 1], MIN_TIME_US);
+      ok &= linear ("Peak RSS", results[i - 1].rss_kb, results[i].rss_kb,
+                    (gdouble) sizes[i] / sizes[i - 1], MIN_RSS_KB);
+    }
+
+  g_unlink (path);
+  g_free (path);
+
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,345 @@
+/*
+ *
+ *  Copyright (C) 2005-2014 Kemal Ilgar Eroglu <ilgar_eroglu@yahoo.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * Drives the timer core headless with a fake clock and measures the
+ * paths taken while alarms run: the periodic display update, starting
+ * an alarm, starting an "At" alarm on the system clocks (which keeps
+ * the real-time clock watch armed) and firing many alarms at once.
+ * Each is run with 10, 1k and 10k alarms; the results are printed and
+ * written as JSON (to the file given on the command line, else
+ * bench-core.json) so that runs can be compared. For the tick an
+ * operation is one pass over all alarms, for start, start_at and fire
+ * it is one alarm.
+ *
+ * The popup menu and the options list are GTK code that needs a
+ * display, and are not measured here.
+ **/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <glib.h>
+
+#include "timercore.h"
+
+
+
+/* Operations per measurement, spread over as many rounds as needed */
+#define MIN_OPS 200000
+
+/* Real time of the fake clock at monotonic 0: 2020-01-01 UTC */
+#define FAKE_EPOCH (G_GINT64_CONSTANT (1577836800) * G_USEC_PER_SEC)
+
+typedef struct
+{
+  const gchar *name;
+  guint alarms;
+  guint64 ops;
+  gint64 total_us;
+} Result;
+
+/* Keeps the compiler from dropping work whose result is unused */
+static volatile gint64 sink;
+
+static gint64 fake_now;
+static guint fired;
+
+
+
+static gint64
+fake_monotonic (gpointer data)
+{
+  return fake_now;
+}
+
+
+
+static gint64
+fake_real (gpointer data)
+{
+  return FAKE_EPOCH + fake_now;
+}
+
+
+
+static void
+count_fired (TimerCore *core, TimerAlarm *alarm, gpointer data)
+{
+  fired++;
+}
+
+
+
+/* A core on the fake clock with n stopped countdowns of 'time' seconds and up */
+static TimerCore *
+core_new (guint n, gint time)
+{
+  static const TimerCoreClock clock = { fake_monotonic, fake_real };
+  static const TimerCoreCallbacks callbacks = { count_fired, NULL, NULL };
+  TimerCore *core;
+  TimerAlarm *alarm;
+  gchar *str;
+  guint i;
+
+  core = timer_core_new (&callbacks, NULL);
+  timer_core_set_clock (core, &clock, NULL);
+
+  for (i = 0; i < n; i++)
+    {
+      alarm = timer_core_add (core);
+      str = g_strdup_printf ("Alarm number %u", i);
+      timer_core_set_name (core, alarm, str);
+      g_free (str);
+      str = g_strdup_printf ("%um %us", i / 60 % 60, i % 60);
+      timer_core_set_info (core, alarm, str);
+      g_free (str);
+      timer_core_set_command (core, alarm, "");
+      alarm->is_countdown = TRUE;
+      alarm->time = time;
+    }
+
+  return core;
+}
+
+
+
+static void
+start_all (TimerCore *core)
+{
+  guint i;
+
+  for (i = 0; i < timer_core_n_alarms (core); i++)
+    timer_core_start (core, timer_core_get (core, i));
+}
+
+
+
+static void
+stop_all (TimerCore *core)
+{
+  guint i;
+
+  for (i = 0; i < timer_core_n_alarms (core); i++)
+    timer_core_stop (core, timer_core_get (core, i));
+}
+
+
+
+/**
+ * One display update as the plugin does it: find the alarm the
+ * pbar shows and the remaining time of every running one.
+ **/
+static void
+tick (TimerCore *core)
+{
+  TimerAlarm *alarm, *shown;
+  gint64 sum = 0;
+  guint i;
+
+  shown = timer_core_first_to_finish (core, fake_now);
+  for (i = 0; i < timer_core_n_alarms (core); i++)
+    {
+      alarm = timer_core_get (core, i);
+      if (timer_core_get_state (core, alarm) & TIMER_ALARM_RUNNING)
+        sum += timer_core_remaining (core, alarm, fake_now);
+    }
+
+  sink = sum + (shown != NULL);
+}
+
+
+
+static Result
+bench_tick (guint n)
+{
+  Result result = { "tick", n, 0, 0 };
+  TimerCore *core;
+  gint64 start;
+  guint i, rounds = MAX (MIN_OPS / n, 20);
+
+  fake_now = 0;
+  core = core_new (n, G_MAXINT / 2);
+  start_all (core);
+
+  start = g_get_monotonic_time ();
+  for (i = 0; i < rounds; i++)
+    {
+      fake_now += G_USEC_PER_SEC;
+      tick (core);
+    }
+  result.total_us = g_get_monotonic_time () - start;
+  result.ops = rounds;
+
+  timer_core_free (core);
+  return result;
+}
+
+
+
+static Result
+bench_start (guint n)
+{
+  Result result = { "start", n, 0, 0 };
+  TimerCore *core;
+  gint64 start;
+  guint i, rounds = MAX (MIN_OPS / n, 1);
+
+  fake_now = 0;
+  core = core_new (n, 3600);
+
+  for (i = 0; i < rounds; i++)
+    {
+      start = g_get_monotonic_time ();
+      start_all (core);
+      result.total_us += g_get_monotonic_time () - start;
+      stop_all (core);
+      fake_now += G_USEC_PER_SEC;
+    }
+  result.ops = (guint64) rounds * n;
+
+  timer_core_free (core);
+  return result;
+}
+
+
+
+/**
+ * Starts and stops n "At" alarms on the system clocks rather than
+ * the fake one, so that the real-time clock watch is kept armed for
+ * the earliest wall deadline as in the panel.
+ **/
+static Result
+bench_start_at (guint n)
+{
+  Result result = { "start_at", n, 0, 0 };
+  TimerCore *core;
+  TimerAlarm *alarm;
+  gint64 start;
+  guint i, rounds = MAX (MIN_OPS / n, 1);
+
+  core = core_new (n, 0);
+  timer_core_set_clock (core, NULL, NULL);
+  for (i = 0; i < n; i++)
+    {
+      alarm = timer_core_get (core, i);
+      alarm->is_countdown = FALSE;
+      alarm->time = i % (24 * 60);
+    }
+
+  for (i = 0; i < rounds; i++)
+    {
+      start = g_get_monotonic_time ();
+      start_all (core);
+      result.total_us += g_get_monotonic_time () - start;
+      stop_all (core);
+    }
+  result.ops = (guint64) rounds * n;
+
+  timer_core_free (core);
+  return result;
+}
+
+
+
+/* All n alarms expire at the same moment and are fired by one dispatch */
+static Result
+bench_fire (guint n)
+{
+  Result result = { "fire", n, 0, 0 };
+  TimerCore *core;
+  gint64 start;
+  guint i, rounds = MAX (MIN_OPS / n, 1);
+
+  fake_now = 0;
+  core = core_new (n, 60);
+
+  for (i = 0; i < rounds; i++)
+    {
+      start_all (core);
+      fake_now += 60 * G_USEC_PER_SEC;
+      fired = 0;
+
+      start = g_get_monotonic_time ();
+      timer_core_dispatch (core);
+      result.total_us += g_get_monotonic_time () - start;
+
+      if (fired != n || timer_core_n_running (core) != 0)
+        g_error ("Fired %u of %u alarms", fired, n);
+    }
+  result.ops = (guint64) rounds * n;
+
+  timer_core_free (core);
+  return result;
+}
+
+
+
+int
+main (int argc, char **argv)
+{
+  static const guint sizes[] = { 10, 1000, 10000 };
+  static Result (*const benches[]) (guint) =
+    { bench_tick, bench_start, bench_start_at, bench_fire };
+  const gchar *path = argc > 1 ? argv[1] : "bench-core.json";
+  GError *error = NULL;
+  GString *json;
+  Result result;
+  guint i, j;
+
+  json = g_string_new ("{\n  \"benchmark\": \"core\",\n  \"results\": [");
+
+  g_print ("%-10s %8s %12s %14s\n", "bench", "alarms", "ops", "ns/op");
+
+  for (i = 0; i < G_N_ELEMENTS (benches); i++)
+    for (j = 0; j < G_N_ELEMENTS (sizes); j++)
+      {
+        result = benches[i] (sizes[j]);
+
+        g_print ("%-10s %8u %12" G_GUINT64_FORMAT " %14.1f\n", result.name,
+                 result.alarms, result.ops,
+                 result.total_us * 1000.0 / result.ops);
+
+        g_string_append_printf (json,
+                                "%s\n    { \"name\": \"%s\", \"alarms\": %u, "
+                                "\"ops\": %" G_GUINT64_FORMAT ", "
+                                "\"total_us\": %" G_GINT64_FORMAT ", "
+                                "\"ns_per_op\": %.1f }",
+                                i + j > 0 ? "," : "", result.name,
+                                result.alarms, result.ops, result.total_us,
+                                result.total_us * 1000.0 / result.ops);
+      }
+
+  g_string_append (json, "\n  ]\n}\n");
+
+  if (!g_file_set_contents (path, json->str, json->len, &error))
+    {
+      g_printerr ("Could not write %s: %s\n", path, error->message);
+      g_error_free (error);
+      g_string_free (json, TRUE);
+      return 1;
+    }
+
+  g_string_free (json, TRUE);
+  return 0;
+}
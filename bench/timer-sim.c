@@ -0,0 +1,342 @@
+/*
+ *
+ *  Copyright (C) 2005-2014 Kemal Ilgar Eroglu <ilgar_eroglu@yahoo.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * Runs an alarm schedule on the simulated clock of the timer core.
+ * Hours of alarms take milliseconds, and every firing is checked
+ * against the time it was due: a countdown exactly one period after
+ * it started or last fired, an "At" alarm exactly on its minute.
+ *
+ *   timer-sim [--hours=H] [--storm=N] [--verbose] [RCFILE]
+ *
+ * Every alarm of RCFILE is started at once, or those of a built-in
+ * day if no file is given. Then N alarms are made to expire at the
+ * same moment to time the scheduler under a storm of expirations.
+ * Last a recurring "At" alarm is coalesced with a countdown just
+ * before it, which must make it fire once a day, not over and over.
+ * Alarm commands are counted, not run. Exits with 1 if a firing was
+ * off.
+ **/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <glib.h>
+
+#include "timerconfig.h"
+#include "timercore.h"
+#include "timersim.h"
+
+
+
+/* Local midnight the simulation starts at, 2020-03-28, a day before DST in Europe */
+#define START_YEAR  2020
+#define START_MONTH 3
+#define START_DAY   28
+
+typedef struct
+{
+  TimerSimClock *sim;
+  gint64 *last; /* Per alarm id: when it was started or last fired */
+  guint n_last;
+  guint fired, commands, errors;
+  gboolean verbose;
+} Sim;
+
+
+
+static void
+sim_fired (TimerCore *core, TimerAlarm *alarm, gpointer data)
+{
+  Sim *s = (Sim *) data;
+  GDateTime *local;
+  gint64 now, expected;
+
+  now = timer_sim_clock_now (s->sim);
+  s->fired++;
+
+  if (alarm->is_countdown)
+    {
+      expected = s->last[alarm->id] + (gint64) alarm->time * G_USEC_PER_SEC;
+      if (now != expected)
+        {
+          g_printerr ("%s fired at %" G_GINT64_FORMAT " us instead of %"
+                      G_GINT64_FORMAT " us\n", alarm->name, now, expected);
+          s->errors++;
+        }
+    }
+  else
+    {
+      local = g_date_time_new_from_unix_local (
+          timer_sim_clock_real_now (s->sim) / G_USEC_PER_SEC);
+      if (g_date_time_get_hour (local) * 60 + g_date_time_get_minute (local)
+          != alarm->time
+          || g_date_time_get_second (local) != 0
+          || timer_sim_clock_real_now (s->sim) % G_USEC_PER_SEC != 0)
+        {
+          g_printerr ("%s fired at %02d:%02d:%02d instead of %02d:%02d\n",
+                      alarm->name, g_date_time_get_hour (local),
+                      g_date_time_get_minute (local),
+                      g_date_time_get_second (local),
+                      alarm->time / 60, alarm->time % 60);
+          s->errors++;
+        }
+      g_date_time_unref (local);
+    }
+
+  if (alarm->lateness != 0)
+    {
+      g_printerr ("%s fired %" G_GINT64_FORMAT " us late\n", alarm->name,
+                  alarm->lateness);
+      s->errors++;
+    }
+
+  if (s->verbose)
+    g_print ("%12.3f s  %s\n", now / (gdouble) G_USEC_PER_SEC, alarm->name);
+
+  s->last[alarm->id] = now;
+}
+
+
+
+static void
+sim_run_command (TimerCore *core, TimerAlarm *alarm, gchar **argv,
+                 gpointer data)
+{
+  ((Sim *) data)->commands++;
+}
+
+
+
+static void
+add_alarm (TimerCore *core, const gchar *name, gint time, gboolean countdown,
+           gboolean recurring, const gchar *command)
+{
+  TimerAlarm *alarm;
+
+  alarm = timer_core_add (core);
+  timer_core_set_name (core, alarm, name);
+  timer_core_set_info (core, alarm, "");
+  timer_core_set_command (core, alarm, command);
+  alarm->time = time;
+  alarm->is_countdown = countdown;
+  alarm->is_recurring = recurring;
+}
+
+
+
+/* A day of alarms: short and long recurring countdowns, "At" alarms, repeats */
+static void
+add_day (TimerCore *core)
+{
+  add_alarm (core, "Tea", 7, TRUE, TRUE, "");
+  add_alarm (core, "Stretch", 25 * 60, TRUE, TRUE, "true");
+  add_alarm (core, "Hourly", 3600, TRUE, TRUE, "");
+  add_alarm (core, "Odd period", 4999, TRUE, TRUE, "true");
+  add_alarm (core, "Pizza", 17 * 60, TRUE, FALSE, "true");
+  add_alarm (core, "Wake up", 6 * 60 + 30, FALSE, TRUE, "");
+  add_alarm (core, "Lunch", 12 * 60, FALSE, TRUE, "true");
+  add_alarm (core, "Midnight", 0, FALSE, TRUE, "");
+  add_alarm (core, "Late", 23 * 60 + 59, FALSE, FALSE, "");
+
+  timer_core_set_use_global_command (core, TRUE);
+  timer_core_set_global_command (core, "true");
+  timer_core_set_repeat (core, TRUE, 3, 10);
+}
+
+
+
+static void
+load_alarm (const TimerConfigAlarm *entry, gpointer data)
+{
+  TimerCore *core = (TimerCore *) data;
+
+  add_alarm (core, entry->name ? entry->name : "No name", entry->time,
+             entry->is_countdown, entry->is_recurring,
+             entry->command ? entry->command : "");
+}
+
+
+
+static gboolean
+load_rc (TimerCore *core, const gchar *path)
+{
+  TimerConfigOptions options = { .repetitions = 1, .repeat_interval = 10 };
+  GError *error = NULL;
+  gchar *contents;
+
+  if (!g_file_get_contents (path, &contents, NULL, &error))
+    {
+      g_printerr ("%s\n", error->message);
+      g_error_free (error);
+      return FALSE;
+    }
+
+  timer_config_parse (contents, &options, load_alarm, core);
+  timer_core_set_use_global_command (core, options.use_global_command);
+  timer_core_set_global_command (core, options.global_command);
+  timer_core_set_repeat (core, options.repeat_alarm_command,
+                         options.repetitions, options.repeat_interval);
+  timer_core_set_coalesce (core, MAX (options.coalesce_window, 0) * 1000);
+  g_free (contents);
+
+  return TRUE;
+}
+
+
+
+/* Fires n alarms due at the same moment in one dispatch */
+static void
+storm (guint n)
+{
+  TimerCore *core;
+  TimerSimClock *sim;
+  gint64 start;
+  guint i;
+
+  core = timer_core_new (NULL, NULL);
+  sim = timer_sim_clock_new (core, 0);
+  for (i = 0; i < n; i++)
+    add_alarm (core, "Storm", 60, TRUE, TRUE, "");
+  for (i = 0; i < n; i++)
+    timer_core_start (core, timer_core_get (core, i));
+
+  start = g_get_monotonic_time ();
+  timer_sim_clock_advance (sim, 60 * G_USEC_PER_SEC);
+  g_print ("Storm of %u expirations handled in %.2f ms\n", n,
+           (g_get_monotonic_time () - start) / 1000.0);
+
+  timer_sim_clock_free (sim);
+  timer_core_free (core);
+}
+
+
+
+/**
+ * A recurring "At" alarm at 00:01 and a countdown ending a second
+ * before it, within the coalesce window: the alarm goes off early
+ * with the countdown on the first day, then on its minute. Returns
+ * the number of firings that were off.
+ **/
+static guint
+coalesced_at (gint64 midnight)
+{
+  TimerCore *core;
+  TimerSimClock *sim;
+  guint fired;
+
+  core = timer_core_new (NULL, NULL);
+  sim = timer_sim_clock_new (core, midnight);
+  timer_core_set_coalesce (core, 2000);
+  add_alarm (core, "Early", 59, TRUE, FALSE, "");
+  add_alarm (core, "Coalesced", 1, FALSE, TRUE, "");
+  timer_core_start (core, timer_core_get (core, 0));
+  timer_core_start (core, timer_core_get (core, 1));
+
+  /* Into the third day, wherever the DST change falls */
+  timer_sim_clock_advance (sim, 60 * G_TIME_SPAN_HOUR);
+  fired = timer_core_get_stats (core)->fired;
+  g_print ("Coalesced \"At\" alarm: %u firings in 60 h\n", fired);
+
+  timer_sim_clock_free (sim);
+  timer_core_free (core);
+
+  /* The countdown once, the alarm once a day */
+  return fired == 4 ? 0 : 1;
+}
+
+
+
+int
+main (int argc, char **argv)
+{
+  static const TimerCoreCallbacks callbacks =
+    { sim_fired, NULL, NULL, sim_run_command };
+  gint hours = 24, storm_size = 10000;
+  gboolean verbose = FALSE;
+  GOptionEntry entries[] =
+  {
+    { "hours", 0, 0, G_OPTION_ARG_INT, &hours, "Hours to simulate", "H" },
+    { "storm", 0, 0, G_OPTION_ARG_INT, &storm_size,
+      "Alarms expiring at once in the storm, 0 for none", "N" },
+    { "verbose", 'v', 0, G_OPTION_ARG_NONE, &verbose, "Print every firing",
+      NULL },
+    { NULL }
+  };
+  GOptionContext *context;
+  GError *error = NULL;
+  GDateTime *midnight;
+  TimerCore *core;
+  Sim s = { NULL, NULL, 0, 0, 0, 0, FALSE };
+  gint64 start, start_real;
+  guint i;
+
+  context = g_option_context_new ("[RCFILE]");
+  g_option_context_add_main_entries (context, entries, NULL);
+  if (!g_option_context_parse (context, &argc, &argv, &error))
+    {
+      g_printerr ("%s\n", error->message);
+      g_error_free (error);
+      g_option_context_free (context);
+      return 2;
+    }
+  g_option_context_free (context);
+
+  s.verbose = verbose;
+  core = timer_core_new (&callbacks, &s);
+  midnight = g_date_time_new_local (START_YEAR, START_MONTH, START_DAY, 0, 0, 0);
+  start_real = g_date_time_to_unix (midnight) * G_USEC_PER_SEC;
+  s.sim = timer_sim_clock_new (core, start_real);
+  g_date_time_unref (midnight);
+
+  if (argc > 1)
+    {
+      if (!load_rc (core, argv[1]))
+        return 2;
+    }
+  else
+    add_day (core);
+
+  /* Ids start at 1 and are never reused */
+  s.n_last = timer_core_n_alarms (core) + 1;
+  s.last = g_new0 (gint64, s.n_last);
+  for (i = 0; i < timer_core_n_alarms (core); i++)
+    timer_core_start (core, timer_core_get (core, i));
+
+  start = g_get_monotonic_time ();
+  timer_sim_clock_advance (s.sim, (gint64) hours * G_TIME_SPAN_HOUR);
+  g_print ("%d h of %u alarms: %u firings, %u commands, %u off, in %.2f ms\n",
+           hours, timer_core_n_alarms (core), s.fired, s.commands, s.errors,
+           (g_get_monotonic_time () - start) / 1000.0);
+
+  timer_sim_clock_free (s.sim);
+  timer_core_free (core);
+  g_free (s.last);
+
+  if (storm_size > 0)
+    storm (storm_size);
+
+  s.errors += coalesced_at (start_real);
+
+  return s.errors > 0 ? 1 : 0;
+}
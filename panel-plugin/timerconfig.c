@@ -0,0 +1,338 @@
+/*
+ *
+ *  Copyright (C) 2005-2014 Kemal Ilgar Eroglu <ilgar_eroglu@yahoo.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * Reading and writing the plugin's rc file.
+ *
+ * The file keeps the layout XfceRc gives it: one [G<n>] group per
+ * alarm, in display order, followed by an [others] group. Both ways
+ * are a single pass with no fixed-size buffers, so the cost is
+ * linear in the number of alarms.
+ **/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "timerconfig.h"
+
+
+
+struct _TimerConfigWriter
+{
+  GString *contents;
+  guint n_alarms;
+};
+
+
+
+/* Undoes the escaping of values, in place */
+static void
+config_unescape (gchar *value)
+{
+  gchar *s, *d;
+
+  for (s = d = value; *s != '\0'; s++, d++)
+    {
+      if (*s == '\\' && s[1] != '\0')
+        {
+          s++;
+          switch (*s)
+            {
+            case 'n':
+              *d = '\n';
+              break;
+            case 't':
+              *d = '\t';
+              break;
+            case 'r':
+              *d = '\r';
+              break;
+            case 's':
+              *d = ' ';
+              break;
+            default:
+              *d = *s;
+              break;
+            }
+        }
+      else
+        *d = *s;
+    }
+  *d = '\0';
+}
+
+
+
+static gboolean
+config_bool (const gchar *value)
+{
+  return g_ascii_strcasecmp (value, "true") == 0
+         || g_ascii_strcasecmp (value, "on") == 0
+         || g_ascii_strcasecmp (value, "yes") == 0;
+}
+
+
+
+static void
+config_alarm_init (TimerConfigAlarm *alarm)
+{
+  memset (alarm, 0, sizeof (*alarm));
+  alarm->is_countdown = TRUE;
+}
+
+
+
+/**
+ * Parses the contents of an rc file. The buffer is split into lines
+ * and values in place, and the strings handed out point into it.
+ * func is called for every alarm group, in file order.
+ **/
+void
+timer_config_parse (gchar *buffer,
+                    TimerConfigOptions *options,
+                    TimerConfigAlarmFunc func,
+                    gpointer user_data)
+{
+  TimerConfigAlarm alarm;
+  gboolean in_alarm = FALSE, in_others = FALSE;
+  gchar *line, *next, *key, *value;
+
+  for (line = buffer; line != NULL; line = next)
+    {
+      next = strchr (line, '\n');
+      if (next != NULL)
+        *next++ = '\0';
+
+      line = g_strstrip (line);
+      if (*line == '\0' || *line == '#')
+        continue;
+
+      /* A new group: either an alarm or the other options */
+      if (*line == '[')
+        {
+          if (in_alarm)
+            func (&alarm, user_data);
+
+          in_alarm = line[1] == 'G' && g_ascii_isdigit (line[2]);
+          in_others = strcmp (line, "[others]") == 0;
+          if (in_alarm)
+            config_alarm_init (&alarm);
+          continue;
+        }
+
+      /* Only the bare padding goes; an escaped blank is part of the value */
+      value = strchr (line, '=');
+      if (value == NULL)
+        continue;
+      *value++ = '\0';
+      key = g_strchomp (line);
+      value = g_strchug (value);
+      config_unescape (value);
+
+      if (in_alarm)
+        {
+          if (strcmp (key, "timername") == 0)
+            alarm.name = value;
+          else if (strcmp (key, "timercommand") == 0)
+            alarm.command = value;
+          else if (strcmp (key, "timerinfo") == 0)
+            alarm.info = value;
+          else if (strcmp (key, "is_countdown") == 0)
+            alarm.is_countdown = config_bool (value);
+          else if (strcmp (key, "is_recur") == 0)
+            alarm.is_recurring = config_bool (value);
+          else if (strcmp (key, "autostart") == 0)
+            alarm.is_auto_start = config_bool (value);
+          else if (strcmp (key, "time") == 0)
+            alarm.time = atoi (value);
+        }
+      else if (in_others)
+        {
+          if (strcmp (key, "nowin_if_alarm") == 0)
+            options->nowin_if_alarm = config_bool (value);
+          else if (strcmp (key, "use_global_command") == 0)
+            options->use_global_command = config_bool (value);
+          else if (strcmp (key, "global_command") == 0)
+            options->global_command = value;
+          else if (strcmp (key, "repeat_alarm") == 0)
+            options->repeat_alarm_command = config_bool (value);
+          else if (strcmp (key, "repetitions") == 0)
+            options->repetitions = atoi (value);
+          else if (strcmp (key, "repeat_interval") == 0)
+            options->repeat_interval = atoi (value);
+          else if (strcmp (key, "coalesce_window") == 0)
+            options->coalesce_window = atoi (value);
+          else if (strcmp (key, "snooze_time") == 0)
+            options->snooze_time = atoi (value);
+          else if (strcmp (key, "binary_snapshot") == 0)
+            options->use_snapshot = config_bool (value);
+          else if (strcmp (key, "skip_missed") == 0)
+            options->skip_missed = config_bool (value);
+          else if (strcmp (key, "desktop_notifications") == 0)
+            options->use_notifications = config_bool (value);
+        }
+    }
+
+  if (in_alarm)
+    func (&alarm, user_data);
+}
+
+
+
+TimerConfigWriter *
+timer_config_writer_new (void)
+{
+  TimerConfigWriter *writer;
+
+  writer = g_new0 (TimerConfigWriter, 1);
+  writer->contents = g_string_sized_new (4096);
+
+  return writer;
+}
+
+
+
+/**
+ * Appends key=value, escaping what would not survive a read: line
+ * breaks, and the blanks at either end, which would go as padding.
+ **/
+static void
+config_write_entry (GString *contents, const gchar *key, const gchar *value)
+{
+  const gchar *s, *first, *end;
+
+  g_string_append (contents, key);
+  g_string_append_c (contents, '=');
+
+  if (value == NULL)
+    value = "";
+
+  /* The blanks before first and from end on are escaped */
+  for (first = value; *first == ' '; first++);
+  for (end = value + strlen (value); end > first && end[-1] == ' '; end--);
+
+  for (s = value; *s != '\0'; s++)
+    {
+      if (*s == ' ' && (s < first || s >= end))
+        {
+          g_string_append (contents, "\\s");
+          continue;
+        }
+
+      switch (*s)
+        {
+        case '\\':
+          g_string_append (contents, "\\\\");
+          break;
+        case '\n':
+          g_string_append (contents, "\\n");
+          break;
+        case '\t':
+          g_string_append (contents, "\\t");
+          break;
+        case '\r':
+          g_string_append (contents, "\\r");
+          break;
+        default:
+          g_string_append_c (contents, *s);
+          break;
+        }
+    }
+
+  g_string_append_c (contents, '\n');
+}
+
+
+
+static void
+config_write_bool (GString *contents, const gchar *key, gboolean value)
+{
+  g_string_append_printf (contents, "%s=%s\n", key, value ? "true" : "false");
+}
+
+
+
+static void
+config_write_int (GString *contents, const gchar *key, gint value)
+{
+  g_string_append_printf (contents, "%s=%d\n", key, value);
+}
+
+
+
+/* Appends the next alarm group */
+void
+timer_config_writer_add_alarm (TimerConfigWriter *writer,
+                               const TimerConfigAlarm *alarm)
+{
+  GString *contents = writer->contents;
+
+  g_string_append_printf (contents, "[G%u]\n", writer->n_alarms++);
+  config_write_entry (contents, "timername", alarm->name);
+  config_write_int (contents, "time", alarm->time);
+  config_write_entry (contents, "timercommand", alarm->command);
+  config_write_entry (contents, "timerinfo", alarm->info);
+  config_write_bool (contents, "is_countdown", alarm->is_countdown);
+  config_write_bool (contents, "is_recur", alarm->is_recurring);
+  config_write_bool (contents, "autostart", alarm->is_auto_start);
+  g_string_append_c (contents, '\n');
+}
+
+
+
+/**
+ * Appends the other options and writes everything to path. The file
+ * is replaced atomically, so a crash never leaves it half-written.
+ * Frees the writer.
+ **/
+gboolean
+timer_config_writer_finish (TimerConfigWriter *writer,
+                            const TimerConfigOptions *options,
+                            const gchar *path,
+                            GError **error)
+{
+  GString *contents = writer->contents;
+  gboolean ok;
+
+  g_string_append (contents, "[others]\n");
+  config_write_bool (contents, "nowin_if_alarm", options->nowin_if_alarm);
+  config_write_bool (contents, "use_global_command",
+                     options->use_global_command);
+  config_write_entry (contents, "global_command", options->global_command);
+  config_write_bool (contents, "repeat_alarm", options->repeat_alarm_command);
+  config_write_int (contents, "repetitions", options->repetitions);
+  config_write_int (contents, "repeat_interval", options->repeat_interval);
+  config_write_int (contents, "coalesce_window", options->coalesce_window);
+  config_write_int (contents, "snooze_time", options->snooze_time);
+  config_write_bool (contents, "binary_snapshot", options->use_snapshot);
+  config_write_bool (contents, "skip_missed", options->skip_missed);
+  config_write_bool (contents, "desktop_notifications",
+                     options->use_notifications);
+
+  ok = g_file_set_contents (path, contents->str, contents->len, error);
+
+  g_string_free (contents, TRUE);
+  g_free (writer);
+
+  return ok;
+}
@@ -0,0 +1,72 @@
+/*
+ *
+ *  Copyright (C) 2005-2014 Kemal Ilgar Eroglu <ilgar_eroglu@yahoo.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __TIMERCONFIG_H__
+#define __TIMERCONFIG_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* One alarm group. Strings are NULL for keys that are not set. */
+typedef struct
+{
+  gchar *name, *info, *command;
+  gint time;
+  gboolean is_countdown, is_recurring, is_auto_start;
+} TimerConfigAlarm;
+
+/* The "others" group. Keys that are not set are left alone. */
+typedef struct
+{
+  gboolean nowin_if_alarm;
+  gboolean use_global_command;
+  gboolean repeat_alarm_command;
+  gboolean use_snapshot;
+  gboolean skip_missed;
+  gboolean use_notifications;
+  gint repetitions, repeat_interval;
+  gint coalesce_window; /* Seconds, 0 to fire every alarm on its own */
+  gint snooze_time; /* Seconds */
+  gchar *global_command;
+} TimerConfigOptions;
+
+typedef void (*TimerConfigAlarmFunc) (const TimerConfigAlarm *alarm,
+                                      gpointer                user_data);
+
+typedef struct _TimerConfigWriter TimerConfigWriter;
+
+void               timer_config_parse            (gchar                    *buffer,
+                                                  TimerConfigOptions       *options,
+                                                  TimerConfigAlarmFunc      func,
+                                                  gpointer                  user_data);
+
+TimerConfigWriter *timer_config_writer_new       (void);
+
+void               timer_config_writer_add_alarm (TimerConfigWriter        *writer,
+                                                  const TimerConfigAlarm   *alarm);
+
+gboolean           timer_config_writer_finish    (TimerConfigWriter        *writer,
+                                                  const TimerConfigOptions *options,
+                                                  const gchar              *path,
+                                                  GError                  **error);
+
+G_END_DECLS
+
+#endif /* !__TIMERCONFIG_H__ */
@@ -0,0 +1,1553 @@
+/*
+ *
+ *  Copyright (C) 2005-2014 Kemal Ilgar Eroglu <ilgar_eroglu@yahoo.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * The timer core: the alarm list, the countdowns, the command repeats
+ * and the recurrence, driven by the GLib main loop only. The panel
+ * plugin is a view over it and learns about changes through the
+ * callbacks, so the core can also run without a panel.
+ *
+ * Everything that is due at some point in time (a countdown ending,
+ * an alarm command being repeated) is an event of the alarm's slot.
+ * The slots with a pending event sit in a min-heap ordered by their
+ * earliest event, and one GSource is armed for the top of the heap.
+ * The ticking "At" alarms also sit in a second heap ordered by their
+ * wall deadline, the top of which the real-time clock watch is armed for.
+ **/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+
+#ifdef HAVE_SYS_TIMERFD_H
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <glib-unix.h>
+#endif
+
+#include "timerexec.h"
+#include "timerhistory.h"
+#include "timerstats.h"
+#include "timercore.h"
+
+
+
+/**
+ * The state looked at on every expiry and display update, kept
+ * apart from the alarms in packed parallel arrays indexed by
+ * TimerAlarm.slot so that it can be scanned linearly.
+ **/
+typedef struct
+{
+  gint64 *deadline; /* Monotonic time (usec) when the countdown ends */
+  gint64 *remaining; /* Remaining time (usec) while paused */
+  gint64 *repeat_at; /* Monotonic time (usec) of the next command repeat */
+  guint8 *state; /* TIMER_ALARM_* flags */
+  TimerAlarm **alarm; /* Owner of the slot */
+  guint len, size; /* Slots in use, allocated slots */
+} TimerSlots;
+
+/**
+ * A min-heap of slots. The key and the position in the heap are
+ * kept for every slot, so that they are sized along with TimerSlots.
+ **/
+typedef struct
+{
+  GArray *entries; /* Slots in the heap */
+  gint64 *key; /* Key of each slot */
+  gint *index; /* Position of each slot in entries, -1 if not in it */
+} TimerHeap;
+
+struct _TimerCore
+{
+  TimerCoreCallbacks callbacks;
+  gpointer user_data;
+  TimerCoreClock clock; /* All NULL for the system clocks */
+  gpointer clock_data;
+
+  GPtrArray *alarms; /* Alarms, in display order */
+  GHashTable *alarm_ids; /* Alarm id -> TimerAlarm */
+  guint last_id; /* Last alarm id given out */
+  gchar *buffer; /* Adopted buffer alarm strings may point into */
+  gsize buffer_len;
+
+  TimerSlots slots; /* Hot state of the alarms */
+  TimerHeap events; /* Slots with a pending event, by the earliest one */
+  TimerHeap walls; /* Ticking "At" alarms, by their wall deadline */
+  guint num_running; /* Running alarms, paused ones included */
+  GSource *expiry_source; /* Ready at the earliest event, in usec */
+  gint clock_fd; /* Real-time timerfd for the "At" alarms, or -1 */
+  guint clock_watch; /* Source ID watching clock_fd */
+  gint64 clock_armed; /* Wall deadline clock_fd is armed for */
+  gint64 coalesce; /* Events due this soon are handled together (usec) */
+  guint frozen; /* Nesting of timer_core_freeze() */
+  gboolean changed_pending; /* 'changed' held back while frozen */
+  GArray *batch; /* Commands to run once the due events are handled */
+
+  TimerExec *exec; /* Runs the alarm commands */
+  TimerHistory *history; /* Where firings are recorded, or NULL */
+  gchar **global_argv; /* Parsed default command, NULL if empty or invalid */
+  gboolean use_global_command; /* Run global_argv for alarms without a command */
+  gboolean repeat; /* Repeat the alarm command */
+  gint repetitions; /* Number of alarm repeats */
+  gint repeat_interval; /* Time between repeats (in secs) */
+
+  TimerCoreStats stats;
+};
+
+/* An alarm command put off until the end of timer_core_dispatch() */
+typedef struct
+{
+  guint alarm_id;
+  guint tag; /* History entry, or 0 */
+} TimerBatchRun;
+
+/* The countdown of a slot is running and not paused */
+#define SLOT_TICKING(core, slot) \
+  (((core)->slots.state[(slot)] & (TIMER_ALARM_RUNNING | TIMER_ALARM_PAUSED)) \
+   == TIMER_ALARM_RUNNING)
+
+/* Key of the i-th entry of a heap */
+#define HEAP_KEY(heap, i) \
+  ((heap)->key[g_array_index ((heap)->entries, guint, (i))])
+
+
+
+static gboolean
+expiry_function (gpointer data);
+
+static void
+start_at (TimerCore *core, TimerAlarm *alarm, gint64 start, gint64 after);
+
+
+
+/**
+ * Records the firings in history from now on, NULL to stop. The
+ * history stays the caller's, and must outlive the core or be unset.
+ **/
+void
+timer_core_set_history (TimerCore *core, TimerHistory *history)
+{
+  core->history = history;
+}
+
+
+
+/* The current time of the core, in usec of the monotonic clock */
+gint64
+timer_core_now (TimerCore *core)
+{
+  if (core->clock.monotonic != NULL)
+    return core->clock.monotonic (core->clock_data);
+  return g_get_monotonic_time ();
+}
+
+
+
+/* The current wall clock time of the core, in usec since the epoch */
+static gint64
+real_now (TimerCore *core)
+{
+  if (core->clock.real != NULL)
+    return core->clock.real (core->clock_data);
+  return g_get_real_time ();
+}
+
+
+
+gint64
+timer_core_real_now (TimerCore *core)
+{
+  return real_now (core);
+}
+
+
+
+static void
+notify_alarm_changed (TimerCore *core, TimerAlarm *alarm)
+{
+  if (core->callbacks.alarm_changed)
+    core->callbacks.alarm_changed (core, alarm, core->user_data);
+}
+
+
+
+static void
+notify_changed (TimerCore *core)
+{
+  if (core->frozen > 0)
+    {
+      core->changed_pending = TRUE;
+      return;
+    }
+
+  if (core->callbacks.changed)
+    core->callbacks.changed (core, core->user_data);
+}
+
+
+
+/* Runs an alarm command; tag is the history entry, or 0 */
+static void
+run_command (TimerCore *core, TimerAlarm *alarm, gchar **argv, guint tag)
+{
+  if (core->callbacks.run_command)
+    core->callbacks.run_command (core, alarm, argv, core->user_data);
+  else
+    timer_exec_run (core->exec, argv, tag);
+}
+
+
+
+/* Executor callback: a command of a firing is over */
+static void
+command_exited (guint tag, GPid pid, gint status, gint64 duration,
+                gpointer data)
+{
+  TimerCore *core = (TimerCore *) data;
+
+  if (core->history == NULL)
+    return;
+
+  if (pid == 0 && status == TIMER_EXEC_DROPPED)
+    timer_history_dropped (core->history, tag);
+  else
+    timer_history_done (core->history, tag, pid, status, duration);
+}
+
+
+
+/**
+ * Splits a command line into an argument vector. Returns NULL for
+ * an empty command, and also for an invalid one, in which case the
+ * reason is put in *error_message.
+ **/
+gchar **
+timer_core_parse_command (const gchar *command, gchar **error_message)
+{
+  gchar **argv = NULL;
+  GError *error = NULL;
+
+  *error_message = NULL;
+  if (command == NULL || command[0] == '\0')
+    return NULL;
+
+  if (!g_shell_parse_argv (command, NULL, &argv, &error))
+    {
+      *error_message = g_strdup (error->message);
+      g_error_free (error);
+      return NULL;
+    }
+
+  return argv;
+}
+
+
+
+/**
+ * Hands a buffer over to the core. Alarm strings may point into
+ * it, e.g. when they were parsed from it in place; it is freed
+ * along with the core.
+ **/
+void
+timer_core_adopt_buffer (TimerCore *core, gchar *buffer, gsize len)
+{
+  g_free (core->buffer);
+  core->buffer = buffer;
+  core->buffer_len = len;
+}
+
+
+
+/**
+ * Alarm strings may point into the adopted buffer until they are
+ * changed, so they are only freed if they were allocated on their own.
+ **/
+void
+timer_core_string_free (TimerCore *core, gchar *str)
+{
+  if (core->buffer != NULL
+      && (guintptr) str >= (guintptr) core->buffer
+      && (guintptr) str < (guintptr) (core->buffer + core->buffer_len))
+    return;
+
+  g_free (str);
+}
+
+
+
+void
+timer_core_set_name (TimerCore *core, TimerAlarm *alarm, const gchar *name)
+{
+  timer_core_string_free (core, alarm->name);
+  alarm->name = g_strdup (name);
+}
+
+
+
+void
+timer_core_set_info (TimerCore *core, TimerAlarm *alarm, const gchar *info)
+{
+  timer_core_string_free (core, alarm->info);
+  alarm->info = g_strdup (info);
+}
+
+
+
+/* Takes over the alarm command and parses it once for all firings */
+void
+timer_core_take_command (TimerCore *core, TimerAlarm *alarm, gchar *command)
+{
+  timer_core_string_free (core, alarm->command);
+  g_strfreev (alarm->argv);
+  g_free (alarm->command_error);
+
+  alarm->command = command;
+  alarm->argv = timer_core_parse_command (command, &alarm->command_error);
+}
+
+
+
+void
+timer_core_set_command (TimerCore *core, TimerAlarm *alarm,
+                        const gchar *command)
+{
+  timer_core_take_command (core, alarm, g_strdup (command));
+}
+
+
+
+/* Sets the default command, parsed the same way */
+void
+timer_core_set_global_command (TimerCore *core, const gchar *command)
+{
+  gchar *error_message;
+
+  g_strfreev (core->global_argv);
+  core->global_argv = timer_core_parse_command (command, &error_message);
+  g_free (error_message);
+}
+
+
+
+void
+timer_core_set_use_global_command (TimerCore *core, gboolean use)
+{
+  core->use_global_command = use;
+}
+
+
+
+/* Repeats of the alarm command, applied from the next firing on */
+void
+timer_core_set_repeat (TimerCore *core, gboolean repeat, gint repetitions,
+                       gint interval)
+{
+  core->repeat = repeat;
+  core->repetitions = repetitions;
+  core->repeat_interval = interval;
+}
+
+
+
+/**
+ * Alarms and repeats due within window (msec) of each other go off
+ * in one dispatch, so that their commands are spawned in one batch
+ * and the view hears of them with a single 'changed'. Later events
+ * are then handled a bit early rather than a bit later each.
+ **/
+void
+timer_core_set_coalesce (TimerCore *core, guint window)
+{
+  core->coalesce = (gint64) window * 1000;
+}
+
+
+
+/**
+ * Holds back 'changed' until the matching timer_core_thaw(), so that
+ * a loop starting or restoring many alarms makes the view update once
+ * rather than once per alarm. Calls may be nested.
+ **/
+void
+timer_core_freeze (TimerCore *core)
+{
+  core->frozen++;
+}
+
+
+
+/* Ends a timer_core_freeze(), with one 'changed' if anything changed */
+void
+timer_core_thaw (TimerCore *core)
+{
+  g_return_if_fail (core->frozen > 0);
+
+  if (--core->frozen > 0 || !core->changed_pending)
+    return;
+
+  core->changed_pending = FALSE;
+  notify_changed (core);
+}
+
+
+
+/**
+ * The command an alarm runs when it goes off: its own command if
+ * it has one (even an invalid one), else the default command if
+ * that is enabled. NULL if there is nothing to run.
+ **/
+gchar **
+timer_core_alarm_argv (TimerCore *core, TimerAlarm *alarm)
+{
+  if (alarm->command != NULL && alarm->command[0] != '\0')
+    return alarm->argv;
+  if (core->use_global_command)
+    return core->global_argv;
+  return NULL;
+}
+
+
+
+/* Swaps two entries of a heap, keeping the positions in sync */
+static void
+heap_swap (TimerHeap *heap, guint i, guint j)
+{
+  guint a = g_array_index (heap->entries, guint, i);
+  guint b = g_array_index (heap->entries, guint, j);
+
+  g_array_index (heap->entries, guint, i) = b;
+  g_array_index (heap->entries, guint, j) = a;
+  heap->index[b] = i;
+  heap->index[a] = j;
+}
+
+
+
+static void
+heap_sift_up (TimerHeap *heap, guint i)
+{
+  guint parent;
+
+  while (i > 0)
+    {
+      parent = (i - 1) / 2;
+      if (HEAP_KEY (heap, parent) <= HEAP_KEY (heap, i))
+        break;
+      heap_swap (heap, i, parent);
+      i = parent;
+    }
+}
+
+
+
+static void
+heap_sift_down (TimerHeap *heap, guint i)
+{
+  guint child, smallest;
+
+  for (;;)
+    {
+      smallest = i;
+      child = 2 * i + 1;
+      if (child < heap->entries->len
+          && HEAP_KEY (heap, child) < HEAP_KEY (heap, smallest))
+        smallest = child;
+      child++;
+      if (child < heap->entries->len
+          && HEAP_KEY (heap, child) < HEAP_KEY (heap, smallest))
+        smallest = child;
+      if (smallest == i)
+        break;
+      heap_swap (heap, i, smallest);
+      i = smallest;
+    }
+}
+
+
+
+/* Takes a slot out of a heap */
+static void
+heap_remove (TimerHeap *heap, guint slot)
+{
+  gint i = heap->index[slot];
+  guint last, moved;
+
+  if (i < 0)
+    return;
+
+  last = heap->entries->len - 1;
+  if ((guint) i != last)
+    heap_swap (heap, i, last);
+  g_array_set_size (heap->entries, last);
+  heap->index[slot] = -1;
+
+  if ((guint) i < heap->entries->len)
+    {
+      moved = g_array_index (heap->entries, guint, i);
+      heap_sift_up (heap, i);
+      heap_sift_down (heap, heap->index[moved]);
+    }
+}
+
+
+
+/* Puts a slot into a heap with the given key, or moves it there */
+static void
+heap_set (TimerHeap *heap, guint slot, gint64 key)
+{
+  gint i = heap->index[slot];
+
+  heap->key[slot] = key;
+  if (i < 0)
+    {
+      g_array_append_val (heap->entries, slot);
+      i = heap->entries->len - 1;
+      heap->index[slot] = i;
+    }
+  heap_sift_up (heap, i);
+  heap_sift_down (heap, heap->index[slot]);
+}
+
+
+
+/* Restores the heap order after many keys were changed in place */
+static void
+heap_reorder (TimerHeap *heap)
+{
+  guint i;
+
+  for (i = heap->entries->len / 2; i-- > 0;)
+    heap_sift_down (heap, i);
+}
+
+
+
+static void
+heap_init (TimerHeap *heap)
+{
+  heap->entries = g_array_new (FALSE, FALSE, sizeof (guint));
+}
+
+
+
+static void
+heap_clear (TimerHeap *heap)
+{
+  g_array_free (heap->entries, TRUE);
+  g_free (heap->key);
+  g_free (heap->index);
+}
+
+
+
+/* Makes room for the key and position of 'size' slots */
+static void
+heap_resize (TimerHeap *heap, guint size)
+{
+  heap->key = g_renew (gint64, heap->key, size);
+  heap->index = g_renew (gint, heap->index, size);
+}
+
+
+
+/* Slot 'from' was moved to 'to' by slots_free() */
+static void
+heap_move (TimerHeap *heap, guint from, guint to)
+{
+  heap->key[to] = heap->key[from];
+  heap->index[to] = heap->index[from];
+  if (heap->index[to] >= 0)
+    g_array_index (heap->entries, guint, heap->index[to]) = to;
+}
+
+
+
+/* Gives an alarm a slot in the hot state arrays */
+static void
+slots_alloc (TimerCore *core, TimerAlarm *alarm)
+{
+  TimerSlots *slots = &core->slots;
+
+  if (slots->len == slots->size)
+    {
+      slots->size = MAX (16, 2 * slots->size);
+      slots->deadline = g_renew (gint64, slots->deadline, slots->size);
+      slots->remaining = g_renew (gint64, slots->remaining, slots->size);
+      slots->repeat_at = g_renew (gint64, slots->repeat_at, slots->size);
+      slots->state = g_renew (guint8, slots->state, slots->size);
+      slots->alarm = g_renew (TimerAlarm *, slots->alarm, slots->size);
+      heap_resize (&core->events, slots->size);
+      heap_resize (&core->walls, slots->size);
+    }
+
+  alarm->slot = slots->len++;
+  slots->deadline[alarm->slot] = 0;
+  slots->remaining[alarm->slot] = 0;
+  slots->repeat_at[alarm->slot] = 0;
+  slots->state[alarm->slot] = 0;
+  slots->alarm[alarm->slot] = alarm;
+  core->events.index[alarm->slot] = -1;
+  core->walls.index[alarm->slot] = -1;
+}
+
+
+
+/**
+ * Releases the slot of an alarm that is out of the heaps. The last
+ * slot is moved into the hole so that the arrays stay packed.
+ **/
+static void
+slots_free (TimerCore *core, TimerAlarm *alarm)
+{
+  TimerSlots *slots = &core->slots;
+  guint slot = alarm->slot, last = --slots->len;
+
+  if (slot == last)
+    return;
+
+  slots->deadline[slot] = slots->deadline[last];
+  slots->remaining[slot] = slots->remaining[last];
+  slots->repeat_at[slot] = slots->repeat_at[last];
+  slots->state[slot] = slots->state[last];
+  slots->alarm[slot] = slots->alarm[last];
+  slots->alarm[slot]->slot = slot;
+
+  heap_move (&core->events, last, slot);
+  heap_move (&core->walls, last, slot);
+}
+
+
+
+/* Earliest pending event of a slot, G_MAXINT64 if there is none */
+static gint64
+slot_next_event (TimerCore *core, guint slot)
+{
+  gint64 next = G_MAXINT64;
+
+  if (SLOT_TICKING (core, slot))
+    next = core->slots.deadline[slot];
+  if (core->slots.state[slot] & TIMER_ALARM_REPEATING)
+    next = MIN (next, core->slots.repeat_at[slot]);
+
+  return next;
+}
+
+
+
+/**
+ * Puts a slot where it belongs in the heaps after its state or
+ * deadlines changed, or takes it out if nothing is pending.
+ * Call schedule_rearm() after.
+ **/
+static void
+schedule_update (TimerCore *core, guint slot)
+{
+  gint64 next = slot_next_event (core, slot);
+
+  if (next == G_MAXINT64)
+    heap_remove (&core->events, slot);
+  else
+    heap_set (&core->events, slot, next);
+
+  if (!core->slots.alarm[slot]->is_countdown && SLOT_TICKING (core, slot))
+    heap_set (&core->walls, slot, core->slots.alarm[slot]->wall_deadline);
+  else
+    heap_remove (&core->walls, slot);
+}
+
+
+
+/**
+ * Maps the real-time deadlines of the running "At" alarms
+ * onto the monotonic clock again, e.g. after the wall clock
+ * was set or the machine resumed from suspend.
+ **/
+static void
+schedule_resync_wall (TimerCore *core)
+{
+  gint64 offset;
+  guint i, slot;
+
+  if (core->walls.entries->len == 0)
+    return;
+
+  offset = timer_core_now (core) - real_now (core);
+  for (i = 0; i < core->walls.entries->len; i++)
+    {
+      slot = g_array_index (core->walls.entries, guint, i);
+      core->slots.deadline[slot] = core->walls.key[slot] + offset;
+      core->events.key[slot] = slot_next_event (core, slot);
+    }
+
+  /* Several keys may have moved, so restore the heap order at once */
+  heap_reorder (&core->events);
+}
+
+
+
+/**
+ * Arms the real-time clock watch for the earliest wall deadline.
+ * Besides expiring at the right wall time even across a suspend,
+ * it is cancelled when the clock is set so we can resync at once.
+ **/
+static void
+clock_watch_rearm (TimerCore *core)
+{
+#ifdef HAVE_SYS_TIMERFD_H
+  struct itimerspec spec = { { 0, 0 }, { 0, 0 } };
+  gint64 earliest = G_MAXINT64;
+
+  if (core->clock_fd < 0)
+    return;
+
+  /* A custom clock has nothing to do with the system's */
+  if (core->walls.entries->len > 0 && core->clock.real == NULL)
+    earliest = HEAP_KEY (&core->walls, 0);
+
+  /* An all-zero value disarms it */
+  if (earliest != G_MAXINT64)
+    {
+      spec.it_value.tv_sec = earliest / G_USEC_PER_SEC;
+      spec.it_value.tv_nsec = (earliest % G_USEC_PER_SEC) * 1000;
+    }
+
+  if (earliest == core->clock_armed)
+    return;
+  core->clock_armed = earliest;
+
+  if (timerfd_settime (core->clock_fd,
+                       TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET,
+                       &spec, NULL) < 0)
+    g_warning ("Could not arm the clock watch: %s", g_strerror (errno));
+#endif
+}
+
+
+
+/**
+ * Arms the expiry source for the exact earliest event
+ * in the heap, or disarms it if nothing is pending.
+ * With a custom clock the owner calls timer_core_dispatch()
+ * instead, so it stays disarmed.
+ **/
+static void
+schedule_rearm (TimerCore *core)
+{
+  g_source_set_ready_time (core->expiry_source,
+                           core->events.entries->len > 0
+                           && core->clock.monotonic == NULL
+                           ? HEAP_KEY (&core->events, 0) : -1);
+  clock_watch_rearm (core);
+}
+
+
+
+#ifdef HAVE_SYS_TIMERFD_H
+/**
+ * The real-time clock watch expired or was cancelled
+ * because the clock was set: recompute the monotonic
+ * deadlines of the "At" alarms and let expiry run.
+ **/
+static gboolean
+clock_watch_function (gint fd, GIOCondition condition, gpointer data)
+{
+  TimerCore *core = (TimerCore *) data;
+  guint64 expirations;
+
+  /* Fails with ECANCELED on a clock change, which is all we need to know */
+  if (read (fd, &expirations, sizeof (expirations)) < 0
+      && errno != ECANCELED && errno != EAGAIN)
+    g_warning ("Could not read the clock watch: %s", g_strerror (errno));
+
+  /* Force it to be armed again, it is disarmed once cancelled */
+  core->clock_armed = -1;
+  schedule_resync_wall (core);
+  schedule_rearm (core);
+
+  return G_SOURCE_CONTINUE;
+}
+#endif
+
+
+
+/* The expiry source is dispatched once its ready time has passed */
+static gboolean
+expiry_dispatch (GSource *source, GSourceFunc callback, gpointer data)
+{
+  g_source_set_ready_time (source, -1);
+  return callback (data);
+}
+
+
+
+static GSourceFuncs expiry_source_funcs =
+{
+  NULL, NULL, expiry_dispatch, NULL
+};
+
+
+
+/* Monotonic time of the earliest pending event, -1 if there is none */
+gint64
+timer_core_next_event (TimerCore *core)
+{
+  return core->events.entries->len > 0 ? HEAP_KEY (&core->events, 0) : -1;
+}
+
+
+
+/**
+ * Tells the core that the real-time clock was set, so the "At"
+ * alarms are mapped onto the monotonic clock again. The system
+ * clock is watched by the core itself.
+ **/
+void
+timer_core_clock_changed (TimerCore *core)
+{
+  schedule_resync_wall (core);
+  schedule_rearm (core);
+}
+
+
+
+/**
+ * Makes the core go by another clock, e.g. a simulated one, or
+ * by the system clocks again if clock is NULL. A function left
+ * NULL uses the system clock. The deadlines of the running
+ * alarms are kept as they are, so switch before starting any.
+ **/
+void
+timer_core_set_clock (TimerCore *core, const TimerCoreClock *clock,
+                      gpointer user_data)
+{
+  if (clock != NULL)
+    core->clock = *clock;
+  else
+    core->clock.monotonic = core->clock.real = NULL;
+  core->clock_data = user_data;
+
+  schedule_rearm (core);
+}
+
+
+
+TimerCore *
+timer_core_new (const TimerCoreCallbacks *callbacks, gpointer user_data)
+{
+  TimerCore *core;
+
+  core = g_new0 (TimerCore, 1);
+  if (callbacks)
+    core->callbacks = *callbacks;
+  core->user_data = user_data;
+
+  core->alarms = g_ptr_array_new ();
+  core->alarm_ids = g_hash_table_new (g_direct_hash, g_direct_equal);
+  heap_init (&core->events);
+  heap_init (&core->walls);
+  core->batch = g_array_new (FALSE, FALSE, sizeof (TimerBatchRun));
+  core->repetitions = 1;
+  core->repeat_interval = 10;
+
+  core->expiry_source = g_source_new (&expiry_source_funcs, sizeof (GSource));
+  g_source_set_priority (core->expiry_source, G_PRIORITY_HIGH);
+  g_source_set_callback (core->expiry_source, expiry_function, core, NULL);
+  g_source_attach (core->expiry_source, NULL);
+
+  core->exec = timer_exec_new (TIMER_EXEC_MAX_RUNNING, command_exited, core);
+
+  core->clock_fd = -1;
+  core->clock_armed = -1;
+#ifdef HAVE_SYS_TIMERFD_H
+  core->clock_fd = timerfd_create (CLOCK_REALTIME, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (core->clock_fd >= 0)
+    core->clock_watch = g_unix_fd_add (core->clock_fd, G_IO_IN,
+                                       clock_watch_function, core);
+  else
+    g_warning ("Could not watch the clock: %s", g_strerror (errno));
+#endif
+
+  return core;
+}
+
+
+
+static void
+alarm_free (TimerCore *core, TimerAlarm *alarm)
+{
+  timer_core_string_free (core, alarm->name);
+  timer_core_string_free (core, alarm->info);
+  timer_core_string_free (core, alarm->command);
+  g_strfreev (alarm->argv);
+  g_free (alarm->command_error);
+  g_free (alarm);
+}
+
+
+
+/**
+ * Frees the core and its alarms. No callback is called; the view
+ * has to release the user_data of the alarms beforehand.
+ **/
+void
+timer_core_free (TimerCore *core)
+{
+  guint i;
+
+  for (i = 0; i < core->alarms->len; i++)
+    alarm_free (core, g_ptr_array_index (core->alarms, i));
+  g_ptr_array_free (core->alarms, TRUE);
+  g_hash_table_destroy (core->alarm_ids);
+  g_free (core->buffer);
+
+  g_source_destroy (core->expiry_source);
+  g_source_unref (core->expiry_source);
+#ifdef HAVE_SYS_TIMERFD_H
+  if (core->clock_watch != 0)
+    g_source_remove (core->clock_watch);
+  if (core->clock_fd >= 0)
+    close (core->clock_fd);
+#endif
+  timer_exec_free (core->exec);
+
+  heap_clear (&core->events);
+  heap_clear (&core->walls);
+  g_array_free (core->batch, TRUE);
+  g_free (core->slots.deadline);
+  g_free (core->slots.remaining);
+  g_free (core->slots.repeat_at);
+  g_free (core->slots.state);
+  g_free (core->slots.alarm);
+  g_strfreev (core->global_argv);
+
+  g_free (core);
+}
+
+
+
+/**
+ * Appends a new, stopped alarm with a new id. Its strings are
+ * NULL; set at least the name and command before starting it.
+ **/
+TimerAlarm *
+timer_core_add (TimerCore *core)
+{
+  TimerAlarm *alarm;
+
+  alarm = g_new0 (TimerAlarm, 1);
+  alarm->id = ++core->last_id;
+  alarm->rem_repetitions = 1;
+  slots_alloc (core, alarm);
+  g_ptr_array_add (core->alarms, alarm);
+  g_hash_table_insert (core->alarm_ids, GUINT_TO_POINTER (alarm->id), alarm);
+
+  return alarm;
+}
+
+
+
+/**
+ * Removes and frees the alarm at position index. It is stopped
+ * first and its command is not repeated anymore; the view has to
+ * release its user_data beforehand. The alarms after it move up.
+ **/
+void
+timer_core_remove (TimerCore *core, guint index)
+{
+  TimerAlarm *alarm = g_ptr_array_index (core->alarms, index);
+
+  if (core->slots.state[alarm->slot] & TIMER_ALARM_RUNNING)
+    core->num_running--;
+  core->slots.state[alarm->slot] = 0;
+  heap_remove (&core->events, alarm->slot);
+  heap_remove (&core->walls, alarm->slot);
+  schedule_rearm (core);
+
+  g_hash_table_remove (core->alarm_ids, GUINT_TO_POINTER (alarm->id));
+  g_ptr_array_remove_index (core->alarms, index);
+  slots_free (core, alarm);
+  alarm_free (core, alarm);
+
+  notify_changed (core);
+}
+
+
+
+guint
+timer_core_n_alarms (TimerCore *core)
+{
+  return core->alarms->len;
+}
+
+
+
+TimerAlarm *
+timer_core_get (TimerCore *core, guint index)
+{
+  return (TimerAlarm *) g_ptr_array_index (core->alarms, index);
+}
+
+
+
+/* Returns the position of the alarm in the list; it has to be in it */
+guint
+timer_core_position (TimerCore *core, TimerAlarm *alarm)
+{
+  guint i;
+
+  for (i = 0; i < core->alarms->len; i++)
+    if (g_ptr_array_index (core->alarms, i) == alarm)
+      return i;
+
+  g_return_val_if_reached (0);
+}
+
+
+
+/* Returns the alarm with the given id, NULL if there is none */
+TimerAlarm *
+timer_core_lookup (TimerCore *core, guint id)
+{
+  return (TimerAlarm *) g_hash_table_lookup (core->alarm_ids,
+                                             GUINT_TO_POINTER (id));
+}
+
+
+
+/* Swaps the alarms at positions i and j */
+void
+timer_core_swap (TimerCore *core, guint i, guint j)
+{
+  gpointer temp = g_ptr_array_index (core->alarms, i);
+
+  g_ptr_array_index (core->alarms, i) = g_ptr_array_index (core->alarms, j);
+  g_ptr_array_index (core->alarms, j) = temp;
+}
+
+
+
+guint8
+timer_core_get_state (TimerCore *core, TimerAlarm *alarm)
+{
+  return core->slots.state[alarm->slot];
+}
+
+
+
+guint
+timer_core_n_running (TimerCore *core)
+{
+  return core->num_running;
+}
+
+
+
+const TimerCoreStats *
+timer_core_get_stats (TimerCore *core)
+{
+  return &core->stats;
+}
+
+
+
+/* Remaining time of a running (maybe paused) alarm in usec */
+gint64
+timer_core_remaining (TimerCore *core, TimerAlarm *alarm, gint64 now)
+{
+  if (core->slots.state[alarm->slot] & TIMER_ALARM_PAUSED)
+    return core->slots.remaining[alarm->slot];
+
+  /* The expiry source may not have been dispatched yet */
+  return MAX (core->slots.deadline[alarm->slot] - now, 0);
+}
+
+
+
+/**
+ * Finds the running or paused alarm that will finish first,
+ * NULL if no timer is on. This is one linear pass over the
+ * packed hot arrays; the loop body has no branches so that
+ * the compiler can vectorise it.
+ **/
+TimerAlarm *
+timer_core_first_to_finish (TimerCore *core, gint64 now)
+{
+  const TimerSlots *slots = &core->slots;
+  gint64 key, min_key = G_MAXINT64;
+  guint i;
+
+  for (i = 0; i < slots->len; i++)
+    {
+      key = (slots->state[i] & TIMER_ALARM_PAUSED) ? slots->remaining[i]
+                                                   : slots->deadline[i] - now;
+      key = (slots->state[i] & TIMER_ALARM_RUNNING) ? key : G_MAXINT64;
+      min_key = MIN (min_key, key);
+    }
+
+  if (min_key == G_MAXINT64)
+    return NULL;
+
+  for (i = 0; i < slots->len; i++)
+    if ((slots->state[i] & TIMER_ALARM_RUNNING)
+        && ((slots->state[i] & TIMER_ALARM_PAUSED) ? slots->remaining[i]
+                                                   : slots->deadline[i] - now) == min_key)
+      return slots->alarm[i];
+
+  return NULL;
+}
+
+
+
+/**
+ * Returns the first local time of day 'minutes' strictly after
+ * the real time 'after', both in usec since the epoch.
+ * Going through the local date keeps DST changes right.
+ **/
+static gint64
+next_wall_time (gint minutes, gint64 after)
+{
+  GDateTime *now, *day, *target;
+  gint64 result;
+  gint i;
+
+  now = g_date_time_new_from_unix_local (after / G_USEC_PER_SEC);
+  for (i = 0; i < 3; i++)
+    {
+      day = g_date_time_add_days (now, i);
+      target = g_date_time_new_local (g_date_time_get_year (day),
+                                      g_date_time_get_month (day),
+                                      g_date_time_get_day_of_month (day),
+                                      minutes / 60, minutes % 60, 0);
+      g_date_time_unref (day);
+      if (target == NULL)
+        continue;
+      result = g_date_time_to_unix (target) * G_USEC_PER_SEC;
+      g_date_time_unref (target);
+      if (result > after)
+        break;
+    }
+  g_date_time_unref (now);
+
+  /* Cannot really happen, but never hand back a past deadline */
+  if (i == 3)
+    result = after + G_TIME_SPAN_DAY;
+
+  return result;
+}
+
+
+
+/**
+ * Starts a stopped alarm. A countdown starts at the given
+ * monotonic time, which lets a recurring alarm restart from
+ * its deadline instead of from when it was handled. An "At"
+ * alarm goes off at its time of day next after both now and
+ * the real time 'after', 0 if it does not matter.
+ **/
+static void
+start_at (TimerCore *core, TimerAlarm *alarm, gint64 start, gint64 after)
+{
+  gint64 timeout_period, now_real;
+  guint slot = alarm->slot;
+
+  /**
+   *  If it's a 24h type alarm, it is kept as a real-time deadline
+   *  and only mapped onto the monotonic clock for the heap.
+   *  Here 'time' is in minutes
+   **/
+  if (!alarm->is_countdown)
+    {
+      start = timer_core_now (core);
+      now_real = real_now (core);
+      alarm->wall_deadline = next_wall_time (alarm->time,
+                                             MAX (now_real, after));
+      timeout_period = alarm->wall_deadline - now_real;
+    }
+  /* Else 'time' already gives the countdown period in seconds */
+  else
+    {
+      timeout_period = (gint64) alarm->time * G_USEC_PER_SEC;
+    }
+
+  alarm->timeout_period_in_sec = (gint) ((timeout_period + G_USEC_PER_SEC - 1)
+                                         / G_USEC_PER_SEC);
+
+  core->slots.state[slot] = (core->slots.state[slot] & TIMER_ALARM_REPEATING)
+                            | TIMER_ALARM_RUNNING;
+  core->slots.deadline[slot] = start + timeout_period;
+  core->num_running++;
+
+  schedule_update (core, slot);
+  schedule_rearm (core);
+  notify_alarm_changed (core, alarm);
+}
+
+
+
+/* Starts an alarm, unless it is running already */
+void
+timer_core_start (TimerCore *core, TimerAlarm *alarm)
+{
+  if (core->slots.state[alarm->slot] & TIMER_ALARM_RUNNING)
+    return;
+
+  alarm->snoozes = 0;
+  start_at (core, alarm, timer_core_now (core), 0);
+  notify_changed (core);
+}
+
+
+
+/* Stops a running or paused alarm. Repeats of its command go on. */
+void
+timer_core_stop (TimerCore *core, TimerAlarm *alarm)
+{
+  guint slot = alarm->slot;
+
+  if (!(core->slots.state[slot] & TIMER_ALARM_RUNNING))
+    return;
+
+  core->slots.state[slot] &= ~(TIMER_ALARM_RUNNING | TIMER_ALARM_PAUSED);
+  core->num_running--;
+
+  schedule_update (core, slot);
+  schedule_rearm (core);
+  notify_alarm_changed (core, alarm);
+  notify_changed (core);
+}
+
+
+
+void
+timer_core_pause (TimerCore *core, TimerAlarm *alarm)
+{
+  guint slot = alarm->slot;
+
+  if (!SLOT_TICKING (core, slot))
+    return;
+
+  core->slots.remaining[slot] = timer_core_remaining (core, alarm,
+                                                      timer_core_now (core));
+  core->slots.state[slot] |= TIMER_ALARM_PAUSED;
+
+  schedule_update (core, slot);
+  schedule_rearm (core);
+  notify_alarm_changed (core, alarm);
+  notify_changed (core);
+}
+
+
+
+void
+timer_core_resume (TimerCore *core, TimerAlarm *alarm)
+{
+  guint slot = alarm->slot;
+
+  if (!(core->slots.state[slot] & TIMER_ALARM_PAUSED))
+    return;
+
+  core->slots.deadline[slot] = timer_core_now (core)
+                               + core->slots.remaining[slot];
+  alarm->wall_deadline = real_now (core) + core->slots.remaining[slot];
+  core->slots.state[slot] &= ~TIMER_ALARM_PAUSED;
+
+  schedule_update (core, slot);
+  schedule_rearm (core);
+  notify_alarm_changed (core, alarm);
+  notify_changed (core);
+}
+
+
+
+/**
+ * Makes an alarm go off again 'seconds' from now, in place of its
+ * deadline if it is running, paused or not. Repeats of its command
+ * stop. The slot is only updated and moved in the heap. The
+ * progress runs over the snooze, and a recurring alarm carries on
+ * from the snoozed firing.
+ **/
+void
+timer_core_snooze (TimerCore *core, TimerAlarm *alarm, gint seconds)
+{
+  guint slot = alarm->slot;
+  gint64 delay;
+
+  seconds = MAX (seconds, 1);
+  delay = (gint64) seconds * G_USEC_PER_SEC;
+
+  if (!(core->slots.state[slot] & TIMER_ALARM_RUNNING))
+    core->num_running++;
+  core->slots.state[slot] = TIMER_ALARM_RUNNING;
+  core->slots.deadline[slot] = timer_core_now (core) + delay;
+  alarm->wall_deadline = real_now (core) + delay;
+  alarm->timeout_period_in_sec = seconds;
+  alarm->snoozes++;
+
+  schedule_update (core, slot);
+  schedule_rearm (core);
+  notify_alarm_changed (core, alarm);
+  notify_changed (core);
+}
+
+
+
+/**
+ * Puts a stopped alarm back into the state it had before the panel
+ * was restarted: running until the wall clock time wall_deadline,
+ * or paused with 'remaining' usec to go. 'period' is the length of
+ * its countdown in seconds, as shown by the progress. A deadline
+ * that has passed fires at the next dispatch, as late as it is.
+ **/
+void
+timer_core_restore (TimerCore *core, TimerAlarm *alarm, gint64 wall_deadline,
+                    gint64 remaining, gint period, gboolean paused)
+{
+  guint slot = alarm->slot;
+  gint64 now_real = real_now (core);
+
+  if (core->slots.state[slot] & TIMER_ALARM_RUNNING)
+    return;
+
+  alarm->timeout_period_in_sec = period;
+  core->slots.state[slot] |= TIMER_ALARM_RUNNING;
+
+  if (paused)
+    {
+      core->slots.state[slot] |= TIMER_ALARM_PAUSED;
+      core->slots.remaining[slot] = MAX (remaining, 0);
+      alarm->wall_deadline = now_real + core->slots.remaining[slot];
+    }
+  else
+    alarm->wall_deadline = wall_deadline;
+
+  /* Long past, it could fall below 0, which next_event() takes for none */
+  core->slots.deadline[slot] = MAX (timer_core_now (core)
+                                    + (alarm->wall_deadline - now_real), 0);
+  core->num_running++;
+
+  schedule_update (core, slot);
+  schedule_rearm (core);
+  notify_alarm_changed (core, alarm);
+  notify_changed (core);
+}
+
+
+
+/* Puts off running the command of an alarm to the end of the dispatch */
+static void
+batch_add (TimerCore *core, TimerAlarm *alarm, guint tag)
+{
+  TimerBatchRun run = { alarm->id, tag };
+
+  g_array_append_val (core->batch, run);
+}
+
+
+
+/**
+ * Runs the commands of the events just handled. The alarms are
+ * looked up again, as the 'fired' callbacks may have changed them.
+ **/
+static void
+batch_run (TimerCore *core)
+{
+  TimerBatchRun *run;
+  TimerAlarm *alarm;
+  gchar **argv;
+  guint i;
+
+  for (i = 0; i < core->batch->len; i++)
+    {
+      run = &g_array_index (core->batch, TimerBatchRun, i);
+      alarm = timer_core_lookup (core, run->alarm_id);
+      if (alarm != NULL && (argv = timer_core_alarm_argv (core, alarm)) != NULL)
+        run_command (core, alarm, argv, run->tag);
+      else if (run->tag != 0 && core->history)
+        timer_history_done (core->history, run->tag, 0, -1, 0);
+    }
+  g_array_set_size (core->batch, 0);
+}
+
+
+
+/* Countdown is over: notify the view and queue the alarm command */
+static void
+alarm_fired (TimerCore *core, TimerAlarm *alarm, gint64 due, gint64 now)
+{
+  gchar **argv;
+  gint64 period, fired_real;
+  guint slot = alarm->slot, tag = 0;
+
+  /* Track how late the main loop got round to this deadline */
+  alarm->lateness = MAX (now - due, 0);
+  core->stats.fired++;
+  core->stats.lateness_total += alarm->lateness;
+  core->stats.lateness_max = MAX (core->stats.lateness_max, alarm->lateness);
+  TIMER_STATS_RECORD (TIMER_STAT_FIRE_LATENESS_US, alarm->lateness);
+  g_debug ("Alarm %s fired %" G_GINT64_FORMAT " us late",
+           alarm->name, alarm->lateness);
+
+  /* Stop timer */
+  core->slots.state[slot] &= ~TIMER_ALARM_RUNNING;
+  core->num_running--;
+
+  if (core->callbacks.fired)
+    core->callbacks.fired (core, alarm, core->user_data);
+
+  /* If an alarm command is set, it overrides the default (if any) */
+  argv = timer_core_alarm_argv (core, alarm);
+
+  if (core->history)
+    {
+      fired_real = real_now (core);
+      tag = timer_history_fired (core->history, alarm->id,
+                                 fired_real - alarm->lateness, fired_real,
+                                 argv != NULL
+                                 && core->callbacks.run_command == NULL);
+    }
+
+  if (argv != NULL)
+    {
+      batch_add (core, alarm, tag);
+
+      if (core->repeat)
+        {
+          core->slots.state[slot] |= TIMER_ALARM_REPEATING;
+          alarm->rem_repetitions = core->repetitions;
+          core->slots.repeat_at[slot] = now + (gint64) MAX (core->repeat_interval, 1)
+                                              * G_USEC_PER_SEC;
+        }
+    }
+
+  /**
+   * A recurring alarm starts again right away. A recurring countdown
+   * restarts from its deadline so it does not drift. An "At" alarm
+   * goes on to the day after its deadline even if it fired a bit
+   * early, coalesced with an earlier event, lest it fire again.
+   **/
+  if (alarm->is_recurring)
+    {
+      if (alarm->is_countdown)
+        {
+          period = (gint64) MAX (alarm->time, 1) * G_USEC_PER_SEC;
+          /* Skip the periods that were missed altogether */
+          while (due + period <= now + core->coalesce)
+            due += period;
+        }
+      start_at (core, alarm, due, alarm->wall_deadline);
+    }
+  else
+    notify_alarm_changed (core, alarm);
+}
+
+
+
+/**
+ * The next repeat of an alarm command is due. The repeats are
+ * spaced from the firing, not from when they were handled.
+ **/
+static void
+alarm_repeat (TimerCore *core, TimerAlarm *alarm, gint64 now)
+{
+  gint64 interval;
+  guint slot = alarm->slot;
+
+  /* Don't repeat anymore */
+  if (alarm->rem_repetitions <= 0)
+    {
+      core->slots.state[slot] &= ~TIMER_ALARM_REPEATING;
+      notify_alarm_changed (core, alarm);
+      return;
+    }
+
+  TIMER_STATS_RECORD (TIMER_STAT_REPEAT_LATENESS_US,
+                      MAX (now - core->slots.repeat_at[slot], 0));
+
+  if (timer_core_alarm_argv (core, alarm) != NULL)
+    batch_add (core, alarm, 0);
+  alarm->rem_repetitions--;
+
+  interval = (gint64) MAX (core->repeat_interval, 1) * G_USEC_PER_SEC;
+  do
+    core->slots.repeat_at[slot] += interval;
+  while (core->slots.repeat_at[slot] <= now + core->coalesce);
+}
+
+
+
+/**
+ * Handles every event that is due by the core's clock and rearms.
+ * The expiry source calls it; the owner of a custom clock calls it
+ * after moving the clock on.
+ **/
+void
+timer_core_dispatch (TimerCore *core)
+{
+  TimerAlarm *alarm;
+  gint64 now, due;
+  guint slot;
+
+  while (core->events.entries->len > 0)
+    {
+      /* The callbacks may take a while, so refresh now */
+      now = timer_core_now (core);
+      slot = g_array_index (core->events.entries, guint, 0);
+      if (core->events.key[slot] > now + core->coalesce)
+        break;
+
+      alarm = core->slots.alarm[slot];
+      due = core->slots.deadline[slot];
+      if (SLOT_TICKING (core, slot) && due <= now + core->coalesce)
+        {
+          if (!alarm->is_countdown
+              && real_now (core) + core->coalesce < alarm->wall_deadline)
+            {
+              /* The clocks drifted apart, go by the wall clock */
+              schedule_resync_wall (core);
+              continue;
+            }
+          alarm_fired (core, alarm, due, now);
+        }
+      else
+        alarm_repeat (core, alarm, now);
+
+      schedule_update (core, alarm->slot);
+    }
+
+  batch_run (core);
+  schedule_rearm (core);
+  notify_changed (core);
+}
+
+
+
+/* This is the callback of the expiry source, armed for the earliest event */
+static gboolean
+expiry_function (gpointer data)
+{
+  TimerCore *core = (TimerCore *) data;
+
+  core->stats.wakeups++;
+  timer_core_dispatch (core);
+
+  return G_SOURCE_CONTINUE;
+}
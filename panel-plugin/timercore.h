@@ -0,0 +1,237 @@
+/*
+ *
+ *  Copyright (C) 2005-2014 Kemal Ilgar Eroglu <ilgar_eroglu@yahoo.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __TIMERCORE_H__
+#define __TIMERCORE_H__
+
+#include <glib.h>
+
+#include "timerhistory.h"
+
+G_BEGIN_DECLS
+
+/* Values of timer_core_get_state() */
+#define TIMER_ALARM_RUNNING   (1 << 0) /* Countdown is on, maybe paused */
+#define TIMER_ALARM_PAUSED    (1 << 1) /* Countdown is paused */
+#define TIMER_ALARM_REPEATING (1 << 2) /* Alarm command is being repeated */
+
+typedef struct _TimerCore TimerCore;
+
+/**
+ * An alarm of the core. The strings are owned by the core; they
+ * may point into a buffer handed over with timer_core_adopt_buffer().
+ * Everything below 'slot' is maintained by the core.
+ **/
+typedef struct
+{
+  guint id; /* Stable id, never reused */
+  gchar *name, *info;
+  gchar *command; /* Command when countdown ends */
+  gchar **argv; /* Parsed command, NULL if empty or invalid */
+  gchar *command_error; /* Why the command could not be parsed, or NULL */
+  gint time; /* Countdown in seconds, or time of day in minutes */
+  gboolean is_recurring, is_auto_start;
+  gboolean is_countdown; /* True if the alarm type is contdown */
+  gpointer user_data; /* Owned by the view */
+
+  guint slot; /* Index of the hot state in the core */
+  gint timeout_period_in_sec; /* Active countdown period */
+  gint rem_repetitions; /* Remaining repeats */
+  gint64 lateness; /* How late the last firing was (usec) */
+  gint64 wall_deadline; /* Real-time deadline of an "At" alarm (usec) */
+  guint snoozes; /* Times snoozed since it was last started */
+} TimerAlarm;
+
+/* Totals kept by the core since it was created */
+typedef struct
+{
+  guint wakeups; /* Expiry source dispatches */
+  guint fired; /* Alarms fired */
+  gint64 lateness_total; /* Sum of the firing lateness (usec) */
+  gint64 lateness_max; /* Worst firing lateness (usec) */
+} TimerCoreStats;
+
+/**
+ * Where the core takes the time from, both in usec: 'monotonic'
+ * never jumps, 'real' is the wall clock the "At" alarms go by.
+ **/
+typedef struct
+{
+  gint64 (*monotonic) (gpointer user_data);
+  gint64 (*real)      (gpointer user_data);
+} TimerCoreClock;
+
+/**
+ * How the core reports back. 'fired' is called when a countdown
+ * ends, before the alarm command is run and a recurring alarm is
+ * restarted. 'alarm_changed' is called whenever the state of one
+ * alarm changed, and 'changed' once after a batch of such changes,
+ * e.g. at the end of every call that starts or stops alarms, or
+ * at the end of a timer_core_freeze().
+ * If 'run_command' is set, alarm commands are handed to it
+ * instead of being spawned. Any of them may be NULL.
+ **/
+typedef struct
+{
+  void (*fired)         (TimerCore  *core,
+                         TimerAlarm *alarm,
+                         gpointer    user_data);
+  void (*alarm_changed) (TimerCore  *core,
+                         TimerAlarm *alarm,
+                         gpointer    user_data);
+  void (*changed)       (TimerCore  *core,
+                         gpointer    user_data);
+  void (*run_command)   (TimerCore  *core,
+                         TimerAlarm *alarm,
+                         gchar     **argv,
+                         gpointer    user_data);
+} TimerCoreCallbacks;
+
+TimerCore   *timer_core_new                (const TimerCoreCallbacks *callbacks,
+                                            gpointer                  user_data);
+
+void         timer_core_free               (TimerCore                *core);
+
+void         timer_core_set_clock          (TimerCore                *core,
+                                            const TimerCoreClock     *clock,
+                                            gpointer                  user_data);
+
+void         timer_core_set_history        (TimerCore                *core,
+                                            TimerHistory             *history);
+
+gint64       timer_core_now                (TimerCore                *core);
+
+gint64       timer_core_real_now           (TimerCore                *core);
+
+void         timer_core_dispatch           (TimerCore                *core);
+
+gint64       timer_core_next_event         (TimerCore                *core);
+
+void         timer_core_clock_changed      (TimerCore                *core);
+
+gchar      **timer_core_parse_command      (const gchar              *command,
+                                            gchar                   **error_message);
+
+/* Alarm model */
+TimerAlarm  *timer_core_add                (TimerCore                *core);
+
+void         timer_core_remove             (TimerCore                *core,
+                                            guint                     index);
+
+guint        timer_core_n_alarms           (TimerCore                *core);
+
+TimerAlarm  *timer_core_get                (TimerCore                *core,
+                                            guint                     index);
+
+guint        timer_core_position           (TimerCore                *core,
+                                            TimerAlarm               *alarm);
+
+TimerAlarm  *timer_core_lookup             (TimerCore                *core,
+                                            guint                     id);
+
+void         timer_core_swap               (TimerCore                *core,
+                                            guint                     i,
+                                            guint                     j);
+
+void         timer_core_adopt_buffer       (TimerCore                *core,
+                                            gchar                    *buffer,
+                                            gsize                     len);
+
+void         timer_core_string_free        (TimerCore                *core,
+                                            gchar                    *str);
+
+void         timer_core_set_name           (TimerCore                *core,
+                                            TimerAlarm               *alarm,
+                                            const gchar              *name);
+
+void         timer_core_set_info           (TimerCore                *core,
+                                            TimerAlarm               *alarm,
+                                            const gchar              *info);
+
+void         timer_core_take_command       (TimerCore                *core,
+                                            TimerAlarm               *alarm,
+                                            gchar                    *command);
+
+void         timer_core_set_command        (TimerCore                *core,
+                                            TimerAlarm               *alarm,
+                                            const gchar              *command);
+
+/* What an alarm runs when it goes off */
+void         timer_core_set_global_command (TimerCore                *core,
+                                            const gchar              *command);
+
+void         timer_core_set_use_global_command (TimerCore            *core,
+                                                gboolean              use);
+
+void         timer_core_set_repeat         (TimerCore                *core,
+                                            gboolean                  repeat,
+                                            gint                      repetitions,
+                                            gint                      interval);
+
+void         timer_core_set_coalesce       (TimerCore                *core,
+                                            guint                     window);
+
+void         timer_core_freeze             (TimerCore                *core);
+
+void         timer_core_thaw               (TimerCore                *core);
+
+gchar      **timer_core_alarm_argv         (TimerCore                *core,
+                                            TimerAlarm               *alarm);
+
+/* Scheduling */
+void         timer_core_start              (TimerCore                *core,
+                                            TimerAlarm               *alarm);
+
+void         timer_core_stop               (TimerCore                *core,
+                                            TimerAlarm               *alarm);
+
+void         timer_core_pause              (TimerCore                *core,
+                                            TimerAlarm               *alarm);
+
+void         timer_core_resume             (TimerCore                *core,
+                                            TimerAlarm               *alarm);
+
+void         timer_core_snooze             (TimerCore                *core,
+                                            TimerAlarm               *alarm,
+                                            gint                      seconds);
+
+guint8       timer_core_get_state          (TimerCore                *core,
+                                            TimerAlarm               *alarm);
+
+void         timer_core_restore            (TimerCore                *core,
+                                            TimerAlarm               *alarm,
+                                            gint64                    wall_deadline,
+                                            gint64                    remaining,
+                                            gint                      period,
+                                            gboolean                  paused);
+
+gint64       timer_core_remaining          (TimerCore                *core,
+                                            TimerAlarm               *alarm,
+                                            gint64                    now);
+
+TimerAlarm  *timer_core_first_to_finish    (TimerCore                *core,
+                                            gint64                    now);
+
+guint        timer_core_n_running          (TimerCore                *core);
+
+const TimerCoreStats *timer_core_get_stats (TimerCore                *core);
+
+G_END_DECLS
+
+#endif /* !__TIMERCORE_H__ */
@@ -0,0 +1,389 @@
+/*
+ *
+ *  Copyright (C) 2005-2014 Kemal Ilgar Eroglu <ilgar_eroglu@yahoo.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * The org.xfce.TimerPlugin D-Bus interface, so that scripts can
+ * start, stop and query the timers of a running plugin, e.g.
+ *
+ *   gdbus call --session --dest org.xfce.TimerPlugin \
+ *         --object-path /org/xfce/TimerPlugin/<plugin id> \
+ *         --method org.xfce.TimerPlugin.ListTimers
+ *
+ * Timers are addressed by the ids that ListTimers and Add return.
+ * Every call acts on the core directly, the rc file is neither read
+ * nor written. When several plugins run, the first one owns the
+ * well-known name and the others answer on their unique names.
+ **/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "timerdbus.h"
+
+
+
+/* Times are the alarm's: seconds for a countdown, minutes of the day otherwise */
+static const gchar introspection_xml[] =
+  "<node>"
+  "  <interface name='" TIMER_DBUS_INTERFACE "'>"
+  "    <method name='Start'>"
+  "      <arg type='u' name='id' direction='in'/>"
+  "    </method>"
+  "    <method name='Stop'>"
+  "      <arg type='u' name='id' direction='in'/>"
+  "    </method>"
+  "    <method name='Pause'>"
+  "      <arg type='u' name='id' direction='in'/>"
+  "    </method>"
+  "    <method name='Resume'>"
+  "      <arg type='u' name='id' direction='in'/>"
+  "    </method>"
+  "    <method name='Add'>"
+  "      <arg type='s' name='name' direction='in'/>"
+  "      <arg type='b' name='countdown' direction='in'/>"
+  "      <arg type='i' name='time' direction='in'/>"
+  "      <arg type='s' name='command' direction='in'/>"
+  "      <arg type='u' name='id' direction='out'/>"
+  "    </method>"
+  "    <method name='Remove'>"
+  "      <arg type='u' name='id' direction='in'/>"
+  "    </method>"
+  "    <!-- Goes off again in 'seconds', returns the times snoozed -->"
+  "    <method name='Snooze'>"
+  "      <arg type='u' name='id' direction='in'/>"
+  "      <arg type='i' name='seconds' direction='in'/>"
+  "      <arg type='u' name='snoozes' direction='out'/>"
+  "    </method>"
+  "    <!-- id, name, info, state flags, remaining seconds or -1 -->"
+  "    <method name='ListTimers'>"
+  "      <arg type='a(ussui)' name='timers' direction='out'/>"
+  "    </method>"
+  "    <signal name='Fired'>"
+  "      <arg type='u' name='id'/>"
+  "      <arg type='s' name='name'/>"
+  "    </signal>"
+  "  </interface>"
+  "</node>";
+
+
+
+struct _TimerDBus
+{
+  TimerCore *core;
+  gchar *object_path;
+  TimerDBusCallbacks callbacks;
+  gpointer user_data;
+  GDBusNodeInfo *node_info;
+  GDBusConnection *connection; /* Set once the object is exported */
+  guint owner_id; /* Well-known name request */
+  guint registration_id; /* Exported object */
+};
+
+
+
+/* Finds the alarm of the id argument, or returns an error to the caller */
+static TimerAlarm *
+lookup_alarm (TimerDBus *dbus, GVariant *parameters,
+              GDBusMethodInvocation *invocation)
+{
+  TimerAlarm *alarm;
+  guint id;
+
+  g_variant_get_child (parameters, 0, "u", &id);
+  alarm = timer_core_lookup (dbus->core, id);
+
+  if (alarm == NULL)
+    g_dbus_method_invocation_return_error (invocation, G_DBUS_ERROR,
+                                           G_DBUS_ERROR_INVALID_ARGS,
+                                           "No timer with id %u", id);
+  return alarm;
+}
+
+
+
+/**
+ * All the alarms with their state and remaining time, in list
+ * order. They are read at one instant, so the times agree.
+ **/
+static GVariant *
+list_timers (TimerDBus *dbus)
+{
+  GVariantBuilder builder;
+  TimerAlarm *alarm;
+  gint64 now = timer_core_now (dbus->core);
+  gint remaining;
+  guint8 state;
+  guint i;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(ussui)"));
+
+  for (i = 0; i < timer_core_n_alarms (dbus->core); i++)
+    {
+      alarm = timer_core_get (dbus->core, i);
+      state = timer_core_get_state (dbus->core, alarm);
+
+      /* Rounded up, like the tooltip */
+      remaining = -1;
+      if (state & TIMER_ALARM_RUNNING)
+        remaining = (timer_core_remaining (dbus->core, alarm, now)
+                     + G_USEC_PER_SEC - 1) / G_USEC_PER_SEC;
+
+      g_variant_builder_add (&builder, "(ussui)", alarm->id,
+                             alarm->name ? alarm->name : "",
+                             alarm->info ? alarm->info : "",
+                             (guint32) state, remaining);
+    }
+
+  return g_variant_new ("(a(ussui))", &builder);
+}
+
+
+
+static void
+add_timer (TimerDBus *dbus, GVariant *parameters,
+           GDBusMethodInvocation *invocation)
+{
+  const gchar *name, *command;
+  gboolean is_countdown;
+  TimerAlarm *alarm;
+  gint time;
+
+  g_variant_get (parameters, "(&sbi&s)", &name, &is_countdown, &time,
+                 &command);
+
+  if (time < 0 || (!is_countdown && time >= 24 * 60))
+    {
+      g_dbus_method_invocation_return_error (invocation, G_DBUS_ERROR,
+                                             G_DBUS_ERROR_INVALID_ARGS,
+                                             "Invalid time %d", time);
+      return;
+    }
+
+  alarm = timer_core_add (dbus->core);
+  timer_core_set_name (dbus->core, alarm, name);
+  timer_core_set_info (dbus->core, alarm, "");
+  timer_core_set_command (dbus->core, alarm, command);
+  alarm->is_countdown = is_countdown;
+  alarm->time = time;
+
+  if (dbus->callbacks.added)
+    dbus->callbacks.added (dbus->core, alarm, dbus->user_data);
+
+  g_dbus_method_invocation_return_value (invocation,
+                                         g_variant_new ("(u)", alarm->id));
+}
+
+
+
+static void
+remove_timer (TimerDBus *dbus, TimerAlarm *alarm)
+{
+  guint index = timer_core_position (dbus->core, alarm);
+
+  if (dbus->callbacks.remove)
+    dbus->callbacks.remove (dbus->core, alarm, index, dbus->user_data);
+  else
+    timer_core_remove (dbus->core, index);
+}
+
+
+
+static void
+snooze_timer (TimerDBus *dbus, TimerAlarm *alarm, GVariant *parameters,
+              GDBusMethodInvocation *invocation)
+{
+  gint seconds;
+
+  g_variant_get_child (parameters, 1, "i", &seconds);
+  if (seconds <= 0)
+    {
+      g_dbus_method_invocation_return_error (invocation, G_DBUS_ERROR,
+                                             G_DBUS_ERROR_INVALID_ARGS,
+                                             "Invalid time %d", seconds);
+      return;
+    }
+
+  if (dbus->callbacks.snooze)
+    dbus->callbacks.snooze (dbus->core, alarm, seconds, dbus->user_data);
+  else
+    timer_core_snooze (dbus->core, alarm, seconds);
+
+  g_dbus_method_invocation_return_value (invocation,
+                                         g_variant_new ("(u)", alarm->snoozes));
+}
+
+
+
+static void
+method_call (GDBusConnection *connection, const gchar *sender,
+             const gchar *object_path, const gchar *interface_name,
+             const gchar *method_name, GVariant *parameters,
+             GDBusMethodInvocation *invocation, gpointer user_data)
+{
+  TimerDBus *dbus = (TimerDBus *) user_data;
+  TimerAlarm *alarm;
+
+  if (g_strcmp0 (method_name, "ListTimers") == 0)
+    {
+      g_dbus_method_invocation_return_value (invocation, list_timers (dbus));
+      return;
+    }
+
+  if (g_strcmp0 (method_name, "Add") == 0)
+    {
+      add_timer (dbus, parameters, invocation);
+      return;
+    }
+
+  /* The others take a timer id. GDBus has checked the signature. */
+  if (!(alarm = lookup_alarm (dbus, parameters, invocation)))
+    return;
+
+  if (g_strcmp0 (method_name, "Snooze") == 0)
+    {
+      snooze_timer (dbus, alarm, parameters, invocation);
+      return;
+    }
+
+  /* Like the menu, only a countdown can be paused */
+  if (g_strcmp0 (method_name, "Pause") == 0 && !alarm->is_countdown)
+    {
+      g_dbus_method_invocation_return_error (invocation, G_DBUS_ERROR,
+                                             G_DBUS_ERROR_NOT_SUPPORTED,
+                                             "Timer %u is not a countdown",
+                                             alarm->id);
+      return;
+    }
+
+  if (g_strcmp0 (method_name, "Start") == 0)
+    timer_core_start (dbus->core, alarm);
+  else if (g_strcmp0 (method_name, "Stop") == 0)
+    timer_core_stop (dbus->core, alarm);
+  else if (g_strcmp0 (method_name, "Pause") == 0)
+    timer_core_pause (dbus->core, alarm);
+  else if (g_strcmp0 (method_name, "Resume") == 0)
+    timer_core_resume (dbus->core, alarm);
+  else if (g_strcmp0 (method_name, "Remove") == 0)
+    remove_timer (dbus, alarm);
+
+  g_dbus_method_invocation_return_value (invocation, NULL);
+}
+
+
+
+static const GDBusInterfaceVTable interface_vtable =
+{
+  method_call, NULL, NULL
+};
+
+
+
+/* Exports the object as soon as there is a connection, name or not */
+static void
+bus_acquired (GDBusConnection *connection, const gchar *name,
+              gpointer user_data)
+{
+  TimerDBus *dbus = (TimerDBus *) user_data;
+  GError *error = NULL;
+
+  dbus->registration_id = g_dbus_connection_register_object (
+      connection, dbus->object_path, dbus->node_info->interfaces[0],
+      &interface_vtable, dbus, NULL, &error);
+
+  if (dbus->registration_id == 0)
+    {
+      g_warning ("Cannot export %s: %s", dbus->object_path, error->message);
+      g_error_free (error);
+      return;
+    }
+
+  dbus->connection = g_object_ref (connection);
+}
+
+
+
+static void
+name_lost (GDBusConnection *connection, const gchar *name,
+           gpointer user_data)
+{
+  if (connection == NULL)
+    g_debug ("No session bus, %s is not available", name);
+  else
+    g_debug ("%s is owned by another plugin", name);
+}
+
+
+
+/**
+ * Exports the core at object_path on the session bus. The core
+ * must outlive the service.
+ **/
+TimerDBus *
+timer_dbus_new (TimerCore *core, const gchar *object_path,
+                const TimerDBusCallbacks *callbacks, gpointer user_data)
+{
+  TimerDBus *dbus = g_new0 (TimerDBus, 1);
+
+  dbus->core = core;
+  dbus->object_path = g_strdup (object_path);
+  if (callbacks)
+    dbus->callbacks = *callbacks;
+  dbus->user_data = user_data;
+  dbus->node_info = g_dbus_node_info_new_for_xml (introspection_xml, NULL);
+
+  dbus->owner_id = g_bus_own_name (G_BUS_TYPE_SESSION, TIMER_DBUS_NAME,
+                                   G_BUS_NAME_OWNER_FLAGS_NONE, bus_acquired,
+                                   NULL, name_lost, dbus, NULL);
+
+  return dbus;
+}
+
+
+
+void
+timer_dbus_free (TimerDBus *dbus)
+{
+  if (dbus->registration_id != 0)
+    g_dbus_connection_unregister_object (dbus->connection,
+                                         dbus->registration_id);
+  g_bus_unown_name (dbus->owner_id);
+
+  if (dbus->connection)
+    g_object_unref (dbus->connection);
+  g_dbus_node_info_unref (dbus->node_info);
+  g_free (dbus->object_path);
+  g_free (dbus);
+}
+
+
+
+/* Emits the Fired signal, to be called from the core's 'fired' callback */
+void
+timer_dbus_emit_fired (TimerDBus *dbus, TimerAlarm *alarm)
+{
+  if (dbus->connection == NULL)
+    return;
+
+  g_dbus_connection_emit_signal (dbus->connection, NULL, dbus->object_path,
+                                 TIMER_DBUS_INTERFACE, "Fired",
+                                 g_variant_new ("(us)", alarm->id,
+                                                alarm->name ? alarm->name : ""),
+                                 NULL);
+}
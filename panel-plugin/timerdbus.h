@@ -0,0 +1,70 @@
+/*
+ *
+ *  Copyright (C) 2005-2014 Kemal Ilgar Eroglu <ilgar_eroglu@yahoo.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __TIMERDBUS_H__
+#define __TIMERDBUS_H__
+
+#include <gio/gio.h>
+
+#include "timercore.h"
+
+G_BEGIN_DECLS
+
+/* Well-known name and object path prefix of the control interface */
+#define TIMER_DBUS_NAME      "org.xfce.TimerPlugin"
+#define TIMER_DBUS_INTERFACE "org.xfce.TimerPlugin"
+#define TIMER_DBUS_PATH      "/org/xfce/TimerPlugin"
+
+typedef struct _TimerDBus TimerDBus;
+
+/**
+ * How the service reports back. 'added' is called once an alarm
+ * made by Add is filled in, so the owner can attach its data.
+ * If 'remove' is set, Remove hands the alarm over to it instead of
+ * calling timer_core_remove(), and likewise 'snooze' for Snooze
+ * and timer_core_snooze(). Any of them may be NULL.
+ **/
+typedef struct
+{
+  void (*added)  (TimerCore  *core,
+                  TimerAlarm *alarm,
+                  gpointer    user_data);
+  void (*remove) (TimerCore  *core,
+                  TimerAlarm *alarm,
+                  guint       index,
+                  gpointer    user_data);
+  void (*snooze) (TimerCore  *core,
+                  TimerAlarm *alarm,
+                  gint        seconds,
+                  gpointer    user_data);
+} TimerDBusCallbacks;
+
+TimerDBus *timer_dbus_new        (TimerCore                *core,
+                                  const gchar              *object_path,
+                                  const TimerDBusCallbacks *callbacks,
+                                  gpointer                  user_data);
+
+void       timer_dbus_free       (TimerDBus                *dbus);
+
+void       timer_dbus_emit_fired (TimerDBus                *dbus,
+                                  TimerAlarm               *alarm);
+
+G_END_DECLS
+
+#endif /* !__TIMERDBUS_H__ */
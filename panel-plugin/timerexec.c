@@ -0,0 +1,344 @@
+/*
+ *
+ *  Copyright (C) 2005-2014 Kemal Ilgar Eroglu <ilgar_eroglu@yahoo.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * Runs the alarm commands on behalf of the plugin.
+ *
+ * Every child is tracked with a child watch so it gets reaped, and at
+ * most max_running commands run at the same time; the others wait in
+ * a queue and are started as the running ones exit. Long-running
+ * commands (say, an audio player) must not hold back the later alarms
+ * for good, so a command that waited TIMER_EXEC_MAX_WAIT seconds is
+ * started anyway. The queue takes TIMER_EXEC_MAX_PENDING commands at
+ * most; further ones are dropped. The commands are spawned from an
+ * argument vector, without a shell, by posix_spawnp(): unlike fork()
+ * it does not copy the panel's address space on Linux, and the child
+ * gets none of the panel's descriptors bar stdin, stdout and stderr.
+ **/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+/* glibc declares posix_spawn_file_actions_addclosefrom_np() for GNU only */
+#ifdef HAVE_POSIX_SPAWN_FILE_ACTIONS_ADDCLOSEFROM_NP
+#define _GNU_SOURCE
+#endif
+
+#include <signal.h>
+#include <spawn.h>
+#include <stdlib.h>
+
+#ifndef HAVE_POSIX_SPAWN_FILE_ACTIONS_ADDCLOSEFROM_NP
+#include <dirent.h>
+#endif
+
+#include "timerexec.h"
+#include "timerstats.h"
+
+
+
+struct _TimerExec
+{
+  guint max_running;
+  guint running; /* Children not reaped yet */
+  GQueue pending; /* TimerExecJobs waiting for a free slot */
+  guint wait_timeout; /* Source ID, for the head of the queue */
+  gboolean closing; /* Freed by the owner, goes away with the last child */
+  TimerExecFunc func;
+  gpointer user_data;
+};
+
+/* A command, queued or running */
+typedef struct
+{
+  TimerExec *exec;
+  gchar **argv;
+  guint tag;
+  gint64 start; /* When it was queued, then spawned (monotonic) */
+} TimerExecJob;
+
+
+
+static void
+timer_exec_drain (TimerExec *exec);
+
+extern char **environ;
+
+
+
+/* func, if set, is told how the tagged commands ended */
+TimerExec *
+timer_exec_new (guint max_running, TimerExecFunc func, gpointer user_data)
+{
+  TimerExec *exec;
+
+  exec = g_new0 (TimerExec, 1);
+  exec->max_running = MAX (max_running, 1);
+  exec->func = func;
+  exec->user_data = user_data;
+  g_queue_init (&exec->pending);
+
+  return exec;
+}
+
+
+
+static void
+timer_exec_job_free (TimerExecJob *job)
+{
+  g_strfreev (job->argv);
+  g_free (job);
+}
+
+
+
+/* A command that never ran is over */
+static void
+timer_exec_job_drop (TimerExec *exec, TimerExecJob *job, gint status)
+{
+  if (exec->func != NULL && job->tag != 0)
+    exec->func (job->tag, 0, status, 0, exec->user_data);
+  timer_exec_job_free (job);
+}
+
+
+
+/**
+ * Drops the queued commands, which func hears of. The children
+ * already running are still reaped, and the executor is only
+ * released after them; func is not called anymore for those.
+ **/
+void
+timer_exec_free (TimerExec *exec)
+{
+  TimerExecJob *job;
+
+  if (exec == NULL)
+    return;
+
+  if (exec->wait_timeout != 0)
+    g_source_remove (exec->wait_timeout);
+  while ((job = g_queue_pop_head (&exec->pending)) != NULL)
+    timer_exec_job_drop (exec, job, TIMER_EXEC_DROPPED);
+
+  exec->closing = TRUE;
+  if (exec->running == 0)
+    g_free (exec);
+}
+
+
+
+static void
+timer_exec_child_exited (GPid pid, gint status, gpointer data)
+{
+  TimerExecJob *job = (TimerExecJob *) data;
+  TimerExec *exec = job->exec;
+
+  g_spawn_close_pid (pid);
+  exec->running--;
+
+  if (!exec->closing && exec->func != NULL && job->tag != 0)
+    exec->func (job->tag, pid, status, g_get_monotonic_time () - job->start,
+                exec->user_data);
+  g_free (job);
+
+  if (exec->closing)
+    {
+      if (exec->running == 0)
+        g_free (exec);
+      return;
+    }
+
+  timer_exec_drain (exec);
+}
+
+
+
+/**
+ * Has the child close the descriptors of the panel above stderr.
+ * GLib opens its own close-on-exec, but other libraries and plugins
+ * in the panel need not. Without closefrom, the open descriptors
+ * are listed; one closed meanwhile is no error to posix_spawn().
+ **/
+static void
+timer_exec_close_fds (posix_spawn_file_actions_t *actions)
+{
+#ifdef HAVE_POSIX_SPAWN_FILE_ACTIONS_ADDCLOSEFROM_NP
+  posix_spawn_file_actions_addclosefrom_np (actions, 3);
+#else
+  struct dirent *entry;
+  DIR *dir;
+  gint fd;
+
+  dir = opendir ("/proc/self/fd");
+  if (dir == NULL)
+    dir = opendir ("/dev/fd");
+  if (dir == NULL)
+    return;
+
+  while ((entry = readdir (dir)) != NULL)
+    {
+      fd = atoi (entry->d_name);
+      if (fd > 2 && fd != dirfd (dir))
+        posix_spawn_file_actions_addclose (actions, fd);
+    }
+  closedir (dir);
+#endif
+}
+
+
+
+/* Takes over the job, which lives on until the child exits */
+static gboolean
+timer_exec_spawn (TimerExec *exec, TimerExecJob *job)
+{
+  posix_spawn_file_actions_t actions;
+  posix_spawnattr_t attr;
+  sigset_t signals;
+  pid_t pid;
+  gint err;
+  gint64 start = TIMER_STATS_CLOCK ();
+
+  posix_spawn_file_actions_init (&actions);
+  timer_exec_close_fds (&actions);
+
+  /* Signals the panel blocks or ignores are the command's to handle */
+  posix_spawnattr_init (&attr);
+  sigemptyset (&signals);
+  posix_spawnattr_setsigmask (&attr, &signals);
+  sigaddset (&signals, SIGPIPE);
+  sigaddset (&signals, SIGCHLD);
+  sigaddset (&signals, SIGHUP);
+  sigaddset (&signals, SIGINT);
+  sigaddset (&signals, SIGQUIT);
+  sigaddset (&signals, SIGTERM);
+  posix_spawnattr_setsigdefault (&attr, &signals);
+  posix_spawnattr_setflags (&attr, POSIX_SPAWN_SETSIGMASK
+                                   | POSIX_SPAWN_SETSIGDEF);
+
+  err = posix_spawnp (&pid, job->argv[0], &actions, &attr, job->argv,
+                      environ);
+  posix_spawnattr_destroy (&attr);
+  posix_spawn_file_actions_destroy (&actions);
+  TIMER_STATS_RECORD_SINCE (TIMER_STAT_SPAWN_US, start);
+
+  if (err == 0)
+    {
+      exec->running++;
+      job->start = g_get_monotonic_time ();
+      g_strfreev (job->argv);
+      job->argv = NULL;
+      g_child_watch_add (pid, timer_exec_child_exited, job);
+      return TRUE;
+    }
+
+  g_warning ("Could not run '%s': %s", job->argv[0], g_strerror (err));
+  timer_exec_job_drop (exec, job, TIMER_EXEC_FAILED);
+
+  return FALSE;
+}
+
+
+
+/* The head of the queue waited long enough: run what is overdue */
+static gboolean
+timer_exec_wait_over (gpointer data)
+{
+  TimerExec *exec = (TimerExec *) data;
+
+  exec->wait_timeout = 0;
+  timer_exec_drain (exec);
+
+  return G_SOURCE_REMOVE;
+}
+
+
+
+/**
+ * Starts queued commands while there is a free slot, and those that
+ * waited too long regardless. Then arms the wait timeout for the new
+ * head of the queue, which is the one that waits longest.
+ **/
+static void
+timer_exec_drain (TimerExec *exec)
+{
+  TimerExecJob *job;
+  gint64 now = g_get_monotonic_time ();
+  gint64 max_wait = (gint64) TIMER_EXEC_MAX_WAIT * G_USEC_PER_SEC;
+
+  while ((job = g_queue_peek_head (&exec->pending)) != NULL
+         && (exec->running < exec->max_running
+             || now - job->start >= max_wait))
+    timer_exec_spawn (exec, g_queue_pop_head (&exec->pending));
+
+  if (exec->wait_timeout != 0)
+    {
+      g_source_remove (exec->wait_timeout);
+      exec->wait_timeout = 0;
+    }
+  if (job != NULL)
+    exec->wait_timeout = g_timeout_add ((guint) ((job->start + max_wait - now
+                                                  + 999) / 1000),
+                                        timer_exec_wait_over, exec);
+}
+
+
+
+/**
+ * Runs the command given as an argument vector, or queues it
+ * if too many commands are running already. argv is copied.
+ * Unless tag is 0, func learns how the command ended.
+ * Returns FALSE if the command could not be started or queued.
+ **/
+gboolean
+timer_exec_run (TimerExec *exec, gchar **argv, guint tag)
+{
+  TimerExecJob *job;
+
+  g_return_val_if_fail (exec != NULL && !exec->closing, FALSE);
+
+  if (argv == NULL || argv[0] == NULL)
+    return FALSE;
+
+  job = g_new0 (TimerExecJob, 1);
+  job->exec = exec;
+  job->argv = g_strdupv (argv);
+  job->tag = tag;
+
+  if (exec->running >= exec->max_running)
+    {
+      if (g_queue_get_length (&exec->pending) >= TIMER_EXEC_MAX_PENDING)
+        {
+          g_warning ("Too many alarm commands waiting, dropping '%s'",
+                     argv[0]);
+          timer_exec_job_drop (exec, job, TIMER_EXEC_DROPPED);
+          return FALSE;
+        }
+
+      job->start = g_get_monotonic_time ();
+      g_queue_push_tail (&exec->pending, job);
+      if (exec->wait_timeout == 0)
+        timer_exec_drain (exec);
+      return TRUE;
+    }
+
+  return timer_exec_spawn (exec, job);
+}
+
@@ -0,0 +1,66 @@
+/*
+ *
+ *  Copyright (C) 2005-2014 Kemal Ilgar Eroglu <ilgar_eroglu@yahoo.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __TIMEREXEC_H__
+#define __TIMEREXEC_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Alarm commands allowed to run at the same time */
+#define TIMER_EXEC_MAX_RUNNING 4
+
+/* Alarm commands allowed to wait for a free slot */
+#define TIMER_EXEC_MAX_PENDING 64
+
+/* Seconds a command waits at most before it is run over the limit */
+#define TIMER_EXEC_MAX_WAIT 5
+
+/* Status passed along with a pid of 0 */
+#define TIMER_EXEC_FAILED  (-1) /* The command could not be started */
+#define TIMER_EXEC_DROPPED (-2) /* It was dropped from the queue unstarted */
+
+typedef struct _TimerExec TimerExec;
+
+/**
+ * Called when a command tagged with a non-zero tag is over: with
+ * its pid, wait status and run time (usec) when it exited, or with
+ * a pid of 0 and TIMER_EXEC_FAILED or TIMER_EXEC_DROPPED as status
+ * when it never ran.
+ **/
+typedef void (*TimerExecFunc) (guint    tag,
+                               GPid     pid,
+                               gint     status,
+                               gint64   duration,
+                               gpointer user_data);
+
+TimerExec *timer_exec_new  (guint          max_running,
+                            TimerExecFunc  func,
+                            gpointer       user_data);
+
+void       timer_exec_free (TimerExec     *exec);
+
+gboolean   timer_exec_run  (TimerExec     *exec,
+                            gchar        **argv,
+                            guint          tag);
+
+G_END_DECLS
+
+#endif /* !__TIMEREXEC_H__ */
@@ -0,0 +1,407 @@
+/*
+ *
+ *  Copyright (C) 2005-2014 Kemal Ilgar Eroglu <ilgar_eroglu@yahoo.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * The firing history: when each alarm went off, how late, and how
+ * its command ended.
+ *
+ * The latest firings are kept in a fixed ring. Once a firing is
+ * complete, i.e. its command exited, a copy goes to a writer thread
+ * that appends it to the log file, so the main loop never waits for
+ * the disk. The log is a header followed by TimerHistoryEvent
+ * records; past max_size it is renamed to <path>.1, replacing the
+ * previous one, and a new log is started.
+ **/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <glib/gstdio.h>
+
+#include "timerhistory.h"
+
+
+
+#define HISTORY_MAGIC   "XFTIMHST"
+#define HISTORY_VERSION 1
+
+typedef struct
+{
+  gchar magic[8];
+  guint32 version;
+  guint32 record_size;
+} HistoryHeader;
+
+G_STATIC_ASSERT (sizeof (HistoryHeader) == 16);
+G_STATIC_ASSERT (sizeof (TimerHistoryEvent) == 40);
+
+typedef struct
+{
+  guint seq; /* Firing number, 0 for an unused slot */
+  guint queued; /* Position in the log queue, 0 until handed over */
+  TimerHistoryEvent event;
+} HistorySlot;
+
+struct _TimerHistory
+{
+  HistorySlot ring[TIMER_HISTORY_RING];
+  guint next_seq;
+  guint n_queued; /* Events handed to the writer */
+  gchar *path, *rotated_path; /* NULL if kept in memory only */
+  gsize max_size;
+  GAsyncQueue *queue; /* Events for the writer */
+  GThread *writer;
+  GMutex lock; /* Guards the three below and the rotation */
+  guint n_written; /* Events the writer is done with */
+  gsize log_size; /* Bytes of the log that are complete, all until opened */
+  guint rotations; /* Times the log was rotated */
+};
+
+/* Tells the writer to finish */
+static gchar history_stop;
+
+
+
+static void
+history_header_init (HistoryHeader *header)
+{
+  memset (header, 0, sizeof (*header));
+  memcpy (header->magic, HISTORY_MAGIC, sizeof (header->magic));
+  header->version = HISTORY_VERSION;
+  header->record_size = sizeof (TimerHistoryEvent);
+}
+
+
+
+/* Opens the log for appending, with a header if it is new */
+static FILE *
+history_open (TimerHistory *history, gsize *size)
+{
+  HistoryHeader header;
+  FILE *log;
+  long end;
+
+  log = g_fopen (history->path, "ab");
+  if (log == NULL)
+    {
+      g_warning ("Cannot open %s: %s", history->path, g_strerror (errno));
+      return NULL;
+    }
+
+  end = (fseek (log, 0, SEEK_END) == 0) ? ftell (log) : -1;
+  if (end <= 0)
+    {
+      history_header_init (&header);
+      fwrite (&header, sizeof (header), 1, log);
+      end = sizeof (header);
+    }
+
+  *size = end;
+  return log;
+}
+
+
+
+/* The writer thread: appends the events it is handed, in order */
+static gpointer
+history_writer (gpointer data)
+{
+  TimerHistory *history = (TimerHistory *) data;
+  TimerHistoryEvent *event;
+  FILE *log = NULL;
+  gsize size = 0;
+
+  while ((event = g_async_queue_pop (history->queue))
+         != (gpointer) &history_stop)
+    {
+      if (log == NULL)
+        {
+          g_mutex_lock (&history->lock);
+          log = history_open (history, &size);
+          history->log_size = size;
+          g_mutex_unlock (&history->lock);
+        }
+
+      /* Readers stop at log_size, so the write itself needs no lock */
+      if (log != NULL && fwrite (event, sizeof (*event), 1, log) == 1
+          && fflush (log) == 0)
+        size += sizeof (*event);
+
+      g_mutex_lock (&history->lock);
+      history->n_written++;
+      history->log_size = size;
+
+      if (log != NULL && size >= history->max_size)
+        {
+          fclose (log);
+          log = NULL;
+          g_rename (history->path, history->rotated_path);
+          history->rotations++;
+          history->log_size = size = 0;
+        }
+
+      g_mutex_unlock (&history->lock);
+      g_free (event);
+    }
+
+  if (log != NULL)
+    fclose (log);
+
+  return NULL;
+}
+
+
+
+/**
+ * Creates the history, logging to path unless it is NULL. The
+ * log and its rotated copy together take at most about twice
+ * max_size bytes.
+ **/
+TimerHistory *
+timer_history_new (const gchar *path, gsize max_size)
+{
+  TimerHistory *history;
+
+  history = g_new0 (TimerHistory, 1);
+  history->next_seq = 1;
+  history->log_size = G_MAXSIZE;
+  g_mutex_init (&history->lock);
+
+  if (path != NULL)
+    {
+      history->path = g_strdup (path);
+      history->rotated_path = g_strconcat (path, ".1", NULL);
+      history->max_size = MAX (max_size, sizeof (HistoryHeader)
+                                         + sizeof (TimerHistoryEvent));
+      history->queue = g_async_queue_new ();
+      history->writer = g_thread_new ("timer-history", history_writer,
+                                      history);
+    }
+
+  return history;
+}
+
+
+
+/* Hands an event over to the writer */
+static void
+history_queue (TimerHistory *history, HistorySlot *slot)
+{
+  TimerHistoryEvent *copy;
+
+  slot->queued = ++history->n_queued;
+
+  if (history->queue == NULL)
+    return;
+
+  copy = g_new (TimerHistoryEvent, 1);
+  *copy = slot->event;
+  g_async_queue_push (history->queue, copy);
+}
+
+
+
+/* Logs the firings whose commands are still running, and stops the writer */
+void
+timer_history_free (TimerHistory *history)
+{
+  guint i;
+
+  if (history == NULL)
+    return;
+
+  if (history->writer != NULL)
+    {
+      for (i = 0; i < TIMER_HISTORY_RING; i++)
+        if (history->ring[i].seq != 0 && history->ring[i].queued == 0)
+          history_queue (history, &history->ring[i]);
+
+      g_async_queue_push (history->queue, &history_stop);
+      g_thread_join (history->writer);
+      g_async_queue_unref (history->queue);
+    }
+
+  g_mutex_clear (&history->lock);
+  g_free (history->path);
+  g_free (history->rotated_path);
+  g_free (history);
+}
+
+
+
+/**
+ * Records that an alarm went off. If command is TRUE, the event is
+ * only complete once timer_history_done() is called with the number
+ * returned here. Times are on the wall clock.
+ **/
+guint
+timer_history_fired (TimerHistory *history, guint alarm_id, gint64 due,
+                     gint64 fired, gboolean command)
+{
+  HistorySlot *slot;
+  guint seq;
+
+  seq = history->next_seq++;
+  if (history->next_seq == 0)
+    history->next_seq = 1;
+
+  slot = &history->ring[seq % TIMER_HISTORY_RING];
+
+  /* A firing still waiting for its command is logged unfinished */
+  if (slot->seq != 0 && slot->queued == 0)
+    history_queue (history, slot);
+
+  memset (slot, 0, sizeof (*slot));
+  slot->seq = seq;
+  slot->event.alarm_id = alarm_id;
+  slot->event.due = due;
+  slot->event.fired = fired;
+  slot->event.flags = command ? TIMER_HISTORY_COMMAND : TIMER_HISTORY_DONE;
+
+  if (!command)
+    history_queue (history, slot);
+
+  return seq;
+}
+
+
+
+/* The command of firing seq is over; pid is 0 if it could not be started */
+void
+timer_history_done (TimerHistory *history, guint seq, GPid pid, gint status,
+                    gint64 duration)
+{
+  HistorySlot *slot = &history->ring[seq % TIMER_HISTORY_RING];
+
+  if (seq == 0 || slot->seq != seq || slot->queued != 0)
+    return;
+
+  slot->event.pid = pid;
+  slot->event.status = status;
+  slot->event.duration = duration;
+  slot->event.flags |= TIMER_HISTORY_DONE
+                       | (pid == 0 ? TIMER_HISTORY_FAILED : 0);
+
+  history_queue (history, slot);
+}
+
+
+
+/* The command of firing seq was dropped before it was started */
+void
+timer_history_dropped (TimerHistory *history, guint seq)
+{
+  HistorySlot *slot = &history->ring[seq % TIMER_HISTORY_RING];
+
+  if (seq == 0 || slot->seq != seq || slot->queued != 0)
+    return;
+
+  slot->event.flags |= TIMER_HISTORY_DONE | TIMER_HISTORY_DROPPED;
+
+  history_queue (history, slot);
+}
+
+
+
+static void
+history_read_log (const gchar *path, gsize size, GArray *events)
+{
+  HistoryHeader header, expected;
+  TimerHistoryEvent event;
+  gchar *contents;
+  gsize len, offset;
+
+  if (!g_file_get_contents (path, &contents, &len, NULL))
+    return;
+
+  history_header_init (&expected);
+  memcpy (&header, contents, MIN (len, sizeof (header)));
+  len = MIN (len, size);
+
+  if (len >= sizeof (header)
+      && memcmp (&header, &expected, sizeof (header)) == 0)
+    for (offset = sizeof (header); offset + sizeof (event) <= len;
+         offset += sizeof (event))
+      {
+        memcpy (&event, contents + offset, sizeof (event));
+        g_array_append_val (events, event);
+      }
+
+  g_free (contents);
+}
+
+
+
+/**
+ * Calls func for every firing in the log and in memory, oldest
+ * first. This reads the log files, so it is meant for showing the
+ * history on request rather than for the hot path. The writer goes
+ * on meanwhile: only the part of the log it was done with when the
+ * reading started is read, and both files are read anew by path
+ * should it rotate the log in between.
+ **/
+void
+timer_history_foreach (TimerHistory *history, TimerHistoryFunc func,
+                       gpointer user_data)
+{
+  HistorySlot *slot;
+  GArray *events;
+  gsize log_size;
+  guint i, rotations, written = 0;
+  gboolean rotated;
+
+  events = g_array_new (FALSE, FALSE, sizeof (TimerHistoryEvent));
+
+  while (history->path != NULL)
+    {
+      g_mutex_lock (&history->lock);
+      written = history->n_written;
+      log_size = history->log_size;
+      rotations = history->rotations;
+      g_mutex_unlock (&history->lock);
+
+      g_array_set_size (events, 0);
+      history_read_log (history->rotated_path, G_MAXSIZE, events);
+      history_read_log (history->path, log_size, events);
+
+      g_mutex_lock (&history->lock);
+      rotated = history->rotations != rotations;
+      g_mutex_unlock (&history->lock);
+
+      if (!rotated)
+        break;
+    }
+
+  for (i = 0; i < events->len; i++)
+    func (&g_array_index (events, TimerHistoryEvent, i), user_data);
+  g_array_free (events, TRUE);
+
+  /* Then those that are not in the log yet */
+  for (i = 0; i < TIMER_HISTORY_RING; i++)
+    {
+      slot = &history->ring[(history->next_seq + i) % TIMER_HISTORY_RING];
+      if (slot->seq != 0 && (slot->queued == 0 || slot->queued > written))
+        func (&slot->event, user_data);
+    }
+}
@@ -0,0 +1,82 @@
+/*
+ *
+ *  Copyright (C) 2005-2014 Kemal Ilgar Eroglu <ilgar_eroglu@yahoo.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __TIMERHISTORY_H__
+#define __TIMERHISTORY_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Recent firings kept in memory */
+#define TIMER_HISTORY_RING 256
+
+/* Size at which the log is rotated, by default */
+#define TIMER_HISTORY_MAX_SIZE (256 * 1024)
+
+/* TimerHistoryEvent flags */
+#define TIMER_HISTORY_COMMAND (1 << 0) /* An alarm command was run */
+#define TIMER_HISTORY_DONE    (1 << 1) /* The command is over, if any */
+#define TIMER_HISTORY_FAILED  (1 << 2) /* The command could not be started */
+#define TIMER_HISTORY_DROPPED (1 << 3) /* The command was dropped unstarted */
+
+/* One firing, as kept in memory and on disk. Times are wall clock usec. */
+typedef struct
+{
+  guint32 alarm_id;
+  guint32 flags;
+  gint32 pid; /* Of the alarm command, 0 if none ran */
+  gint32 status; /* Wait status of the command */
+  gint64 due; /* When the alarm should have gone off */
+  gint64 fired; /* When it did */
+  gint64 duration; /* How long the command ran (usec) */
+} TimerHistoryEvent;
+
+typedef struct _TimerHistory TimerHistory;
+
+typedef void (*TimerHistoryFunc) (const TimerHistoryEvent *event,
+                                  gpointer                 user_data);
+
+TimerHistory *timer_history_new      (const gchar      *path,
+                                      gsize             max_size);
+
+void          timer_history_free     (TimerHistory     *history);
+
+guint         timer_history_fired    (TimerHistory     *history,
+                                      guint             alarm_id,
+                                      gint64            due,
+                                      gint64            fired,
+                                      gboolean          command);
+
+void          timer_history_done     (TimerHistory     *history,
+                                      guint             seq,
+                                      GPid              pid,
+                                      gint              status,
+                                      gint64            duration);
+
+void          timer_history_dropped  (TimerHistory     *history,
+                                      guint             seq);
+
+void          timer_history_foreach  (TimerHistory     *history,
+                                      TimerHistoryFunc  func,
+                                      gpointer          user_data);
+
+G_END_DECLS
+
+#endif /* !__TIMERHISTORY_H__ */
@@ -0,0 +1,486 @@
+/*
+ *
+ *  Copyright (C) 2005-2014 Kemal Ilgar Eroglu <ilgar_eroglu@yahoo.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * Reading many alarms at once from a CSV or JSON file.
+ *
+ * A CSV file has one alarm per line:
+ *
+ *   name,type,time,command,recurring,autostart
+ *
+ * where type is "countdown" or "at", and time is seconds, M:SS or
+ * H:MM:SS for a countdown and HH:MM for an alarm time. The columns
+ * after time may be left out. Fields can be quoted, with "" for a
+ * quote. Empty lines, lines starting with '#' and a header line
+ * whose first field is "name" are skipped.
+ *
+ * A JSON file is an array of objects with the same members; the
+ * time of a countdown may also be a number of seconds.
+ *
+ * The whole file is read and checked before anything is handed
+ * out, so an import either adds every entry or none.
+ **/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#ifdef HAVE_JSON_GLIB
+#include <json-glib/json-glib.h>
+#endif
+
+#include "timerimport.h"
+
+
+
+/* Columns of a CSV line */
+enum
+{
+  CSV_NAME,
+  CSV_TYPE,
+  CSV_TIME,
+  CSV_COMMAND,
+  CSV_RECURRING,
+  CSV_AUTOSTART,
+  CSV_N_FIELDS
+};
+
+/* Longest countdown, the most the Edit dialog can show */
+#define IMPORT_MAX_COUNTDOWN (24 * 3600 - 1)
+
+struct _TimerImport
+{
+  gchar *buffer; /* The file, CSV strings point into it */
+  GArray *alarms; /* TimerConfigAlarm, in file order */
+#ifdef HAVE_JSON_GLIB
+  JsonParser *parser; /* JSON strings point into its nodes */
+#endif
+};
+
+
+
+GQuark
+timer_import_error_quark (void)
+{
+  return g_quark_from_static_string ("timer-import-error-quark");
+}
+
+
+
+/* "countdown" or "at" */
+static gboolean
+import_type (const gchar *value, gboolean *is_countdown)
+{
+  if (g_ascii_strcasecmp (value, "countdown") == 0)
+    *is_countdown = TRUE;
+  else if (g_ascii_strcasecmp (value, "at") == 0)
+    *is_countdown = FALSE;
+  else
+    return FALSE;
+
+  return TRUE;
+}
+
+
+
+/**
+ * Reads a time as described at the top: into seconds for a
+ * countdown, into minutes of the day otherwise.
+ **/
+static gboolean
+import_time (const gchar *value, gboolean is_countdown, gint *time)
+{
+  gint64 parts[3], total;
+  gchar *end;
+  guint i, n;
+
+  for (n = 0; n < G_N_ELEMENTS (parts); n++)
+    {
+      if (!g_ascii_isdigit (*value))
+        return FALSE;
+
+      parts[n] = g_ascii_strtoll (value, &end, 10);
+      if (*end == '\0')
+        break;
+      if (*end != ':')
+        return FALSE;
+      value = end + 1;
+    }
+
+  if (n == G_N_ELEMENTS (parts))
+    return FALSE;
+
+  if (!is_countdown)
+    {
+      if (n != 1 || parts[0] > 23 || parts[1] > 59)
+        return FALSE;
+      *time = parts[0] * 60 + parts[1];
+      return TRUE;
+    }
+
+  /* Only the leading part may exceed its unit */
+  if (parts[0] > IMPORT_MAX_COUNTDOWN || (n >= 1 && parts[n] > 59)
+      || (n == 2 && parts[1] > 59))
+    return FALSE;
+
+  for (total = 0, i = 0; i <= n; i++)
+    total = total * 60 + parts[i];
+
+  if (total > IMPORT_MAX_COUNTDOWN)
+    return FALSE;
+
+  *time = total;
+  return TRUE;
+}
+
+
+
+/* true/false, yes/no, on/off, 1/0, and empty for false */
+static gboolean
+import_bool (const gchar *value, gboolean *result)
+{
+  if (*value == '\0' || g_ascii_strcasecmp (value, "false") == 0
+      || g_ascii_strcasecmp (value, "no") == 0
+      || g_ascii_strcasecmp (value, "off") == 0 || strcmp (value, "0") == 0)
+    *result = FALSE;
+  else if (g_ascii_strcasecmp (value, "true") == 0
+           || g_ascii_strcasecmp (value, "yes") == 0
+           || g_ascii_strcasecmp (value, "on") == 0
+           || strcmp (value, "1") == 0)
+    *result = TRUE;
+  else
+    return FALSE;
+
+  return TRUE;
+}
+
+
+
+/* Checks the fields of one CSV line and appends its alarm */
+static gboolean
+csv_alarm (TimerImport *import, gchar **fields, guint n, guint line,
+           GError **error)
+{
+  TimerConfigAlarm alarm;
+  const gchar *problem = NULL, *value = NULL;
+
+  memset (&alarm, 0, sizeof (alarm));
+
+  if (n <= CSV_TIME)
+    problem = "missing type or time";
+  else if (!import_type (value = fields[CSV_TYPE], &alarm.is_countdown))
+    problem = "invalid type";
+  else if (!import_time (value = fields[CSV_TIME], alarm.is_countdown,
+                         &alarm.time))
+    problem = "invalid time";
+  else if (n > CSV_RECURRING
+           && !import_bool (value = fields[CSV_RECURRING],
+                            &alarm.is_recurring))
+    problem = "invalid recurring flag";
+  else if (n > CSV_AUTOSTART
+           && !import_bool (value = fields[CSV_AUTOSTART],
+                            &alarm.is_auto_start))
+    problem = "invalid autostart flag";
+
+  if (problem && value)
+    g_set_error (error, TIMER_IMPORT_ERROR, TIMER_IMPORT_ERROR_INVALID,
+                 "Line %u: %s \"%s\"", line, problem, value);
+  else if (problem)
+    g_set_error (error, TIMER_IMPORT_ERROR, TIMER_IMPORT_ERROR_INVALID,
+                 "Line %u: %s", line, problem);
+
+  if (problem)
+    return FALSE;
+
+  alarm.name = fields[CSV_NAME];
+  if (n > CSV_COMMAND)
+    alarm.command = fields[CSV_COMMAND];
+
+  g_array_append_val (import->alarms, alarm);
+  return TRUE;
+}
+
+
+
+/**
+ * Parses the CSV file in one pass. Fields are unquoted and
+ * terminated in place, so the alarms point into the buffer.
+ **/
+static gboolean
+csv_parse (TimerImport *import, GError **error)
+{
+  gchar *fields[CSV_N_FIELDS];
+  gchar *s = import->buffer, *d, *field, end;
+  guint n, line = 1, record_line;
+  gboolean first = TRUE;
+
+  while (*s != '\0')
+    {
+      record_line = line;
+
+      /* One record: the fields up to an unquoted newline */
+      for (n = 0;; s++)
+        {
+          field = d = s;
+
+          if (*s == '"')
+            {
+              for (s++; *s != '"' || s[1] == '"'; s++, d++)
+                {
+                  if (*s == '\0')
+                    {
+                      g_set_error (error, TIMER_IMPORT_ERROR,
+                                   TIMER_IMPORT_ERROR_INVALID,
+                                   "Line %u: unterminated quote",
+                                   record_line);
+                      return FALSE;
+                    }
+                  if (*s == '"')
+                    s++;
+                  else if (*s == '\n')
+                    line++;
+                  *d = *s;
+                }
+              s++;
+            }
+
+          while (*s != '\0' && *s != ',' && *s != '\n')
+            *d++ = *s++;
+
+          end = *s;
+          *d = '\0';
+
+          /* Extra columns are ignored */
+          if (n < CSV_N_FIELDS)
+            fields[n++] = g_strstrip (field);
+
+          if (end != ',')
+            break;
+        }
+
+      if (end == '\n')
+        {
+          s++;
+          line++;
+        }
+
+      if ((n == 1 && *fields[0] == '\0') || *fields[0] == '#')
+        continue;
+
+      if (first && g_ascii_strcasecmp (fields[0], "name") == 0)
+        {
+          first = FALSE;
+          continue;
+        }
+      first = FALSE;
+
+      if (!csv_alarm (import, fields, n, record_line, error))
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+
+
+#ifdef HAVE_JSON_GLIB
+/* A string member, or def if it is not there or not a string */
+static const gchar *
+json_string (JsonObject *object, const gchar *member, const gchar *def)
+{
+  JsonNode *node = json_object_get_member (object, member);
+
+  if (node == NULL || json_node_get_value_type (node) != G_TYPE_STRING)
+    return def;
+
+  return json_node_get_string (node);
+}
+
+
+
+/* A boolean member, FALSE if it is not there */
+static gboolean
+json_bool (JsonObject *object, const gchar *member)
+{
+  JsonNode *node = json_object_get_member (object, member);
+
+  return node != NULL && json_node_get_value_type (node) == G_TYPE_BOOLEAN
+         && json_node_get_boolean (node);
+}
+
+
+
+static gboolean
+json_alarm (TimerImport *import, JsonNode *node, guint index, GError **error)
+{
+  TimerConfigAlarm alarm;
+  JsonObject *object;
+  JsonNode *member;
+  const gchar *problem = NULL;
+  gint64 seconds;
+
+  memset (&alarm, 0, sizeof (alarm));
+
+  if (!JSON_NODE_HOLDS_OBJECT (node))
+    problem = "not an object";
+  else if (!import_type (json_string (object = json_node_get_object (node),
+                                      "type", ""), &alarm.is_countdown))
+    problem = "invalid type";
+  else if ((member = json_object_get_member (object, "time")) == NULL
+           || !JSON_NODE_HOLDS_VALUE (member))
+    problem = "missing time";
+  else if (json_node_get_value_type (member) == G_TYPE_INT64)
+    {
+      /* A plain number of seconds */
+      seconds = json_node_get_int (member);
+      if (!alarm.is_countdown || seconds < 0
+          || seconds > IMPORT_MAX_COUNTDOWN)
+        problem = "invalid time";
+      else
+        alarm.time = seconds;
+    }
+  else if (!import_time (json_string (object, "time", ""),
+                         alarm.is_countdown, &alarm.time))
+    problem = "invalid time";
+
+  if (problem)
+    {
+      g_set_error (error, TIMER_IMPORT_ERROR, TIMER_IMPORT_ERROR_INVALID,
+                   "Entry %u: %s", index + 1, problem);
+      return FALSE;
+    }
+
+  alarm.name = (gchar *) json_string (object, "name", "");
+  alarm.command = (gchar *) json_string (object, "command", NULL);
+  alarm.is_recurring = json_bool (object, "recurring");
+  alarm.is_auto_start = json_bool (object, "autostart");
+
+  g_array_append_val (import->alarms, alarm);
+  return TRUE;
+}
+#endif
+
+
+
+static gboolean
+json_parse (TimerImport *import, gsize len, GError **error)
+{
+#ifdef HAVE_JSON_GLIB
+  JsonNode *root;
+  JsonArray *array;
+  guint i;
+
+  import->parser = json_parser_new ();
+  if (!json_parser_load_from_data (import->parser, import->buffer, len, error))
+    return FALSE;
+
+  root = json_parser_get_root (import->parser);
+  if (!JSON_NODE_HOLDS_ARRAY (root))
+    {
+      g_set_error (error, TIMER_IMPORT_ERROR, TIMER_IMPORT_ERROR_INVALID,
+                   "Expected an array of alarms");
+      return FALSE;
+    }
+
+  array = json_node_get_array (root);
+  for (i = 0; i < json_array_get_length (array); i++)
+    if (!json_alarm (import, json_array_get_element (array, i), i, error))
+      return FALSE;
+
+  return TRUE;
+#else
+  g_set_error (error, TIMER_IMPORT_ERROR, TIMER_IMPORT_ERROR_UNSUPPORTED,
+               "This build cannot read JSON, use CSV instead");
+  return FALSE;
+#endif
+}
+
+
+
+/**
+ * Reads and checks all the alarms of a CSV or JSON file, told
+ * apart by whether it starts with '['. Returns NULL and sets error
+ * on the first bad entry. The strings of the alarms stay valid
+ * until the import is freed.
+ **/
+TimerImport *
+timer_import_read (const gchar *path, GError **error)
+{
+  TimerImport *import;
+  const gchar *start;
+  gboolean ok;
+  gsize len;
+
+  import = g_new0 (TimerImport, 1);
+  import->alarms = g_array_new (FALSE, FALSE, sizeof (TimerConfigAlarm));
+
+  if (!g_file_get_contents (path, &import->buffer, &len, error))
+    {
+      timer_import_free (import);
+      return NULL;
+    }
+
+  for (start = import->buffer; g_ascii_isspace (*start); start++)
+    ;
+
+  if (*start == '[')
+    ok = json_parse (import, len, error);
+  else
+    ok = csv_parse (import, error);
+
+  if (!ok)
+    {
+      timer_import_free (import);
+      return NULL;
+    }
+
+  return import;
+}
+
+
+
+guint
+timer_import_n_alarms (TimerImport *import)
+{
+  return import->alarms->len;
+}
+
+
+
+const TimerConfigAlarm *
+timer_import_get (TimerImport *import, guint index)
+{
+  return &g_array_index (import->alarms, TimerConfigAlarm, index);
+}
+
+
+
+void
+timer_import_free (TimerImport *import)
+{
+#ifdef HAVE_JSON_GLIB
+  if (import->parser)
+    g_object_unref (import->parser);
+#endif
+  g_array_free (import->alarms, TRUE);
+  g_free (import->buffer);
+  g_free (import);
+}
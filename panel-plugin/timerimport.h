@@ -0,0 +1,53 @@
+/*
+ *
+ *  Copyright (C) 2005-2014 Kemal Ilgar Eroglu <ilgar_eroglu@yahoo.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __TIMERIMPORT_H__
+#define __TIMERIMPORT_H__
+
+#include <glib.h>
+
+#include "timerconfig.h"
+
+G_BEGIN_DECLS
+
+#define TIMER_IMPORT_ERROR (timer_import_error_quark ())
+
+typedef enum
+{
+  TIMER_IMPORT_ERROR_INVALID, /* An entry is malformed */
+  TIMER_IMPORT_ERROR_UNSUPPORTED /* JSON, without json-glib */
+} TimerImportError;
+
+typedef struct _TimerImport TimerImport;
+
+GQuark                  timer_import_error_quark (void);
+
+TimerImport            *timer_import_read        (const gchar *path,
+                                                  GError     **error);
+
+guint                   timer_import_n_alarms    (TimerImport *import);
+
+const TimerConfigAlarm *timer_import_get         (TimerImport *import,
+                                                  guint        index);
+
+void                    timer_import_free        (TimerImport *import);
+
+G_END_DECLS
+
+#endif /* !__TIMERIMPORT_H__ */
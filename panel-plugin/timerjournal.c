@@ -0,0 +1,301 @@
+/*
+ *
+ *  Copyright (C) 2005-2014 Kemal Ilgar Eroglu <ilgar_eroglu@yahoo.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * The state journal: which alarms are running or paused, so they
+ * can go on where they were when the panel is restarted.
+ *
+ * It is kept apart from the rc file and only holds fixed-size
+ * records, so writing it after every start, stop or pause is cheap.
+ * Running alarms are stored with their deadline on the wall clock,
+ * paused ones with the time they have left. A record names its alarm
+ * by position, with a fingerprint of the alarm to make sure the list
+ * did not change meanwhile.
+ **/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <string.h>
+
+#include <glib/gstdio.h>
+
+#include "timerjournal.h"
+
+
+
+#define JOURNAL_MAGIC   "XFTIMJNL"
+#define JOURNAL_VERSION 1
+
+/* Record flags */
+#define JOURNAL_PAUSED (1 << 0)
+
+typedef struct
+{
+  gchar magic[8];
+  guint32 version;
+  guint32 n_records;
+} JournalHeader;
+
+typedef struct
+{
+  guint32 index; /* Position in the alarm list */
+  guint32 fingerprint; /* Of the alarm's name, type and time */
+  guint32 flags;
+  gint32 period; /* Countdown length (sec) */
+  gint64 wall_deadline; /* When a running alarm goes off (usec, wall clock) */
+  gint64 remaining; /* What a paused alarm has left (usec) */
+} JournalRecord;
+
+G_STATIC_ASSERT (sizeof (JournalHeader) == 16);
+G_STATIC_ASSERT (sizeof (JournalRecord) == 32);
+
+
+
+static guint32
+journal_fingerprint (TimerAlarm *alarm)
+{
+  return g_str_hash (alarm->name ? alarm->name : "") * 31
+         + (guint32) alarm->time * 2 + (alarm->is_countdown ? 1 : 0);
+}
+
+
+
+/**
+ * Writes the state of the running and paused alarms to path,
+ * replacing it at once. The file is removed if none is running.
+ **/
+gboolean
+timer_journal_save (TimerCore *core, const gchar *path, GError **error)
+{
+  JournalHeader header;
+  JournalRecord record;
+  GByteArray *contents;
+  TimerAlarm *alarm;
+  gint64 now, now_real;
+  guint8 state;
+  gboolean ok;
+  guint i;
+
+  memset (&header, 0, sizeof (header));
+  memcpy (header.magic, JOURNAL_MAGIC, sizeof (header.magic));
+  header.version = JOURNAL_VERSION;
+
+  contents = g_byte_array_new ();
+  g_byte_array_append (contents, (const guint8 *) &header, sizeof (header));
+
+  now = timer_core_now (core);
+  now_real = timer_core_real_now (core);
+
+  for (i = 0; i < timer_core_n_alarms (core); i++)
+    {
+      alarm = timer_core_get (core, i);
+      state = timer_core_get_state (core, alarm);
+      if (!(state & TIMER_ALARM_RUNNING))
+        continue;
+
+      memset (&record, 0, sizeof (record));
+      record.index = i;
+      record.fingerprint = journal_fingerprint (alarm);
+      record.period = alarm->timeout_period_in_sec;
+
+      if (state & TIMER_ALARM_PAUSED)
+        {
+          record.flags = JOURNAL_PAUSED;
+          record.remaining = timer_core_remaining (core, alarm, now);
+        }
+      /* "At" alarms keep their wall deadline, countdowns go by the monotonic clock */
+      else if (!alarm->is_countdown)
+        record.wall_deadline = alarm->wall_deadline;
+      else
+        record.wall_deadline = now_real + timer_core_remaining (core, alarm,
+                                                                now);
+
+      g_byte_array_append (contents, (const guint8 *) &record,
+                           sizeof (record));
+      header.n_records++;
+    }
+
+  if (header.n_records == 0)
+    {
+      g_byte_array_free (contents, TRUE);
+      if (g_unlink (path) != 0 && errno != ENOENT)
+        {
+          g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+                       "Cannot remove %s: %s", path, g_strerror (errno));
+          return FALSE;
+        }
+      return TRUE;
+    }
+
+  memcpy (contents->data, &header, sizeof (header));
+  ok = g_file_set_contents (path, (const gchar *) contents->data,
+                            contents->len, error);
+  g_byte_array_free (contents, TRUE);
+
+  return ok;
+}
+
+
+
+/**
+ * The stopped alarms by fingerprint, each a queue in list order, so
+ * that records are matched without going over all the alarms.
+ **/
+static GHashTable *
+journal_index (TimerCore *core)
+{
+  GHashTable *index;
+  GQueue *queue;
+  TimerAlarm *alarm;
+  gpointer key;
+  guint i;
+
+  index = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL,
+                                 (GDestroyNotify) g_queue_free);
+
+  for (i = 0; i < timer_core_n_alarms (core); i++)
+    {
+      alarm = timer_core_get (core, i);
+      if (timer_core_get_state (core, alarm) & TIMER_ALARM_RUNNING)
+        continue;
+
+      key = GUINT_TO_POINTER (journal_fingerprint (alarm));
+      queue = g_hash_table_lookup (index, key);
+      if (queue == NULL)
+        {
+          queue = g_queue_new ();
+          g_hash_table_insert (index, key, queue);
+        }
+      g_queue_push_tail (queue, alarm);
+    }
+
+  return index;
+}
+
+
+
+/**
+ * The stopped alarm a record is about: the one at its position if
+ * that still matches, or else the first stopped one that does.
+ **/
+static TimerAlarm *
+journal_match (TimerCore *core, GHashTable *index,
+               const JournalRecord *record)
+{
+  TimerAlarm *alarm;
+  GQueue *queue;
+
+  if (record->index < timer_core_n_alarms (core))
+    {
+      alarm = timer_core_get (core, record->index);
+      if (journal_fingerprint (alarm) == record->fingerprint
+          && !(timer_core_get_state (core, alarm) & TIMER_ALARM_RUNNING))
+        return alarm;
+    }
+
+  /* Those matched meanwhile are running, and leave the queue for good */
+  queue = g_hash_table_lookup (index, GUINT_TO_POINTER (record->fingerprint));
+  while (queue != NULL && (alarm = g_queue_peek_head (queue)) != NULL)
+    {
+      if (!(timer_core_get_state (core, alarm) & TIMER_ALARM_RUNNING))
+        return alarm;
+      g_queue_pop_head (queue);
+    }
+
+  return NULL;
+}
+
+
+
+/**
+ * Puts the alarms of the journal at path back into the state they
+ * were saved in. Those that came due meanwhile are dealt with as
+ * catch_up says. Returns how many alarms are running again.
+ **/
+guint
+timer_journal_restore (TimerCore *core, const gchar *path,
+                       TimerCatchUp catch_up)
+{
+  const JournalHeader *header;
+  const JournalRecord *records;
+  GHashTable *index;
+  TimerAlarm *alarm;
+  gchar *contents;
+  gint64 now_real;
+  gboolean paused;
+  guint i, n = 0;
+  gsize len;
+
+  if (!g_file_get_contents (path, &contents, &len, NULL))
+    return 0;
+
+  header = (const JournalHeader *) contents;
+  if (len < sizeof (*header)
+      || memcmp (header->magic, JOURNAL_MAGIC, sizeof (header->magic)) != 0
+      || header->version != JOURNAL_VERSION
+      || len != sizeof (*header) + (gsize) header->n_records
+                                   * sizeof (JournalRecord))
+    {
+      g_warning ("Ignoring the invalid state journal %s", path);
+      g_free (contents);
+      return 0;
+    }
+
+  records = (const JournalRecord *) (contents + sizeof (*header));
+  now_real = timer_core_real_now (core);
+  index = journal_index (core);
+
+  /* The view hears of the restored alarms once */
+  timer_core_freeze (core);
+
+  for (i = 0; i < header->n_records; i++)
+    {
+      alarm = journal_match (core, index, &records[i]);
+      if (alarm == NULL)
+        continue;
+
+      paused = (records[i].flags & JOURNAL_PAUSED) != 0;
+
+      if (!paused && records[i].wall_deadline <= now_real
+          && catch_up == TIMER_CATCH_UP_SKIP)
+        {
+          g_debug ("Skipping alarm %s, it came due while not running",
+                   alarm->name);
+          if (alarm->is_recurring)
+            {
+              timer_core_start (core, alarm);
+              n++;
+            }
+          continue;
+        }
+
+      timer_core_restore (core, alarm, records[i].wall_deadline,
+                          records[i].remaining, records[i].period, paused);
+      n++;
+    }
+
+  timer_core_thaw (core);
+  g_hash_table_destroy (index);
+  g_free (contents);
+
+  return n;
+}
@@ -0,0 +1,46 @@
+/*
+ *
+ *  Copyright (C) 2005-2014 Kemal Ilgar Eroglu <ilgar_eroglu@yahoo.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __TIMERJOURNAL_H__
+#define __TIMERJOURNAL_H__
+
+#include <glib.h>
+
+#include "timercore.h"
+
+G_BEGIN_DECLS
+
+/* What becomes of alarms that came due while the panel was not running */
+typedef enum
+{
+  TIMER_CATCH_UP_FIRE, /* They go off once, late */
+  TIMER_CATCH_UP_SKIP /* They stay stopped, recurring ones start over */
+} TimerCatchUp;
+
+gboolean timer_journal_save    (TimerCore    *core,
+                                const gchar  *path,
+                                GError      **error);
+
+guint    timer_journal_restore (TimerCore    *core,
+                                const gchar  *path,
+                                TimerCatchUp  catch_up);
+
+G_END_DECLS
+
+#endif /* !__TIMERJOURNAL_H__ */
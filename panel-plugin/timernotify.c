@@ -0,0 +1,396 @@
+/*
+ *
+ *  Copyright (C) 2005-2014 Kemal Ilgar Eroglu <ilgar_eroglu@yahoo.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * A client of the desktop notification service. It keeps at most
+ * one notification up: showing it again replaces the one on screen
+ * rather than stacking another, so a burst of alarms costs a single
+ * bubble. Whatever owns org.freedesktop.Notifications on the session
+ * bus is used, so a mock daemon on a private bus (dbus-run-session)
+ * can stand in for the desktop's. Servers that take markup in the
+ * body get the body escaped, so an alarm name is shown as typed.
+ **/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "timernotify.h"
+
+/* Reasons of NotificationClosed */
+#define NOTIFY_CLOSED_DISMISSED 2
+
+/* Urgency hint of an alarm, "critical" */
+#define NOTIFY_URGENCY_CRITICAL 2
+
+
+
+struct _TimerNotify
+{
+  TimerNotifyCallbacks callbacks;
+  gpointer user_data;
+  gchar *app_name, *icon;
+  GDBusConnection *connection; /* NULL until the bus is there, or if none */
+  GCancellable *cancellable; /* Of the calls on their way */
+  guint subscription; /* Signals of the service */
+  guint32 id; /* Notification on screen, 0 if none */
+  gboolean connecting; /* Waiting for the bus and its capabilities */
+  gboolean markup; /* The service takes markup, "body-markup" */
+  gboolean busy; /* A Notify call is on its way */
+  gboolean dirty; /* The text changed since the last Notify */
+  gboolean close_pending; /* Closed while Notify was on its way */
+  gchar *summary, *body;
+  gchar **actions;
+};
+
+
+
+static void
+notify_send (TimerNotify *notify);
+
+
+
+/* Closes notification id on screen, without waiting for the answer */
+static void
+notify_close_id (TimerNotify *notify, guint32 id)
+{
+  g_dbus_connection_call (notify->connection, TIMER_NOTIFY_NAME,
+                          TIMER_NOTIFY_PATH, TIMER_NOTIFY_INTERFACE,
+                          "CloseNotification", g_variant_new ("(u)", id),
+                          NULL, G_DBUS_CALL_FLAGS_NONE, -1, NULL, NULL, NULL);
+}
+
+
+
+static void
+notify_failed (TimerNotify *notify)
+{
+  notify->dirty = FALSE;
+  if (notify->callbacks.failed)
+    notify->callbacks.failed (notify, notify->user_data);
+}
+
+
+
+static void
+notify_done (GObject *source, GAsyncResult *result, gpointer data)
+{
+  TimerNotify *notify;
+  GVariant *reply;
+  GError *error = NULL;
+
+  reply = g_dbus_connection_call_finish (G_DBUS_CONNECTION (source), result,
+                                         &error);
+  if (reply == NULL
+      && g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    {
+      /* The client is gone */
+      g_error_free (error);
+      return;
+    }
+
+  notify = (TimerNotify *) data;
+  notify->busy = FALSE;
+
+  if (reply == NULL)
+    {
+      g_debug ("Cannot show a notification: %s", error->message);
+      g_error_free (error);
+      if (notify->close_pending)
+        notify->close_pending = FALSE;
+      else
+        notify_failed (notify);
+      return;
+    }
+
+  g_variant_get (reply, "(u)", &notify->id);
+  g_variant_unref (reply);
+
+  if (notify->close_pending)
+    {
+      notify->close_pending = FALSE;
+      notify_close_id (notify, notify->id);
+      notify->id = 0;
+    }
+  else if (notify->dirty)
+    notify_send (notify);
+}
+
+
+
+/* Shows the current text, replacing the notification on screen if any */
+static void
+notify_send (TimerNotify *notify)
+{
+  GVariantBuilder actions, hints;
+  gchar *body;
+  guint i;
+
+  g_variant_builder_init (&actions, G_VARIANT_TYPE ("as"));
+  for (i = 0; notify->actions && notify->actions[i]; i++)
+    g_variant_builder_add (&actions, "s", notify->actions[i]);
+
+  g_variant_builder_init (&hints, G_VARIANT_TYPE ("a{sv}"));
+  g_variant_builder_add (&hints, "{sv}", "urgency",
+                         g_variant_new_byte (NOTIFY_URGENCY_CRITICAL));
+
+  /* A '<' or '&' in an alarm name is no markup; the summary is never any */
+  if (notify->markup)
+    body = g_markup_escape_text (notify->body, -1);
+  else
+    body = g_strdup (notify->body);
+
+  notify->busy = TRUE;
+  notify->dirty = FALSE;
+
+  /* An expiry timeout of 0 keeps it up until the user acts on it */
+  g_dbus_connection_call (notify->connection, TIMER_NOTIFY_NAME,
+                          TIMER_NOTIFY_PATH, TIMER_NOTIFY_INTERFACE, "Notify",
+                          g_variant_new ("(susssasa{sv}i)", notify->app_name,
+                                         notify->id, notify->icon,
+                                         notify->summary, body, &actions,
+                                         &hints, 0),
+                          G_VARIANT_TYPE ("(u)"), G_DBUS_CALL_FLAGS_NONE, -1,
+                          notify->cancellable, notify_done, notify);
+  g_free (body);
+}
+
+
+
+/* ActionInvoked and NotificationClosed of the service */
+static void
+notify_signal (GDBusConnection *connection, const gchar *sender,
+               const gchar *object_path, const gchar *interface_name,
+               const gchar *signal_name, GVariant *parameters,
+               gpointer data)
+{
+  TimerNotify *notify = (TimerNotify *) data;
+  const gchar *key;
+  guint32 id, reason;
+
+  if (g_strcmp0 (signal_name, "ActionInvoked") == 0
+      && g_variant_is_of_type (parameters, G_VARIANT_TYPE ("(us)")))
+    {
+      g_variant_get (parameters, "(u&s)", &id, &key);
+      if (id == 0 || id != notify->id)
+        return;
+
+      /* The service may close it now, which is no dismissal */
+      notify->id = 0;
+      if (notify->callbacks.action)
+        notify->callbacks.action (notify, key, notify->user_data);
+    }
+  else if (g_strcmp0 (signal_name, "NotificationClosed") == 0
+           && g_variant_is_of_type (parameters, G_VARIANT_TYPE ("(uu)")))
+    {
+      g_variant_get (parameters, "(uu)", &id, &reason);
+      if (id == 0 || id != notify->id)
+        return;
+
+      notify->id = 0;
+      if (reason == NOTIFY_CLOSED_DISMISSED && notify->callbacks.closed)
+        notify->callbacks.closed (notify, notify->user_data);
+    }
+}
+
+
+
+static void
+capabilities_ready (GObject *source, GAsyncResult *result, gpointer data)
+{
+  TimerNotify *notify;
+  GVariant *reply;
+  GVariantIter *iter;
+  GError *error = NULL;
+  const gchar *capability;
+
+  reply = g_dbus_connection_call_finish (G_DBUS_CONNECTION (source), result,
+                                         &error);
+  if (reply == NULL
+      && g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    {
+      g_error_free (error);
+      return;
+    }
+
+  notify = (TimerNotify *) data;
+  notify->connecting = FALSE;
+
+  /* Without an answer it is taken as plain text, Notify will tell more */
+  if (reply == NULL)
+    {
+      g_debug ("Cannot get the notification capabilities: %s",
+               error->message);
+      g_error_free (error);
+    }
+  else
+    {
+      g_variant_get (reply, "(as)", &iter);
+      while (g_variant_iter_loop (iter, "&s", &capability))
+        if (g_strcmp0 (capability, "body-markup") == 0)
+          notify->markup = TRUE;
+      g_variant_iter_free (iter);
+      g_variant_unref (reply);
+    }
+
+  if (notify->dirty)
+    notify_send (notify);
+}
+
+
+
+static void
+bus_ready (GObject *source, GAsyncResult *result, gpointer data)
+{
+  TimerNotify *notify;
+  GDBusConnection *connection;
+  GError *error = NULL;
+
+  connection = g_bus_get_finish (result, &error);
+  if (connection == NULL
+      && g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    {
+      g_error_free (error);
+      return;
+    }
+
+  notify = (TimerNotify *) data;
+
+  if (connection == NULL)
+    {
+      notify->connecting = FALSE;
+      g_debug ("No session bus, no notifications: %s", error->message);
+      g_error_free (error);
+      if (notify->dirty)
+        notify_failed (notify);
+      return;
+    }
+
+  notify->connection = connection;
+  notify->subscription = g_dbus_connection_signal_subscribe (
+      connection, TIMER_NOTIFY_NAME, TIMER_NOTIFY_INTERFACE, NULL,
+      TIMER_NOTIFY_PATH, NULL, G_DBUS_SIGNAL_FLAGS_NONE, notify_signal,
+      notify, NULL);
+
+  /* Nothing is sent before it is known how to escape it */
+  g_dbus_connection_call (connection, TIMER_NOTIFY_NAME, TIMER_NOTIFY_PATH,
+                          TIMER_NOTIFY_INTERFACE, "GetCapabilities", NULL,
+                          G_VARIANT_TYPE ("(as)"), G_DBUS_CALL_FLAGS_NONE, -1,
+                          notify->cancellable, capabilities_ready, notify);
+}
+
+
+
+/**
+ * Creates a client; it connects to the session bus in the background.
+ * icon is an icon name, or "" for none.
+ **/
+TimerNotify *
+timer_notify_new (const gchar *app_name, const gchar *icon,
+                  const TimerNotifyCallbacks *callbacks, gpointer user_data)
+{
+  TimerNotify *notify = g_new0 (TimerNotify, 1);
+
+  if (callbacks)
+    notify->callbacks = *callbacks;
+  notify->user_data = user_data;
+  notify->app_name = g_strdup (app_name);
+  notify->icon = g_strdup (icon);
+  notify->summary = g_strdup ("");
+  notify->body = g_strdup ("");
+  notify->cancellable = g_cancellable_new ();
+
+  notify->connecting = TRUE;
+  g_bus_get (G_BUS_TYPE_SESSION, notify->cancellable, bus_ready, notify);
+
+  return notify;
+}
+
+
+
+/* Frees the client, taking its notification off the screen */
+void
+timer_notify_free (TimerNotify *notify)
+{
+  g_cancellable_cancel (notify->cancellable);
+  g_object_unref (notify->cancellable);
+
+  if (notify->connection)
+    {
+      if (notify->id != 0)
+        notify_close_id (notify, notify->id);
+      g_dbus_connection_signal_unsubscribe (notify->connection,
+                                            notify->subscription);
+      g_object_unref (notify->connection);
+    }
+
+  g_free (notify->app_name);
+  g_free (notify->icon);
+  g_free (notify->summary);
+  g_free (notify->body);
+  g_strfreev (notify->actions);
+  g_free (notify);
+}
+
+
+
+/**
+ * Shows a notification, or updates the one on screen. actions
+ * holds pairs of an action key and its label, NULL-terminated;
+ * the key "default" is for a click on the notification itself.
+ * Calls that come while the service has not answered yet are
+ * folded into one.
+ **/
+void
+timer_notify_show (TimerNotify *notify, const gchar *summary,
+                   const gchar *body, const gchar * const *actions)
+{
+  g_free (notify->summary);
+  g_free (notify->body);
+  g_strfreev (notify->actions);
+  notify->summary = g_strdup (summary);
+  notify->body = g_strdup (body);
+  notify->actions = g_strdupv ((gchar **) actions);
+  notify->dirty = TRUE;
+  notify->close_pending = FALSE;
+
+  if (notify->connecting || notify->busy)
+    return;
+
+  if (notify->connection == NULL)
+    notify_failed (notify);
+  else
+    notify_send (notify);
+}
+
+
+
+/* Takes the notification off the screen, if it is up */
+void
+timer_notify_close (TimerNotify *notify)
+{
+  notify->dirty = FALSE;
+  if (notify->busy)
+    notify->close_pending = TRUE;
+  else if (notify->id != 0)
+    {
+      notify_close_id (notify, notify->id);
+      notify->id = 0;
+    }
+}
@@ -0,0 +1,67 @@
+/*
+ *
+ *  Copyright (C) 2005-2014 Kemal Ilgar Eroglu <ilgar_eroglu@yahoo.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __TIMERNOTIFY_H__
+#define __TIMERNOTIFY_H__
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+/* The desktop notification service, as in the freedesktop.org spec */
+#define TIMER_NOTIFY_NAME      "org.freedesktop.Notifications"
+#define TIMER_NOTIFY_INTERFACE "org.freedesktop.Notifications"
+#define TIMER_NOTIFY_PATH      "/org/freedesktop/Notifications"
+
+typedef struct _TimerNotify TimerNotify;
+
+/**
+ * How the notification reports back. 'action' is called with the
+ * key of the action the user picked, 'closed' when the user closed
+ * it otherwise, and 'failed' when it could not be shown, e.g. when
+ * no notification daemon runs. Any of them may be NULL.
+ **/
+typedef struct
+{
+  void (*action) (TimerNotify *notify,
+                  const gchar *key,
+                  gpointer     user_data);
+  void (*closed) (TimerNotify *notify,
+                  gpointer     user_data);
+  void (*failed) (TimerNotify *notify,
+                  gpointer     user_data);
+} TimerNotifyCallbacks;
+
+TimerNotify *timer_notify_new   (const gchar                *app_name,
+                                 const gchar                *icon,
+                                 const TimerNotifyCallbacks *callbacks,
+                                 gpointer                    user_data);
+
+void         timer_notify_free  (TimerNotify                *notify);
+
+void         timer_notify_show  (TimerNotify                *notify,
+                                 const gchar                *summary,
+                                 const gchar                *body,
+                                 const gchar * const        *actions);
+
+void         timer_notify_close (TimerNotify                *notify);
+
+G_END_DECLS
+
+#endif /* !__TIMERNOTIFY_H__ */
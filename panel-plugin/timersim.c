@@ -0,0 +1,145 @@
+/*
+ *
+ *  Copyright (C) 2005-2014 Kemal Ilgar Eroglu <ilgar_eroglu@yahoo.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * A simulated clock for the timer core. Time only moves when it is
+ * told to, and then jumps straight from one pending event to the
+ * next, so hours of recurring and repeating alarms run in as long as
+ * it takes to handle them, and every event is handled at exactly
+ * the time it was due. The real-time clock moves along with the
+ * monotonic one unless it is set, like a wall clock being changed.
+ **/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "timersim.h"
+
+
+
+struct _TimerSimClock
+{
+  TimerCore *core;
+  gint64 now; /* Simulated monotonic time (usec) */
+  gint64 real_offset; /* Real time minus monotonic time (usec) */
+};
+
+
+
+static gint64
+sim_monotonic (gpointer data)
+{
+  return ((TimerSimClock *) data)->now;
+}
+
+
+
+static gint64
+sim_real (gpointer data)
+{
+  TimerSimClock *sim = (TimerSimClock *) data;
+
+  return sim->now + sim->real_offset;
+}
+
+
+
+/**
+ * Puts the core on a simulated clock that starts at monotonic time 0
+ * and at the real time start_real (usec since the epoch). Do this
+ * before any alarm is started.
+ **/
+TimerSimClock *
+timer_sim_clock_new (TimerCore *core, gint64 start_real)
+{
+  static const TimerCoreClock clock = { sim_monotonic, sim_real };
+  TimerSimClock *sim;
+
+  sim = g_new0 (TimerSimClock, 1);
+  sim->core = core;
+  sim->real_offset = start_real;
+  timer_core_set_clock (core, &clock, sim);
+
+  return sim;
+}
+
+
+
+/* Puts the core back on the system clocks */
+void
+timer_sim_clock_free (TimerSimClock *sim)
+{
+  timer_core_set_clock (sim->core, NULL, NULL);
+  g_free (sim);
+}
+
+
+
+gint64
+timer_sim_clock_now (TimerSimClock *sim)
+{
+  return sim->now;
+}
+
+
+
+gint64
+timer_sim_clock_real_now (TimerSimClock *sim)
+{
+  return sim_real (sim);
+}
+
+
+
+/**
+ * Moves the clock on to the monotonic time target, handling every
+ * event due up to then at the exact time it is due.
+ **/
+void
+timer_sim_clock_run_until (TimerSimClock *sim, gint64 target)
+{
+  gint64 next;
+
+  while ((next = timer_core_next_event (sim->core)) >= 0 && next <= target)
+    {
+      sim->now = MAX (sim->now, next);
+      timer_core_dispatch (sim->core);
+    }
+
+  sim->now = MAX (sim->now, target);
+}
+
+
+
+void
+timer_sim_clock_advance (TimerSimClock *sim, gint64 span)
+{
+  timer_sim_clock_run_until (sim, sim->now + span);
+}
+
+
+
+/* Sets the real-time clock, like an NTP step or the user would */
+void
+timer_sim_clock_set_real (TimerSimClock *sim, gint64 real)
+{
+  sim->real_offset = real - sim->now;
+  timer_core_clock_changed (sim->core);
+}
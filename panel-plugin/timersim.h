@@ -0,0 +1,51 @@
+/*
+ *
+ *  Copyright (C) 2005-2014 Kemal Ilgar Eroglu <ilgar_eroglu@yahoo.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __TIMERSIM_H__
+#define __TIMERSIM_H__
+
+#include <glib.h>
+
+#include "timercore.h"
+
+G_BEGIN_DECLS
+
+typedef struct _TimerSimClock TimerSimClock;
+
+TimerSimClock *timer_sim_clock_new       (TimerCore     *core,
+                                          gint64         start_real);
+
+void           timer_sim_clock_free      (TimerSimClock *sim);
+
+gint64         timer_sim_clock_now       (TimerSimClock *sim);
+
+gint64         timer_sim_clock_real_now  (TimerSimClock *sim);
+
+void           timer_sim_clock_run_until (TimerSimClock *sim,
+                                          gint64         target);
+
+void           timer_sim_clock_advance   (TimerSimClock *sim,
+                                          gint64         span);
+
+void           timer_sim_clock_set_real  (TimerSimClock *sim,
+                                          gint64         real);
+
+G_END_DECLS
+
+#endif /* !__TIMERSIM_H__ */
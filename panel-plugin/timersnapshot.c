@@ -0,0 +1,349 @@
+/*
+ *
+ *  Copyright (C) 2005-2014 Kemal Ilgar Eroglu <ilgar_eroglu@yahoo.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * A binary copy of the settings, kept next to the rc file.
+ *
+ * The file is a fixed header, one fixed-size record per alarm and a
+ * block of NUL-terminated strings the records point into. It is
+ * mapped and used in place, so loading does no parsing at all. The
+ * header remembers the size, inode and modification time, to the
+ * nanosecond where the file system keeps it, of the rc file it was
+ * written with. If the rc file was changed or replaced in any other
+ * way the snapshot is ignored and the rc file is read instead.
+ **/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <glib/gstdio.h>
+
+#include "timersnapshot.h"
+
+
+
+#define SNAPSHOT_MAGIC   "XFTIMSNP"
+#define SNAPSHOT_VERSION 3
+
+/* Options flags */
+#define SNAPSHOT_NOWIN_IF_ALARM       (1 << 0)
+#define SNAPSHOT_USE_GLOBAL_COMMAND   (1 << 1)
+#define SNAPSHOT_REPEAT_ALARM_COMMAND (1 << 2)
+#define SNAPSHOT_SKIP_MISSED          (1 << 3)
+#define SNAPSHOT_USE_NOTIFICATIONS    (1 << 4)
+
+/* What tells one version of the rc file from another */
+typedef struct
+{
+  guint64 size;
+  guint64 inode; /* Changes when the rc file is replaced, as on writing */
+  gint64 mtime; /* Seconds */
+  gint64 mtime_nsec; /* 0 where the file system has no finer times */
+} SnapshotStamp;
+
+typedef struct
+{
+  gchar magic[8];
+  guint32 version;
+  guint32 n_alarms;
+  SnapshotStamp rc; /* The rc file this snapshot belongs to */
+  guint32 flags;
+  gint32 repetitions, repeat_interval;
+  guint32 global_command; /* Offset in the string block */
+  gint32 coalesce_window;
+  gint32 snooze_time;
+} SnapshotHeader;
+
+typedef struct
+{
+  gint32 time;
+  guint32 flags;
+  guint32 name, info, command; /* Offsets in the string block */
+} SnapshotRecord;
+
+G_STATIC_ASSERT (sizeof (SnapshotHeader) == 72);
+G_STATIC_ASSERT (sizeof (SnapshotRecord) == 20);
+
+struct _TimerSnapshot
+{
+  GMappedFile *file;
+  const SnapshotHeader *header;
+  const SnapshotRecord *records;
+  const gchar *strings; /* In the mapping, or the copy handed out */
+  gsize strings_len;
+};
+
+
+
+static gboolean
+rc_file_stamp (const gchar *rc_path, SnapshotStamp *stamp)
+{
+  GStatBuf st;
+
+  if (g_stat (rc_path, &st) != 0)
+    return FALSE;
+
+  stamp->size = st.st_size;
+  stamp->inode = st.st_ino;
+  stamp->mtime = st.st_mtime;
+#ifdef HAVE_STRUCT_STAT_ST_MTIM_TV_NSEC
+  stamp->mtime_nsec = st.st_mtim.tv_nsec;
+#else
+  stamp->mtime_nsec = 0;
+#endif
+  return TRUE;
+}
+
+
+
+/* Appends a string to the block and returns its offset */
+static guint32
+add_string (GString *strings, const gchar *str)
+{
+  guint32 offset = strings->len;
+
+  g_string_append (strings, str ? str : "");
+  g_string_append_c (strings, '\0');
+  return offset;
+}
+
+
+
+/**
+ * Writes the snapshot for the given settings. The rc file must be
+ * written first, since its current stamp is recorded.
+ **/
+gboolean
+timer_snapshot_write (const gchar *path,
+                      const gchar *rc_path,
+                      const TimerSnapshotOptions *options,
+                      const TimerSnapshotAlarm *alarms,
+                      guint n_alarms,
+                      GError **error)
+{
+  SnapshotHeader header;
+  SnapshotRecord *records;
+  GString *strings;
+  GByteArray *data;
+  gboolean ok;
+  guint i;
+
+  memset (&header, 0, sizeof (header));
+  memcpy (header.magic, SNAPSHOT_MAGIC, sizeof (header.magic));
+  header.version = SNAPSHOT_VERSION;
+  header.n_alarms = n_alarms;
+
+  if (!rc_file_stamp (rc_path, &header.rc))
+    {
+      g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_NOENT,
+                   "Cannot stat %s", rc_path);
+      return FALSE;
+    }
+
+  strings = g_string_new (NULL);
+  records = g_new0 (SnapshotRecord, MAX (n_alarms, 1));
+
+  header.flags = (options->nowin_if_alarm ? SNAPSHOT_NOWIN_IF_ALARM : 0)
+                 | (options->use_global_command ? SNAPSHOT_USE_GLOBAL_COMMAND : 0)
+                 | (options->repeat_alarm_command ? SNAPSHOT_REPEAT_ALARM_COMMAND : 0)
+                 | (options->skip_missed ? SNAPSHOT_SKIP_MISSED : 0)
+                 | (options->use_notifications ? SNAPSHOT_USE_NOTIFICATIONS : 0);
+  header.repetitions = options->repetitions;
+  header.repeat_interval = options->repeat_interval;
+  header.coalesce_window = options->coalesce_window;
+  header.snooze_time = options->snooze_time;
+  header.global_command = add_string (strings, options->global_command);
+
+  for (i = 0; i < n_alarms; i++)
+    {
+      records[i].time = alarms[i].time;
+      records[i].flags = alarms[i].flags;
+      records[i].name = add_string (strings, alarms[i].name);
+      records[i].info = add_string (strings, alarms[i].info);
+      records[i].command = add_string (strings, alarms[i].command);
+    }
+
+  data = g_byte_array_sized_new (sizeof (header)
+                                 + n_alarms * sizeof (SnapshotRecord)
+                                 + strings->len);
+  g_byte_array_append (data, (guint8 *) &header, sizeof (header));
+  g_byte_array_append (data, (guint8 *) records,
+                       n_alarms * sizeof (SnapshotRecord));
+  g_byte_array_append (data, (guint8 *) strings->str, strings->len);
+
+  /* Written to a temporary file and renamed over the old one */
+  ok = g_file_set_contents (path, (gchar *) data->data, data->len, error);
+
+  g_byte_array_free (data, TRUE);
+  g_string_free (strings, TRUE);
+  g_free (records);
+
+  return ok;
+}
+
+
+
+/**
+ * Maps the snapshot at path. Returns NULL if there is none, if it is
+ * damaged, or if it does not belong to the current rc file.
+ **/
+TimerSnapshot *
+timer_snapshot_open (const gchar *path, const gchar *rc_path)
+{
+  TimerSnapshot *snapshot;
+  GMappedFile *file;
+  const SnapshotHeader *header;
+  const SnapshotRecord *records;
+  const gchar *contents;
+  gsize len, records_len;
+  SnapshotStamp rc;
+  guint i;
+
+  file = g_mapped_file_new (path, FALSE, NULL);
+  if (file == NULL)
+    return NULL;
+
+  contents = g_mapped_file_get_contents (file);
+  len = g_mapped_file_get_length (file);
+  header = (const SnapshotHeader *) contents;
+
+  if (len < sizeof (SnapshotHeader)
+      || memcmp (header->magic, SNAPSHOT_MAGIC, sizeof (header->magic)) != 0
+      || header->version != SNAPSHOT_VERSION
+      || !rc_file_stamp (rc_path, &rc)
+      || header->rc.size != rc.size || header->rc.inode != rc.inode
+      || header->rc.mtime != rc.mtime
+      || header->rc.mtime_nsec != rc.mtime_nsec)
+    goto stale;
+
+  records_len = (gsize) header->n_alarms * sizeof (SnapshotRecord);
+  if (len - sizeof (SnapshotHeader) < records_len)
+    goto stale;
+
+  /* Every offset must fall in the string block, which ends in a NUL */
+  records = (const SnapshotRecord *) (contents + sizeof (SnapshotHeader));
+  len -= sizeof (SnapshotHeader) + records_len;
+  if (len == 0 || contents[sizeof (SnapshotHeader) + records_len + len - 1] != '\0'
+      || header->global_command >= len)
+    goto stale;
+  for (i = 0; i < header->n_alarms; i++)
+    if (records[i].name >= len || records[i].info >= len
+        || records[i].command >= len)
+      goto stale;
+
+  snapshot = g_new0 (TimerSnapshot, 1);
+  snapshot->file = file;
+  snapshot->header = header;
+  snapshot->records = records;
+  snapshot->strings = contents + sizeof (SnapshotHeader) + records_len;
+  snapshot->strings_len = len;
+
+  return snapshot;
+
+stale:
+  g_mapped_file_unref (file);
+  return NULL;
+}
+
+
+
+guint
+timer_snapshot_n_alarms (TimerSnapshot *snapshot)
+{
+  return snapshot->header->n_alarms;
+}
+
+
+
+/* The strings stay valid until the snapshot is closed */
+void
+timer_snapshot_get_alarm (TimerSnapshot *snapshot,
+                          guint index,
+                          TimerSnapshotAlarm *alarm)
+{
+  const SnapshotRecord *record;
+
+  g_return_if_fail (index < snapshot->header->n_alarms);
+
+  record = &snapshot->records[index];
+  alarm->name = snapshot->strings + record->name;
+  alarm->info = snapshot->strings + record->info;
+  alarm->command = snapshot->strings + record->command;
+  alarm->time = record->time;
+  alarm->flags = record->flags;
+}
+
+
+
+void
+timer_snapshot_get_options (TimerSnapshot *snapshot,
+                            TimerSnapshotOptions *options)
+{
+  const SnapshotHeader *header = snapshot->header;
+
+  options->nowin_if_alarm = (header->flags & SNAPSHOT_NOWIN_IF_ALARM) != 0;
+  options->use_global_command =
+      (header->flags & SNAPSHOT_USE_GLOBAL_COMMAND) != 0;
+  options->repeat_alarm_command =
+      (header->flags & SNAPSHOT_REPEAT_ALARM_COMMAND) != 0;
+  options->skip_missed = (header->flags & SNAPSHOT_SKIP_MISSED) != 0;
+  options->use_notifications =
+      (header->flags & SNAPSHOT_USE_NOTIFICATIONS) != 0;
+  options->repetitions = header->repetitions;
+  options->repeat_interval = header->repeat_interval;
+  options->coalesce_window = header->coalesce_window;
+  options->snooze_time = header->snooze_time;
+  options->global_command = snapshot->strings + header->global_command;
+}
+
+
+
+/**
+ * Copies the string block out of the mapping in one go and hands the
+ * copy to the caller, e.g. for timer_core_adopt_buffer(). The strings
+ * returned by timer_snapshot_get_alarm() and _get_options() from then
+ * on point into the copy, so they outlive the snapshot.
+ **/
+gchar *
+timer_snapshot_take_strings (TimerSnapshot *snapshot, gsize *len)
+{
+  gchar *strings;
+
+  strings = g_malloc (snapshot->strings_len);
+  memcpy (strings, snapshot->strings, snapshot->strings_len);
+  snapshot->strings = strings;
+  *len = snapshot->strings_len;
+
+  return strings;
+}
+
+
+
+void
+timer_snapshot_close (TimerSnapshot *snapshot)
+{
+  if (snapshot == NULL)
+    return;
+
+  g_mapped_file_unref (snapshot->file);
+  g_free (snapshot);
+}
@@ -0,0 +1,83 @@
+/*
+ *
+ *  Copyright (C) 2005-2014 Kemal Ilgar Eroglu <ilgar_eroglu@yahoo.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __TIMERSNAPSHOT_H__
+#define __TIMERSNAPSHOT_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Appended to the rc file name */
+#define TIMER_SNAPSHOT_SUFFIX ".snapshot"
+
+/* TimerSnapshotAlarm flags */
+#define TIMER_SNAPSHOT_COUNTDOWN (1 << 0)
+#define TIMER_SNAPSHOT_RECURRING (1 << 1)
+#define TIMER_SNAPSHOT_AUTOSTART (1 << 2)
+
+typedef struct
+{
+  const gchar *name, *info, *command;
+  gint time;
+  guint flags;
+} TimerSnapshotAlarm;
+
+typedef struct
+{
+  gboolean nowin_if_alarm;
+  gboolean use_global_command;
+  gboolean repeat_alarm_command;
+  gboolean skip_missed;
+  gboolean use_notifications;
+  gint repetitions, repeat_interval;
+  gint coalesce_window;
+  gint snooze_time;
+  const gchar *global_command;
+} TimerSnapshotOptions;
+
+typedef struct _TimerSnapshot TimerSnapshot;
+
+gboolean       timer_snapshot_write       (const gchar                *path,
+                                           const gchar                *rc_path,
+                                           const TimerSnapshotOptions *options,
+                                           const TimerSnapshotAlarm   *alarms,
+                                           guint                       n_alarms,
+                                           GError                    **error);
+
+TimerSnapshot *timer_snapshot_open        (const gchar                *path,
+                                           const gchar                *rc_path);
+
+guint          timer_snapshot_n_alarms    (TimerSnapshot              *snapshot);
+
+void           timer_snapshot_get_alarm   (TimerSnapshot              *snapshot,
+                                           guint                       index,
+                                           TimerSnapshotAlarm         *alarm);
+
+void           timer_snapshot_get_options (TimerSnapshot              *snapshot,
+                                           TimerSnapshotOptions       *options);
+
+gchar         *timer_snapshot_take_strings (TimerSnapshot             *snapshot,
+                                           gsize                      *len);
+
+void           timer_snapshot_close       (TimerSnapshot              *snapshot);
+
+G_END_DECLS
+
+#endif /* !__TIMERSNAPSHOT_H__ */
@@ -0,0 +1,242 @@
+/*
+ *
+ *  Copyright (C) 2005-2014 Kemal Ilgar Eroglu <ilgar_eroglu@yahoo.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * Histograms of what the plugin spends its time on, for finding out
+ * why it gets sluggish. Nothing is recorded unless TIMER_STATS_ENV is
+ * set or recording is turned on from the statistics dialog, and the
+ * recording macros then cost a single predictable branch.
+ *
+ * The buckets are fixed and log-linear like in an HDR histogram:
+ * values below SUB_BUCKETS have a bucket each, and every power of two
+ * above is split into SUB_BUCKETS buckets, so a value is known to
+ * within 1/SUB_BUCKETS of itself whatever its magnitude.
+ **/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "timerstats.h"
+
+
+
+/* Buckets per power of two, a power of two itself */
+#define SUB_BUCKET_BITS 3
+#define SUB_BUCKETS     (1 << SUB_BUCKET_BITS)
+
+/* Enough buckets for any gint64 */
+#define N_BUCKETS ((64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS)
+
+/* Dump period when TIMER_STATS_ENV does not give one, in seconds */
+#define DEFAULT_DUMP_INTERVAL 60
+
+typedef struct
+{
+  guint64 count;
+  gint64 min, max;
+  gdouble sum;
+  guint64 buckets[N_BUCKETS];
+} Histogram;
+
+static const gchar *const stat_names[TIMER_N_STATS] =
+{
+  "tick (us)",
+  "tick alarms scanned",
+  "tooltip bytes",
+  "menu (us)",
+  "spawn (us)",
+  "fire lateness (us)",
+  "repeat lateness (us)"
+};
+
+gboolean timer_stats_enabled = FALSE;
+
+static Histogram histograms[TIMER_N_STATS];
+static guint dump_timeout;
+
+
+
+static guint
+bucket_index (gint64 value)
+{
+  guint64 v = MAX (value, 0);
+  guint exponent = 0;
+
+  if (v < SUB_BUCKETS)
+    return v;
+
+  /* Scale v down to [SUB_BUCKETS, 2 * SUB_BUCKETS) */
+  while ((v >> exponent) >= 2 * SUB_BUCKETS)
+    exponent++;
+
+  return (exponent + 1) * SUB_BUCKETS
+         + ((v >> exponent) & (SUB_BUCKETS - 1));
+}
+
+
+
+/* Smallest value that falls into bucket i */
+static gint64
+bucket_lowest (guint i)
+{
+  guint exponent;
+
+  if (i < SUB_BUCKETS)
+    return i;
+
+  exponent = i / SUB_BUCKETS - 1;
+  return (gint64) (SUB_BUCKETS + i % SUB_BUCKETS) << exponent;
+}
+
+
+
+void
+timer_stats_record (TimerStat stat, gint64 value)
+{
+  Histogram *h = &histograms[stat];
+
+  if (h->count == 0 || value < h->min)
+    h->min = value;
+  if (h->count == 0 || value > h->max)
+    h->max = value;
+  h->count++;
+  h->sum += value;
+  h->buckets[bucket_index (value)]++;
+}
+
+
+
+/* Value below which the given fraction of the recorded values lie */
+static gint64
+percentile (const Histogram *h, gdouble fraction)
+{
+  guint64 rank, seen = 0;
+  guint i;
+
+  rank = (guint64) (fraction * h->count);
+  for (i = 0; i < N_BUCKETS; i++)
+    {
+      seen += h->buckets[i];
+      if (seen > rank)
+        return CLAMP (bucket_lowest (i), h->min, h->max);
+    }
+
+  return h->max;
+}
+
+
+
+/* Appends a table of all the histograms to text */
+void
+timer_stats_format (GString *text)
+{
+  const Histogram *h;
+  guint i;
+
+  g_string_append_printf (text, "%-22s %10s %9s %9s %9s %9s %9s %11s\n",
+                          "", "count", "min", "p50", "p90", "p99", "max",
+                          "mean");
+
+  for (i = 0; i < TIMER_N_STATS; i++)
+    {
+      h = &histograms[i];
+      if (h->count == 0)
+        {
+          g_string_append_printf (text, "%-22s %10d\n", stat_names[i], 0);
+          continue;
+        }
+
+      g_string_append_printf (text,
+                              "%-22s %10" G_GUINT64_FORMAT " %9" G_GINT64_FORMAT
+                              " %9" G_GINT64_FORMAT " %9" G_GINT64_FORMAT
+                              " %9" G_GINT64_FORMAT " %9" G_GINT64_FORMAT
+                              " %11.1f\n",
+                              stat_names[i], h->count, h->min,
+                              percentile (h, 0.5), percentile (h, 0.9),
+                              percentile (h, 0.99), h->max,
+                              h->sum / h->count);
+    }
+}
+
+
+
+void
+timer_stats_reset (void)
+{
+  memset (histograms, 0, sizeof (histograms));
+}
+
+
+
+static gboolean
+dump_function (gpointer data)
+{
+  GString *text = g_string_new (NULL);
+
+  timer_stats_format (text);
+  g_message ("Statistics:\n%s", text->str);
+  g_string_free (text, TRUE);
+
+  return G_SOURCE_CONTINUE;
+}
+
+
+
+/* Turns recording on or off; what was recorded so far is kept */
+void
+timer_stats_enable (gboolean enabled)
+{
+  timer_stats_enabled = enabled;
+}
+
+
+
+/**
+ * Starts recording if TIMER_STATS_ENV is set. Its value is the
+ * period of the dump in seconds; 0 records without dumping.
+ **/
+void
+timer_stats_init (void)
+{
+  const gchar *value;
+  gint interval;
+
+  value = g_getenv (TIMER_STATS_ENV);
+  if (value == NULL)
+    return;
+
+  interval = value[0] != '\0' ? atoi (value) : DEFAULT_DUMP_INTERVAL;
+  timer_stats_enabled = TRUE;
+  if (interval > 0 && dump_timeout == 0)
+    dump_timeout = g_timeout_add_seconds (interval, dump_function, NULL);
+}
+
+
+
+void
+timer_stats_shutdown (void)
+{
+  if (dump_timeout != 0)
+    g_source_remove (dump_timeout);
+  dump_timeout = 0;
+}
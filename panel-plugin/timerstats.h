@@ -0,0 +1,78 @@
+/*
+ *
+ *  Copyright (C) 2005-2014 Kemal Ilgar Eroglu <ilgar_eroglu@yahoo.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __TIMERSTATS_H__
+#define __TIMERSTATS_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Set in the environment to record the statistics, and to dump them every N seconds */
+#define TIMER_STATS_ENV "XFCE4_TIMER_PLUGIN_STATS"
+
+/* The histograms, one value recorded per event */
+typedef enum
+{
+  TIMER_STAT_TICK_US, /* Duration of a display update */
+  TIMER_STAT_TICK_SCANNED, /* Alarms looked at by a display update */
+  TIMER_STAT_TOOLTIP_BYTES, /* Tooltip text rebuilt by a display update */
+  TIMER_STAT_MENU_US, /* Building or patching the popup menu */
+  TIMER_STAT_SPAWN_US, /* Spawning an alarm command */
+  TIMER_STAT_FIRE_LATENESS_US, /* How late a countdown was handled */
+  TIMER_STAT_REPEAT_LATENESS_US, /* How late a command repeat was handled */
+  TIMER_N_STATS
+} TimerStat;
+
+/* Only read through the macros below, so that recording costs a branch when off */
+extern gboolean timer_stats_enabled;
+
+/* Recorded values are only worth a function call while recording */
+#define TIMER_STATS_RECORD(stat, value) \
+  G_STMT_START { \
+    if (G_UNLIKELY (timer_stats_enabled)) \
+      timer_stats_record ((stat), (value)); \
+  } G_STMT_END
+
+/* Start time for TIMER_STATS_RECORD_SINCE(), 0 while not recording */
+#define TIMER_STATS_CLOCK() \
+  (G_UNLIKELY (timer_stats_enabled) ? g_get_monotonic_time () : 0)
+
+#define TIMER_STATS_RECORD_SINCE(stat, start) \
+  G_STMT_START { \
+    if (G_UNLIKELY (timer_stats_enabled) && (start) != 0) \
+      timer_stats_record ((stat), g_get_monotonic_time () - (start)); \
+  } G_STMT_END
+
+void timer_stats_init    (void);
+
+void timer_stats_shutdown (void);
+
+void timer_stats_enable  (gboolean    enabled);
+
+void timer_stats_record  (TimerStat   stat,
+                          gint64      value);
+
+void timer_stats_reset   (void);
+
+void timer_stats_format  (GString    *text);
+
+G_END_DECLS
+
+#endif /* !__TIMERSTATS_H__ */
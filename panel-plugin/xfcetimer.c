@@ -19,12 +19,15 @@
 
 
 
-/* Countdown update period in milliseconds */
-#define UPDATE_INTERVAL 2000
+/* Tooltip and pbar update period in milliseconds while the tooltip or menu is open */
+#define UPDATE_INTERVAL 1000
 #define PBAR_THICKNESS  10
 #define BORDER 4
 #define WIDGET_SPACING 2
 
+/* Snooze time unless set otherwise, in seconds */
+#define SNOOZE_TIME_DEFAULT 600
+
 
 
 #ifdef HAVE_CONFIG_H
@@ -35,335 +38,902 @@
 #include <stdlib.h>
 #include <time.h>
 #include <string.h>
+#include <sys/wait.h>
 
 #include <gtk/gtk.h>
 #include <glib/gprintf.h>  // for gcc's warning: implicit declaration of function 'g_sprintf'
+#include <glib/gstdio.h>
 #include <libxfce4util/libxfce4util.h>
 #include <libxfce4ui/libxfce4ui.h>
 #include <libxfce4panel/libxfce4panel.h>
 
+#include "timerconfig.h"
+#include "timercore.h"
+#include "timerdbus.h"
+#include "timerimport.h"
+#include "timerjournal.h"
+#include "timernotify.h"
+#include "timersnapshot.h"
+#include "timerstats.h"
 #include "xfcetimer.h"
 
 
 
-static void
-create_plugin_control (XfcePanelPlugin *plugin);
+/* TIMER_ALARM_* flags of an alarm */
+#define ALARM_STATE(pd, alrm) \
+  timer_core_get_state (((plugin_data *) (pd))->core, (alrm))
+
+/* The plugin's own data of an alarm */
+#define ALARM_VIEW(alrm) ((alarm_view *) (alrm)->user_data)
+
+/* Liststore icon flagging an alarm command that cannot be run */
+#define COMMAND_ICON(alrm) ((alrm)->command_error ? "dialog-warning" : NULL)
+
+
 
 static void
-start_timer (plugin_data *pd, alarm_t* alrm);
+create_plugin_control (XfcePanelPlugin *plugin);
 
 static void
-dialog_response (GtkWidget *dlg, int response, alarm_t* alrm);
+dialog_response (GtkWidget *dlg, int response, plugin_data *pd);
 
 static void
 start_stop_callback (GtkWidget* menuitem, gpointer data);
 XFCE_PANEL_PLUGIN_REGISTER ( create_plugin_control);
 
-void
-make_menu (plugin_data *pd);
+static void
+menu_update_alarm (plugin_data *pd, alarm_t *alrm);
 
 
 
-/* This is the timeout function that repeats the alarm */
-static gboolean
-repeat_alarm (gpointer data)
+/* Sets the default command, the core keeps it parsed */
+static void
+set_global_command (plugin_data *pd, const gchar *command)
+{
+  g_free (pd->global_command);
+  pd->global_command = g_strdup (command);
+  timer_core_set_global_command (pd->core, command);
+}
+
+
+
+/* Hands the options on what an alarm runs over to the core */
+static void
+command_options_changed (plugin_data *pd)
+{
+  timer_core_set_use_global_command (pd->core, pd->use_global_command);
+  timer_core_set_repeat (pd->core, pd->repeat_alarm_command, pd->repetitions,
+                         pd->repeat_interval);
+  timer_core_set_coalesce (pd->core, pd->coalesce_window * 1000);
+}
+
+
+
+/* Gives an alarm of the core its view data */
+static void
+alarm_view_new (plugin_data *pd, alarm_t *alrm)
+{
+  alarm_view *view;
+
+  view = g_new0 (alarm_view, 1);
+  view->pd = pd;
+  view->tip_remaining = -1;
+  alrm->user_data = view;
+}
+
+
+
+/* Appends a new alarm to the core, along with its view data */
+static alarm_t *
+alarm_new (plugin_data *pd)
 {
   alarm_t *alrm;
-  gchar *command;
-  plugin_data *pd;
 
-  alrm = (alarm_t *) data;
-  pd = alrm->pd;
+  alrm = timer_core_add (pd->core);
+  alarm_view_new (pd, alrm);
 
-  /* Don't repeat anymore */
-  if (alrm->rem_repetitions == 0)
-    {
-      alrm->is_repeating=FALSE;
-      return FALSE;
-    }
+  return alrm;
+}
 
-  if (strlen(alrm->command)>0)
-    command = g_strdup(alrm->command);
-  else if (pd->use_global_command)
-    command = g_strdup (pd->global_command);
+
+
+/* The time column of an alarm: its countdown period or "At hh:mm" */
+static gchar *
+alarm_time_info (gboolean is_countdown, gint t)
+{
+  if (!is_countdown)
+    return g_strdup_printf (_("At %02d:%02d"), t / 60, t % 60);
+
+  if (t >= 3600)
+    return g_strdup_printf (_("%dh %dm %ds"), t / 3600, t / 60 % 60, t % 60);
+  else if (t >= 60)
+    return g_strdup_printf (_("%dm %ds"), t / 60, t % 60);
   else
-    command = g_strdup("");
+    return g_strdup_printf (_("%ds"), t);
+}
 
-  g_spawn_command_line_async (command, NULL);
-  alrm->rem_repetitions = alrm->rem_repetitions - 1;
-  return TRUE;
+
+
+/* Frees the view data of an alarm, before the core frees the alarm */
+static void
+alarm_view_free (alarm_t *alrm)
+{
+  alarm_view *view = ALARM_VIEW (alrm);
+
+  if (view->tip_line)
+    g_string_free (view->tip_line, TRUE);
+  g_free (view);
+  alrm->user_data = NULL;
+}
+
+
+
+/**
+ * Returns the alarm selected in the options treeview and
+ * stores its position in index. Returns NULL if none.
+ **/
+static alarm_t *
+get_selected_alarm (plugin_data *pd, GtkTreeIter *iter, guint *index)
+{
+  GtkTreeModel *model;
+  GtkTreeSelection *select;
+  GtkTreePath *path;
+  guint id;
+
+  select = gtk_tree_view_get_selection (GTK_TREE_VIEW (pd->tree));
+
+  if (!select)
+    return NULL;
+
+  if (!gtk_tree_selection_get_selected (select, &model, iter))
+    return NULL;
+
+  if (index)
+    {
+      path = gtk_tree_model_get_path (model, iter);
+      *index = gtk_tree_path_get_indices (path)[0];
+      gtk_tree_path_free (path);
+    }
+
+  gtk_tree_model_get (model, iter, 0, &id, -1);
+  return timer_core_lookup (pd->core, id);
 }
 
 
 
 /**
  * Fills in the pd->liststore to create the treeview
- * in the options window. The second arguments indicates
- * the alarm whose row will be highlighted in the
- * treeview. If it is NULL, no action is taken.
+ * in the options window. Later changes are applied
+ * to single rows.
  **/
 static void
-fill_liststore (plugin_data *pd, GList *selected)
+fill_liststore (plugin_data *pd)
 {
   GtkTreeIter iter;
-  GList *list;
   alarm_t *alrm;
+  guint i;
 
   if (pd->liststore)
     gtk_list_store_clear (pd->liststore);
 
-  list = pd->alarm_list;
+  for (i = 0; i < timer_core_n_alarms (pd->core); i++)
+    {
+      alrm = timer_core_get (pd->core, i);
+
+      gtk_list_store_insert_with_values (pd->liststore, &iter, -1, 0, alrm->id,
+                                         1, alrm->name, 2, alrm->info, 3,
+                                         alrm->command, 4,
+                                         COMMAND_ICON (alrm), 5,
+                                         alrm->command_error, -1);
+    }
+}
+
+
+
+/* Rewrites the cached tooltip line of a running alarm */
+static void
+update_tip_line (alarm_t *alrm, gint remaining, gboolean paused)
+{
+  alarm_view *view = ALARM_VIEW (alrm);
+
+  if (view->tip_line == NULL)
+    view->tip_line = g_string_new (NULL);
+
+  if (remaining >= 3600)
+    g_string_printf (view->tip_line, _("%dh %dm %ds left"), remaining / 3600,
+                     (remaining % 3600) / 60, remaining % 60);
+  else if (remaining >= 60)
+    g_string_printf (view->tip_line, _("%dm %ds left"), remaining / 60,
+                     remaining % 60);
+  else
+    g_string_printf (view->tip_line, _("%ds left"), remaining);
+
+  if (paused)
+    g_string_append (view->tip_line, _(" (Paused)"));
+  if (alrm->snoozes > 0)
+    g_string_append_printf (view->tip_line, _(" (Snoozed: %u)"),
+                            alrm->snoozes);
+
+  g_string_prepend_c (view->tip_line, '\t');
+  g_string_prepend (view->tip_line, alrm->name);
+
+  view->tip_remaining = remaining;
+  view->tip_paused = paused;
+}
 
-  while (list)
+
+
+/**
+ * Brings the tooltip up to date. Only the lines whose text changed
+ * are rewritten, and the text is only rebuilt if one did. Returns
+ * the number of alarms looked at.
+ **/
+static guint
+update_tooltip (plugin_data *pd, gint64 now)
+{
+  gint remaining;
+  guint i, n = timer_core_n_alarms (pd->core);
+  alarm_t *alrm;
+  alarm_view *view;
+  gboolean firstActiveTimer = TRUE, paused;
+
+  for (i = 0; i < n; i++)
     {
+      alrm = timer_core_get (pd->core, i);
+      if (!(ALARM_STATE (pd, alrm) & TIMER_ALARM_RUNNING))
+        continue;
 
-      alrm = (alarm_t *) list->data;
+      remaining = (gint) ((timer_core_remaining (pd->core, alrm, now)
+                           + G_USEC_PER_SEC - 1) / G_USEC_PER_SEC);
+      paused = (ALARM_STATE (pd, alrm) & TIMER_ALARM_PAUSED) != 0;
+      view = ALARM_VIEW (alrm);
 
-      gtk_list_store_append (pd->liststore, &iter);
+      if (remaining != view->tip_remaining || paused != view->tip_paused)
+        {
+          update_tip_line (alrm, remaining, paused);
+          pd->tooltip_dirty = TRUE;
+        }
+    }
 
-      gtk_list_store_set (pd->liststore, &iter, 0, list, 1, alrm->name, 2,
-                          alrm->info, 3, alrm->command, -1);
+  if (!pd->tooltip_dirty)
+    return n;
 
-      /* We select the given row */
-      if (selected && list == selected)
-        gtk_tree_selection_select_iter (
-            gtk_tree_view_get_selection (GTK_TREE_VIEW (pd->tree)), &iter);
+  g_string_truncate (pd->tooltip, 0);
+  for (i = 0; i < n; i++)
+    {
+      alrm = timer_core_get (pd->core, i);
+      if (!(ALARM_STATE (pd, alrm) & TIMER_ALARM_RUNNING))
+        continue;
 
-      list = g_list_next (list);
+      if (firstActiveTimer)
+        firstActiveTimer = FALSE;
+      else
+        g_string_append_c (pd->tooltip, '\n');
+      view = ALARM_VIEW (alrm);
+      g_string_append_len (pd->tooltip, view->tip_line->str,
+                           view->tip_line->len);
     }
+
+  gtk_widget_set_tooltip_text (GTK_WIDGET (pd->base), pd->tooltip->str);
+  pd->tooltip_dirty = FALSE;
+  TIMER_STATS_RECORD (TIMER_STAT_TOOLTIP_BYTES, pd->tooltip->len);
+
+  return 2 * n;
 }
 
 
 
 /**
- * This is the update function that updates the
- * tooltip, pbar and keeps track of elapsed time
+ * Updates the tooltip and the pbar. The pbar shows
+ * the progress of the first timer to finish, which
+ * is returned (NULL if no timer is on).
+ * The tooltip is only updated while it can be seen.
+ **/
+static alarm_t *
+update_display (plugin_data *pd)
+{
+  gint64 start = TIMER_STATS_CLOCK (), now = timer_core_now (pd->core);
+  guint scanned;
+  alarm_t *shown;
+
+  shown = timer_core_first_to_finish (pd->core, now);
+  scanned = timer_core_n_alarms (pd->core);
+
+  if (shown && shown->timeout_period_in_sec > 0)
+    gtk_progress_bar_set_fraction (GTK_PROGRESS_BAR (pd->pbar),
+        (gdouble) timer_core_remaining (pd->core, shown, now)
+        / ((gint64) shown->timeout_period_in_sec * G_USEC_PER_SEC));
+  else
+    gtk_progress_bar_set_fraction (GTK_PROGRESS_BAR (pd->pbar), 0);
+
+  if (pd->hovered)
+    scanned += update_tooltip (pd, now);
+  TIMER_STATS_RECORD (TIMER_STAT_TICK_SCANNED, scanned);
+  TIMER_STATS_RECORD_SINCE (TIMER_STAT_TICK_US, start);
+
+  return shown;
+}
+
+
+
+/**
+ * Counts display wakeups, reported once per hour together
+ * with the expiry wakeups the core counted meanwhile.
+ **/
+static void
+count_wakeup (plugin_data *pd)
+{
+  const TimerCoreStats *stats;
+  gint64 now = g_get_monotonic_time ();
+
+  pd->wakeups++;
+  if (now - pd->wakeups_since < G_TIME_SPAN_HOUR)
+    return;
+
+  stats = timer_core_get_stats (pd->core);
+  g_debug ("%u wakeups in the last hour",
+           pd->wakeups + stats->wakeups - pd->expiry_wakeups);
+  pd->wakeups = 0;
+  pd->wakeups_since = now;
+  pd->expiry_wakeups = stats->wakeups;
+}
+
+
+
+/**
+ * Returns the delay in milliseconds until the display changes in a
+ * way a human can see, or -1 if it won't change at all. The tooltip
+ * and menu are refreshed every UPDATE_INTERVAL while they are open;
+ * otherwise we only wake up for the next pixel step of the pbar or
+ * the next whole minute of the countdown it shows. Expiries are
+ * handled by the expiry timeout.
+ **/
+static gint
+next_visible_change (plugin_data *pd, alarm_t *shown)
+{
+  gint64 period, elapsed, step, delay, minute;
+  gint size;
+
+  if (pd->hovered || pd->menu_open)
+    return UPDATE_INTERVAL;
+
+  if (shown == NULL || (ALARM_STATE (pd, shown) & TIMER_ALARM_PAUSED)
+      || shown->timeout_period_in_sec <= 0)
+    return -1;
+
+  period = (gint64) shown->timeout_period_in_sec * G_USEC_PER_SEC;
+  elapsed = period - timer_core_remaining (pd->core, shown,
+                                           timer_core_now (pd->core));
+  if (elapsed >= period || elapsed < 0)
+    return -1;
+
+  /* Next pixel step of the pbar at the current panel size */
+  size = MAX (xfce_panel_plugin_get_size (pd->base) - BORDER, 1);
+  step = MAX (period / size, 1);
+  delay = step - elapsed % step;
+
+  /* Next whole minute of the remaining time, a full minute off if it is on one */
+  minute = (period - elapsed) % G_TIME_SPAN_MINUTE;
+  delay = MIN (delay, minute > 0 ? minute : G_TIME_SPAN_MINUTE);
+
+  return (gint) MIN ((delay + 999) / 1000, G_MAXINT);
+}
+
+
+
+static gboolean
+update_function (gpointer data);
+
+/* (Re)arms the display update timeout after the display was refreshed */
+static void
+schedule_update (plugin_data *pd, alarm_t *shown)
+{
+  gint delay;
+
+  if (pd->update_timeout != 0)
+    g_source_remove (pd->update_timeout);
+  pd->update_timeout = 0;
+
+  if (timer_core_n_running (pd->core) == 0)
+    return;
+
+  delay = next_visible_change (pd, shown);
+  if (delay >= 0)
+    pd->update_timeout = g_timeout_add (delay, update_function, pd);
+}
+
+
+
+/**
+ * This is the update function that refreshes the tooltip
+ * and pbar whenever a visible change is due
  **/
 static gboolean
 update_function (gpointer data)
 {
   plugin_data *pd = (plugin_data *) data;
-  gint elapsed_sec, remaining;
-  //for showing the progress of the first to finish
-  gint min_remaining_time = G_MAXINT;
-  gchar *tiptext = NULL, *temp, *dialog_title, *dialog_message;
-  gchar *finalTipText = g_strdup("");
-  GtkWidget *dialog;
-  GList *list = NULL;
+
+  /* This source is about to be destroyed by returning FALSE */
+  pd->update_timeout = 0;
+  count_wakeup (pd);
+
+  schedule_update (pd, update_display (pd));
+  return FALSE;
+}
+
+
+
+/**
+ * Called whenever a timer is started, stopped, paused or
+ * resumed, and when the tooltip or menu opens or closes.
+ * Refreshes the display and replans the next update.
+ **/
+static void
+active_timers_changed (plugin_data *pd)
+{
+  schedule_update (pd, update_display (pd));
+}
+
+
+
+/* Pointer entered or left the plugin, the tooltip may show up */
+static gboolean
+crossing_event (GtkWidget *widget, GdkEventCrossing *event, gpointer data)
+{
+  plugin_data *pd = (plugin_data *) data;
+
+  /* Moving between our own child widgets */
+  if (event->detail == GDK_NOTIFY_INFERIOR)
+    return FALSE;
+
+  pd->hovered = (event->type == GDK_ENTER_NOTIFY);
+  active_timers_changed (pd);
+
+  return FALSE;
+}
+
+
+
+/* The popup menu was closed */
+static void
+menu_deactivated (GtkMenuShell *menu, gpointer data)
+{
+  plugin_data *pd = (plugin_data *) data;
+
+  pd->menu_open = FALSE;
+  active_timers_changed (pd);
+}
+
+
+
+/* Alarms named in the alarm window or notification, the others are counted */
+#define ALARM_QUEUE_MAX_NAMES 10
+
+/* Responses of the alarm window, and what is done to the alarm queue */
+#define ALARM_RESPONSE_DISMISS 0
+#define ALARM_RESPONSE_RERUN   1
+#define ALARM_RESPONSE_SNOOZE  2
+
+/* Snooze times offered besides the one of the settings, in seconds */
+static const gint snooze_presets[] = { 30, 60, 5 * 60 };
+
+static void
+alarm_queue_update (plugin_data *pd, gboolean use_window);
+
+static void
+alarm_queue_act (plugin_data *pd, gint response, gint snooze);
+
+
+
+/* Snooze time for menus and buttons, e.g. "90 s" or "5 min" */
+static gchar *
+snooze_label (gint seconds)
+{
+  if (seconds % 60 == 0)
+    return g_strdup_printf (_("%d min"), seconds / 60);
+  else
+    return g_strdup_printf (_("%d s"), seconds);
+}
+
+
+
+/* Notification callbacks: the user picked an action or closed it */
+static void
+notify_action (TimerNotify *notify, const gchar *key, gpointer data)
+{
+  plugin_data *pd = (plugin_data *) data;
+
+  if (g_strcmp0 (key, "rerun") == 0)
+    alarm_queue_act (pd, ALARM_RESPONSE_RERUN, 0);
+  else if (g_strcmp0 (key, "snooze") == 0)
+    alarm_queue_act (pd, ALARM_RESPONSE_SNOOZE, pd->snooze_time);
+  else
+    alarm_queue_act (pd, ALARM_RESPONSE_DISMISS, 0);
+}
+
+
+
+static void
+notify_closed (TimerNotify *notify, gpointer data)
+{
+  alarm_queue_act ((plugin_data *) data, ALARM_RESPONSE_DISMISS, 0);
+}
+
+
+
+/* No notification daemon, fall back to the window */
+static void
+notify_failed (TimerNotify *notify, gpointer data)
+{
+  alarm_queue_update ((plugin_data *) data, TRUE);
+}
+
+
+
+static const TimerNotifyCallbacks notify_callbacks =
+{
+  notify_action, notify_closed, notify_failed
+};
+
+
+
+/**
+ * Text telling the user about the alarms in the queue. Only the
+ * first few are named, so it stays short whatever went off.
+ **/
+static void
+alarm_queue_text (plugin_data *pd, gchar **summary, gchar **body)
+{
+  GString *names;
   alarm_t *alrm;
-  gboolean callAgain = FALSE;
-  gboolean firstActiveTimer = TRUE;
-
-  list = pd->alarm_list;
-
-  while (list){
-	  alrm = (alarm_t *) list->data;
-	  if(alrm->timer_on){
-
-	  elapsed_sec = (gint) g_timer_elapsed(alrm->timer, NULL);
-  /* If countdown is not over, update tooltip */
-	  if (elapsed_sec < alrm->timeout_period_in_sec) {
-		  remaining = alrm->timeout_period_in_sec - elapsed_sec;
-
-		  if (remaining >= 3600)
-			tiptext = g_strdup_printf (_("%dh %dm %ds left"), remaining / 3600,
-									   (remaining % 3600) / 60, remaining % 60);
-		  else if (remaining >= 60)
-			tiptext = g_strdup_printf (_("%dm %ds left"), remaining / 60,
-									   remaining % 60);
-		  else
-			tiptext = g_strdup_printf (_("%ds left"), remaining);
-
-		  if (alrm->is_paused)
-			{
-			  temp = g_strconcat (tiptext, _(" (Paused)"), NULL);
-			  g_free (tiptext);
-			  tiptext = temp;
-			}
-		  if(alrm->timeout_period_in_sec < min_remaining_time){
-			  min_remaining_time = alrm->timeout_period_in_sec;
-			  gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(pd->pbar),
-					  1.0 - ((gdouble) elapsed_sec) / alrm->timeout_period_in_sec);
-		  }
-	  callAgain =  TRUE;
-	  }else{
-			  gchar *command;
-
-			  /* Countdown is over, stop timer and free resources */
-			  if (alrm->timer)
-				  g_timer_destroy(alrm->timer);
-			  alrm->timer = NULL;
-			  /* Disable tooltips, reset pbar */
-			  gtk_widget_set_tooltip_text (GTK_WIDGET (pd->base), "");
-			  gtk_progress_bar_set_fraction (GTK_PROGRESS_BAR (pd->pbar), 0);
-
-			  alrm->timeout = 0;
-			  alrm->timer_on = FALSE;
-
-			  /* If an alarm command is set, it overrides the default (if any) */
-			  if (strlen(alrm->command)>0)
-				command = g_strdup(alrm->command);
-			  else if (pd->use_global_command)
-				command = g_strdup (pd->global_command);
-			  else
-				command = g_strdup("");
-
-			  if ((strlen(command) == 0) || !pd->nowin_if_alarm) {
-				gtk_progress_bar_set_fraction (GTK_PROGRESS_BAR (pd->pbar), 0);
-
-				/* Display the name of the alarm when the countdown ends */
-				dialog_message = g_strdup_printf(_("Beeep! :) \nTime is up for the alarm %s."), alrm->name);
-				dialog_title = g_strdup_printf("Xfce4 Timer Plugin: %s", alrm->name);
-
-				dialog = gtk_message_dialog_new(NULL, GTK_DIALOG_MODAL,
-						GTK_MESSAGE_WARNING, GTK_BUTTONS_NONE, "%s", dialog_message);
-
-				gtk_window_set_title((GtkWindow *) dialog, dialog_title);
-
-				gtk_dialog_add_button((GtkDialog *) dialog, _("Close"), 0);
-				gtk_dialog_add_button((GtkDialog *) dialog, _("Rerun the timer"), 1);
-
-				g_signal_connect(dialog, "response",
-						G_CALLBACK(dialog_response),
-						alrm);
-
-				g_free(dialog_title);
-				g_free(dialog_message);
-
-				gtk_widget_show(dialog);
-			}
-
-			if (strlen(command) > 0) {
-
-				g_spawn_command_line_async(command, NULL);
-
-				if (pd->repeat_alarm_command) {
-					alrm->is_repeating = TRUE;
-					alrm->rem_repetitions = pd->repetitions;
-					if (alrm->repeat_timeout != 0)
-						g_source_remove(alrm->repeat_timeout);
-					alrm->repeat_timeout = g_timeout_add(pd->repeat_interval * 1000, repeat_alarm, alrm);
-				} else {
-					if (command)
-						g_free(command);
-					command = NULL;
-				}
-			}
-
-			//Check if alarm is recurring after it's finished and destroyed; if yes then start it again.
-			if(alrm->is_recurring){
-				start_timer(pd,alrm);
-			}
-
-		  }
-		  //tiptext = g_strconcat("\t", tiptext, NULL);
-		  temp = g_strconcat(alrm->name ,"\t", tiptext, NULL);
-		  g_free(tiptext);
-		  tiptext = temp;
-		  //if not first
-		  if(firstActiveTimer){
-		  	firstActiveTimer = FALSE;
-		  }else{
-			temp = g_strconcat("\n", tiptext, NULL);
-			g_free(tiptext);
-			tiptext = temp;
-		  }
-		  temp = g_strconcat(finalTipText, tiptext, NULL);
-		  g_free(finalTipText);
-		  finalTipText = temp;
-		}
-		list = g_list_next (list);
-	  }
-  gtk_widget_set_tooltip_text (GTK_WIDGET(pd->base), finalTipText);
-  g_free(tiptext);
-  g_free(finalTipText);
-
-  return callAgain;
+  guint i, n = pd->alarm_queue->len;
+
+  names = g_string_new (NULL);
+  for (i = 0; i < MIN (n, ALARM_QUEUE_MAX_NAMES); i++)
+    {
+      alrm = timer_core_lookup (pd->core,
+                                g_array_index (pd->alarm_queue, guint, i));
+      g_string_append_printf (names, "%s%s", i > 0 ? "\n" : "", alrm->name);
+    }
+  if (n > ALARM_QUEUE_MAX_NAMES)
+    g_string_append_printf (names, _("\nand %u more"),
+                            n - ALARM_QUEUE_MAX_NAMES);
+
+  if (n == 1)
+    {
+      alrm = timer_core_lookup (pd->core,
+                                g_array_index (pd->alarm_queue, guint, 0));
+      /* Display the name of the alarm when the countdown ends */
+      *summary = g_strdup_printf (_("Time is up for the alarm %s."),
+                                  alrm->name);
+      *body = g_strdup (alrm->info);
+    }
+  else
+    {
+      *summary = g_strdup_printf (_("Time is up for %u alarms."), n);
+      *body = g_strdup (names->str);
+    }
+
+  g_string_free (names, TRUE);
+}
+
+
+
+/* The window the alarms are shown in, made once and kept for reuse */
+static void
+alarm_window_show (plugin_data *pd, const gchar *summary, const gchar *body)
+{
+  GtkWidget *button, *hbox;
+  gchar *text;
+  gint active;
+  guint i;
+
+  if (pd->alarm_window == NULL)
+    {
+      pd->alarm_window = gtk_message_dialog_new (NULL, 0, GTK_MESSAGE_WARNING,
+                                                 GTK_BUTTONS_NONE, NULL);
+      gtk_window_set_title (GTK_WINDOW (pd->alarm_window),
+                            _("Xfce4 Timer Plugin"));
+      gtk_dialog_add_button (GTK_DIALOG (pd->alarm_window), _("Close"),
+                             ALARM_RESPONSE_DISMISS);
+      gtk_dialog_add_button (GTK_DIALOG (pd->alarm_window), _("Snooze"),
+                             ALARM_RESPONSE_SNOOZE);
+      gtk_dialog_add_button (GTK_DIALOG (pd->alarm_window),
+                             _("Rerun the timer"), ALARM_RESPONSE_RERUN);
+      g_signal_connect (G_OBJECT (pd->alarm_window), "response",
+                        G_CALLBACK (dialog_response), pd);
+
+      hbox = gtk_box_new (GTK_ORIENTATION_HORIZONTAL, 0);
+      gtk_box_pack_start (GTK_BOX (hbox), gtk_label_new (_("Snooze for")),
+                          FALSE, FALSE, 0);
+      pd->snooze_combo = gtk_combo_box_text_new ();
+      gtk_box_pack_start (GTK_BOX (hbox), pd->snooze_combo, FALSE, FALSE, 10);
+      gtk_widget_show_all (hbox);
+      gtk_box_pack_start (GTK_BOX (gtk_message_dialog_get_message_area (
+                              GTK_MESSAGE_DIALOG (pd->alarm_window))),
+                          hbox, FALSE, FALSE, WIDGET_SPACING);
+    }
+
+  /* The snooze time of the settings may have changed; the pick stays */
+  active = gtk_combo_box_get_active (GTK_COMBO_BOX (pd->snooze_combo));
+  gtk_combo_box_text_remove_all (GTK_COMBO_BOX_TEXT (pd->snooze_combo));
+  for (i = 0; i <= G_N_ELEMENTS (snooze_presets); i++)
+    {
+      text = snooze_label (i < G_N_ELEMENTS (snooze_presets)
+                           ? snooze_presets[i] : pd->snooze_time);
+      gtk_combo_box_text_append_text (GTK_COMBO_BOX_TEXT (pd->snooze_combo),
+                                      text);
+      g_free (text);
+    }
+  gtk_combo_box_set_active (GTK_COMBO_BOX (pd->snooze_combo),
+                            active >= 0 ? active
+                                        : (gint) G_N_ELEMENTS (snooze_presets));
+
+  button = gtk_dialog_get_widget_for_response (GTK_DIALOG (pd->alarm_window),
+                                               ALARM_RESPONSE_RERUN);
+  gtk_button_set_label (GTK_BUTTON (button),
+                        pd->alarm_queue->len == 1 ? _("Rerun the timer")
+                                                  : _("Rerun the timers"));
+  text = g_strdup_printf ("%s\n%s", _("Beeep! :)"), summary);
+  g_object_set (G_OBJECT (pd->alarm_window), "text", text,
+                "secondary-text", body, NULL);
+  g_free (text);
+  gtk_window_present (GTK_WINDOW (pd->alarm_window));
 }
 
 
 
 /**
- * This is the callback function called when a timer
- * is selected in the popup menu
+ * Shows the alarm queue, as a desktop notification if they are on
+ * and use_window is FALSE, else in the alarm window. Whatever went
+ * off, there is only ever one of either. An empty queue hides them.
  **/
 static void
-timer_selected (GtkWidget* menuitem, gpointer data)
+alarm_queue_update (plugin_data *pd, gboolean use_window)
 {
-  GList *list = (GList *) data;
+  const gchar *actions[7];
+  gchar *summary, *body, *snooze, *snooze_action;
+
+  pd->alarm_queue_dirty = FALSE;
+
+  if (pd->alarm_queue->len == 0)
+    {
+      if (pd->alarm_window)
+        gtk_widget_hide (pd->alarm_window);
+      if (pd->notify)
+        timer_notify_close (pd->notify);
+      return;
+    }
+
+  alarm_queue_text (pd, &summary, &body);
+
+  if (pd->use_notifications && !use_window)
+    {
+      if (pd->notify == NULL)
+        pd->notify = timer_notify_new (_("Xfce4 Timer Plugin"),
+                                       "xfce4-timer-plugin", &notify_callbacks,
+                                       pd);
+      snooze = snooze_label (pd->snooze_time);
+      snooze_action = g_strdup_printf (_("Snooze %s"), snooze);
+      actions[0] = "rerun";
+      actions[1] = _("Rerun");
+      actions[2] = "snooze";
+      actions[3] = snooze_action;
+      actions[4] = "dismiss";
+      actions[5] = _("Dismiss");
+      actions[6] = NULL;
+
+      /* Left over from a time the notification daemon was not there */
+      if (pd->alarm_window)
+        gtk_widget_hide (pd->alarm_window);
+      timer_notify_show (pd->notify, summary, body, actions);
+      g_free (snooze_action);
+      g_free (snooze);
+    }
+  else
+    alarm_window_show (pd, summary, body);
+
+  g_free (summary);
+  g_free (body);
+}
+
+
+
+/**
+ * Dismisses the alarms in the queue, restarting them first on
+ * ALARM_RESPONSE_RERUN or snoozing them by 'snooze' seconds on
+ * ALARM_RESPONSE_SNOOZE.
+ **/
+static void
+alarm_queue_act (plugin_data *pd, gint response, gint snooze)
+{
+  GArray *ids;
   alarm_t *alrm;
-  plugin_data *pd;
+  guint i;
+
+  /* Starting alarms may add to the queue, so take it over */
+  ids = pd->alarm_queue;
+  pd->alarm_queue = g_array_new (FALSE, FALSE, sizeof (guint));
+
+  timer_core_freeze (pd->core);
+  for (i = 0; i < ids->len; i++)
+    {
+      alrm = timer_core_lookup (pd->core, g_array_index (ids, guint, i));
+      /* Does nothing if a recurring alarm has already been restarted */
+      if (response == ALARM_RESPONSE_RERUN)
+        timer_core_start (pd->core, alrm);
+      else if (response == ALARM_RESPONSE_SNOOZE)
+        timer_core_snooze (pd->core, alrm, snooze);
+      else
+        menu_update_alarm (pd, alrm);
+    }
+  timer_core_thaw (pd->core);
+  g_array_unref (ids);
+
+  alarm_queue_update (pd, FALSE);
+}
+
 
-  alrm = (alarm_t *) list->data;
-  pd = (plugin_data *) alrm->pd;
 
-  pd->selected = list;
+/* Queue position of an alarm, -1 if it is not waiting for the user */
+static gint
+alarm_queue_find (plugin_data *pd, alarm_t *alrm)
+{
+  guint i;
+
+  for (i = 0; i < pd->alarm_queue->len; i++)
+    if (g_array_index (pd->alarm_queue, guint, i) == alrm->id)
+      return i;
 
-  start_stop_callback (menuitem, list);
+  return -1;
+}
+
+
+
+/* Takes an alarm out of the queue, e.g. when it is removed */
+static void
+alarm_queue_remove (plugin_data *pd, alarm_t *alrm)
+{
+  gint i = alarm_queue_find (pd, alrm);
+
+  if (i < 0)
+    return;
+
+  g_array_remove_index (pd->alarm_queue, i);
+  alarm_queue_update (pd, FALSE);
+}
+
+
+
+/* Snoozes one alarm, which the user has then seen to */
+static void
+alarm_snooze (plugin_data *pd, alarm_t *alrm, gint seconds)
+{
+  alarm_queue_remove (pd, alrm);
+  timer_core_snooze (pd->core, alrm, seconds);
 }
 
 
 
 /**
- * Used for starting/rerunning the timer
- * Assumes that the timer is already stopped
+ * Core callback: the countdown is over. Queues it for the user,
+ * unless the alarm runs a command and the window is not wanted
+ * then; the core runs the command itself. The queue is shown once
+ * the core is done with the batch.
  **/
 static void
-start_timer (plugin_data *pd, alarm_t* alrm)
+alarm_fired (TimerCore *core, alarm_t *alrm, gpointer data)
 {
+  plugin_data *pd = (plugin_data *) data;
 
-  gchar temp[8];
-  gint cur_h, cur_m, cur_s;
-  gint timeout_period;
-  GTimeVal timeval;
-  struct tm *current;
+  if (pd->dbus)
+    timer_dbus_emit_fired (pd->dbus, alrm);
 
-  /* Empty timer list-> Nothing to do. alrm=0, though */
-  if (alrm == NULL)
+  if (timer_core_alarm_argv (core, alrm) != NULL && pd->nowin_if_alarm)
     return;
 
-  gtk_progress_bar_set_fraction (GTK_PROGRESS_BAR (pd->pbar), 1);
+  /* A recurring alarm may go off again before the user saw it */
+  if (alarm_queue_find (pd, alrm) >= 0)
+    return;
+
+  g_array_append_val (pd->alarm_queue, alrm->id);
+  pd->alarm_queue_dirty = TRUE;
+}
 
-  /**
-   *  If it's a 24h type alarm, we find the difference with current time
-   *  Here 'time' is in minutes
-   **/
-  if (!alrm->is_countdown)
-    {
 
-      g_get_current_time (&timeval);
-      current = localtime ((time_t *) &timeval.tv_sec);
-      strftime (temp, 7, "%H", current);
-      cur_h = atoi (temp);
-      strftime (temp, 7, "%M", current);
-      cur_m = atoi (temp);
-      strftime (temp, 7, "%S", current);
-      cur_s = atoi (temp);
 
-      timeout_period = (alrm->time) * 60 - ((60 * cur_h + cur_m) * 60 + cur_s);
+/* Core callback: an alarm was started, stopped, paused or resumed */
+static void
+alarm_changed (TimerCore *core, alarm_t *alrm, gpointer data)
+{
+  plugin_data *pd = (plugin_data *) data;
 
-      if (timeout_period < 0)
-        timeout_period += 24 * 60 * 60;
+  pd->tooltip_dirty = TRUE;
+  menu_update_alarm (pd, alrm);
+}
 
-      alrm->is_countdown = FALSE;
+
+
+/* Writes the state journal now, in place of a pending write */
+static void
+journal_flush (plugin_data *pd)
+{
+  GError *error = NULL;
+
+  if (pd->journal_idle != 0)
+    {
+      g_source_remove (pd->journal_idle);
+      pd->journal_idle = 0;
     }
-  /* Else 'alrm->selected->time' already gives the countdown period in seconds */
-  else
+
+  if (pd->journal_path == NULL)
+    return;
+
+  if (!timer_journal_save (pd->core, pd->journal_path, &error))
     {
-	  alrm->is_countdown = TRUE;
-      timeout_period = alrm->time;
+      g_warning ("Could not save the timer state: %s", error->message);
+      g_error_free (error);
     }
+}
 
-  alrm->timeout_period_in_sec = timeout_period;
 
-  /* start the timer */
-  alrm->timer = g_timer_new ();
-  alrm->timer_on = TRUE;
 
-  gtk_widget_set_tooltip_text (GTK_WIDGET (pd->base), alrm->info);
+static gboolean
+journal_idle (gpointer data)
+{
+  plugin_data *pd = (plugin_data *) data;
+
+  pd->journal_idle = 0;
+  journal_flush (pd);
+
+  return FALSE;
+}
+
+
+
+/**
+ * Core callback: done with a batch of alarm changes. The journal
+ * is written once the main loop is idle, so that changes coming in
+ * a burst only cost one write.
+ **/
+static void
+alarms_changed (TimerCore *core, gpointer data)
+{
+  plugin_data *pd = (plugin_data *) data;
 
-  g_timer_start (alrm->timer);
-  alrm->timeout = g_timeout_add (UPDATE_INTERVAL, update_function, pd);
+  active_timers_changed (pd);
+
+  if (pd->alarm_queue_dirty)
+    alarm_queue_update (pd, FALSE);
+
+  if (pd->journal_idle == 0)
+    pd->journal_idle = g_idle_add (journal_idle, pd);
+}
+
+
+
+static const TimerCoreCallbacks core_callbacks =
+{
+  alarm_fired, alarm_changed, alarms_changed
+};
+
+
+
+/**
+ * This is the callback function called when a timer
+ * is selected in the popup menu
+ **/
+static void
+timer_selected (GtkWidget* menuitem, gpointer data)
+{
+  alarm_t *alrm = (alarm_t *) data;
+  plugin_data *pd;
+
+  pd = (plugin_data *) ALARM_VIEW (alrm)->pd;
+
+  pd->selected = alrm;
+
+  start_stop_callback (menuitem, alrm);
 }
 
 
@@ -373,61 +943,247 @@ start_timer (plugin_data *pd, alarm_t* alrm)
  * start/stop item is selected in the popup menu
  **/
 static void
-start_stop_callback (GtkWidget* menuitem, gpointer list)
+start_stop_callback (GtkWidget* menuitem, gpointer data)
+{
+  alarm_t *alrm = (alarm_t *) data;
+  plugin_data *pd;
+
+  pd = (plugin_data *) ALARM_VIEW (alrm)->pd;
+
+  /* If counting down, we stop the timer, else we start it */
+  if (ALARM_STATE (pd, alrm) & TIMER_ALARM_RUNNING)
+    timer_core_stop (pd->core, alrm);
+  else
+    timer_core_start (pd->core, alrm);
+}
+
+
+
+static void
+pause_resume_selected (GtkWidget* menuitem, gpointer data)
+{
+  alarm_t *alrm = (alarm_t *) data;
+  plugin_data *pd;
+
+  pd = (plugin_data *) ALARM_VIEW (alrm)->pd;
+
+  /* If paused, we resume, else the timer is running so we pause */
+  if (ALARM_STATE (pd, alrm) & TIMER_ALARM_PAUSED)
+    timer_core_resume (pd->core, alrm);
+  else
+    timer_core_pause (pd->core, alrm);
+}
+
+
+
+/* An item of the snooze submenu of an alarm was picked */
+static void
+snooze_selected (GtkWidget *menuitem, gpointer data)
+{
+  alarm_t *alrm = (alarm_t *) data;
+
+  alarm_snooze ((plugin_data *) ALARM_VIEW (alrm)->pd, alrm,
+                GPOINTER_TO_INT (g_object_get_data (G_OBJECT (menuitem),
+                                                    "snooze-time")));
+}
+
+
+
+/* Menu items of an alarm, in menu order */
+#define MENU_ITEMS_PER_ALARM 5
+
+static void
+menu_items (alarm_t *alrm, GtkWidget **items)
+{
+  alarm_view *view = ALARM_VIEW (alrm);
+
+  items[0] = view->menu_sep;
+  items[1] = view->menu_item;
+  items[2] = view->menu_pause;
+  items[3] = view->menu_snooze;
+  items[4] = view->menu_stop;
+}
+
+
+
+/**
+ * Brings the menu items of an alarm in line with its name and
+ * state. Only touches the items of this alarm, so it is cheap
+ * enough to call on every change.
+ **/
+static void
+menu_update_alarm (plugin_data *pd, alarm_t *alrm)
+{
+  alarm_view *view = ALARM_VIEW (alrm);
+  gchar *itemtext;
+  guint8 state;
+
+  if (pd->menu == NULL || view->menu_item == NULL)
+    return;
+
+  state = ALARM_STATE (pd, alrm);
+
+  /* Horizontal line between alarms */
+  gtk_widget_set_visible (view->menu_sep,
+                          timer_core_get (pd->core, 0) != alrm);
+
+  itemtext = g_strdup_printf ("%s (%s)", alrm->name, alrm->info);
+  gtk_menu_item_set_label (GTK_MENU_ITEM (view->menu_item), itemtext);
+  g_free (itemtext);
+
+  /* The running timer is shown but can't be selected again,
+     nor can one whose command is still repeating */
+  gtk_widget_set_sensitive (view->menu_item,
+                            !(state & (TIMER_ALARM_RUNNING | TIMER_ALARM_REPEATING)));
+
+  /* A running countdown can be paused, a paused one only resumed or stopped */
+  gtk_widget_set_visible (view->menu_pause,
+                          (state & TIMER_ALARM_PAUSED)
+                          || ((state & TIMER_ALARM_RUNNING) && alrm->is_countdown));
+  gtk_menu_item_set_label (GTK_MENU_ITEM (view->menu_pause),
+                           (state & TIMER_ALARM_PAUSED) ? _("Resume timer")
+                                                  : _("Pause timer"));
+
+  /* Snoozing is for an alarm that went off or is about to */
+  gtk_widget_set_visible (view->menu_snooze,
+                          (state & (TIMER_ALARM_RUNNING | TIMER_ALARM_REPEATING))
+                          || alarm_queue_find (pd, alrm) >= 0);
+  itemtext = snooze_label (pd->snooze_time);
+  gtk_menu_item_set_label (GTK_MENU_ITEM (view->menu_snooze_custom), itemtext);
+  g_free (itemtext);
+  g_object_set_data (G_OBJECT (view->menu_snooze_custom), "snooze-time",
+                     GINT_TO_POINTER (pd->snooze_time));
+
+  gtk_widget_set_visible (view->menu_stop, state & TIMER_ALARM_RUNNING);
+}
+
+
+
+/* Creates the menu items of the alarm at position index */
+static void
+menu_add_alarm (plugin_data *pd, alarm_t *alrm, guint index)
+{
+  alarm_view *view = ALARM_VIEW (alrm);
+  GtkWidget *items[MENU_ITEMS_PER_ALARM];
+  GtkWidget *submenu, *item;
+  gchar *label;
+  guint i;
+
+  if (pd->menu == NULL)
+    return;
+
+  view->menu_sep = gtk_separator_menu_item_new ();
+
+  view->menu_item = gtk_menu_item_new_with_label ("");
+  g_signal_connect (G_OBJECT (view->menu_item), "activate",
+                    G_CALLBACK (timer_selected), alrm);
+
+  view->menu_pause = gtk_menu_item_new_with_label ("");
+  g_signal_connect (G_OBJECT (view->menu_pause), "activate",
+                    G_CALLBACK (pause_resume_selected), alrm);
+
+  view->menu_snooze = gtk_menu_item_new_with_label (_("Snooze"));
+  submenu = gtk_menu_new ();
+  for (i = 0; i <= G_N_ELEMENTS (snooze_presets); i++)
+    {
+      /* The last one is for the snooze time of the settings */
+      if (i < G_N_ELEMENTS (snooze_presets))
+        {
+          label = snooze_label (snooze_presets[i]);
+          item = gtk_menu_item_new_with_label (label);
+          g_free (label);
+          g_object_set_data (G_OBJECT (item), "snooze-time",
+                             GINT_TO_POINTER (snooze_presets[i]));
+        }
+      else
+        item = view->menu_snooze_custom = gtk_menu_item_new_with_label ("");
+      g_signal_connect (G_OBJECT (item), "activate",
+                        G_CALLBACK (snooze_selected), alrm);
+      gtk_widget_show (item);
+      gtk_menu_shell_append (GTK_MENU_SHELL (submenu), item);
+    }
+  gtk_menu_item_set_submenu (GTK_MENU_ITEM (view->menu_snooze), submenu);
+
+  view->menu_stop = gtk_menu_item_new_with_label (_("Stop timer"));
+  g_signal_connect (G_OBJECT (view->menu_stop), "activate",
+                    G_CALLBACK (start_stop_callback), alrm);
+
+  menu_items (alrm, items);
+  for (i = 0; i < MENU_ITEMS_PER_ALARM; i++)
+    {
+      gtk_widget_show (items[i]);
+      gtk_menu_shell_insert (GTK_MENU_SHELL (pd->menu), items[i],
+                             index * MENU_ITEMS_PER_ALARM + i);
+    }
+
+  menu_update_alarm (pd, alrm);
+}
+
+
+
+/* Destroys the menu items of an alarm */
+static void
+menu_remove_alarm (plugin_data *pd, alarm_t *alrm)
 {
-	  GList *listitem = (GList *) list;
-	  plugin_data *pd;
-	  alarm_t *alrm;
+  alarm_view *view = ALARM_VIEW (alrm);
+  GtkWidget *items[MENU_ITEMS_PER_ALARM];
+  guint i;
 
-	  alrm = (alarm_t *) listitem->data;
-	  pd = (plugin_data *) alrm->pd;
+  if (view->menu_item == NULL)
+    return;
 
-  /* If counting down, we stop the timer and free the resources */
-  if (alrm->timer_on)
-    {
+  menu_items (alrm, items);
+  for (i = 0; i < MENU_ITEMS_PER_ALARM; i++)
+    gtk_widget_destroy (items[i]);
 
-	  if(alrm->timer)
-		 g_timer_destroy(alrm->timer);
-	  if(alrm->timeout)
-		 g_source_remove(alrm->timeout);
+  view->menu_sep = view->menu_item = NULL;
+  view->menu_pause = view->menu_snooze = view->menu_stop = NULL;
+  view->menu_snooze_custom = NULL;
+}
 
-	    alrm->timer = NULL;
-	    alrm->timeout = 0;
-	    alrm->is_paused = FALSE;
-	    alrm->timer_on = FALSE;
 
-      /* Disable tooltips, reset pbar */
-      gtk_widget_set_tooltip_text (GTK_WIDGET (pd->base), "");
-      gtk_progress_bar_set_fraction (GTK_PROGRESS_BAR (pd->pbar), 0);
 
-      return;
+/* Moves the menu items of an alarm to position index */
+static void
+menu_move_alarm (plugin_data *pd, alarm_t *alrm, guint index)
+{
+  alarm_view *view = ALARM_VIEW (alrm);
+  GtkWidget *items[MENU_ITEMS_PER_ALARM];
+  guint i;
 
-    }
+  if (pd->menu == NULL || view->menu_item == NULL)
+    return;
 
-  /* If we're here then the timer is off, so we start it */
-  start_timer (pd, alrm);
+  menu_items (alrm, items);
+  for (i = 0; i < MENU_ITEMS_PER_ALARM; i++)
+    gtk_menu_reorder_child (GTK_MENU (pd->menu), items[i],
+                            index * MENU_ITEMS_PER_ALARM + i);
+
+  menu_update_alarm (pd, alrm);
 }
 
 
 
+/**
+ * Builds the menu the first time it is needed. From then on it
+ * is kept and only patched when alarms change, so showing it
+ * does not depend on the number of alarms. A menu taller than
+ * the screen scrolls by itself.
+ **/
 static void
-pause_resume_selected (GtkWidget* menuitem, gpointer data)
+menu_build (plugin_data *pd)
 {
-  alarm_t *alrm;
-  alrm = (alarm_t *) data;
+  gint64 start = TIMER_STATS_CLOCK ();
+  guint i;
 
-  /* If paused, we resume */
-  if (alrm->is_paused)
-    {
-      g_timer_continue (alrm->timer);
-      /* If we're here then the timer is runnig, so we pause */
-      alrm->is_paused = FALSE;
-    }
-  else
-    {
-	  alrm->is_paused = TRUE;
-      g_timer_stop (alrm->timer);
-    }
+  pd->menu = gtk_menu_new ();
+  g_signal_connect (G_OBJECT (pd->menu), "deactivate",
+                    G_CALLBACK (menu_deactivated), pd);
+
+  for (i = 0; i < timer_core_n_alarms (pd->core); i++)
+    menu_add_alarm (pd, timer_core_get (pd->core, i), i);
+
+  TIMER_STATS_RECORD_SINCE (TIMER_STAT_MENU_US, start);
 }
 
 
@@ -438,106 +1194,23 @@ pbar_clicked (GtkWidget *pbar, GdkEventButton *event, gpointer data)
 {
   plugin_data *pd = (plugin_data *) data;
 
-  make_menu (pd);
-
   if (!pd->menu)
-    return;
+    menu_build (pd);
 
   if (event->button == 1)
-    gtk_menu_popup_at_widget (GTK_MENU (pd->menu), pd->pbar,
-                              GDK_GRAVITY_SOUTH_WEST, GDK_GRAVITY_NORTH_WEST,
-                              NULL);
+    {
+      gtk_menu_popup_at_widget (GTK_MENU (pd->menu), pd->pbar,
+                                GDK_GRAVITY_SOUTH_WEST, GDK_GRAVITY_NORTH_WEST,
+                                NULL);
+      pd->menu_open = TRUE;
+      active_timers_changed (pd);
+    }
   else
     gtk_menu_popdown (GTK_MENU (pd->menu));
 }
 
 
 
-/* This function generates the popup menu */
-void
-make_menu (plugin_data *pd)
-{
-  GList *list = NULL;
-  alarm_t *alrm;
-  GtkWidget *menuitem;
-  gchar *itemtext;
-
-  /* Destroy the existing one */
-  if (pd->menu)
-    gtk_widget_destroy (pd->menu);
-
-  pd->menu = gtk_menu_new ();
-
-  list = pd->alarm_list;
-
-  while (list)
-    {
-      /* Run through the list, read name and timer period info */
-
-      alrm = (alarm_t *) list->data;
-
-      itemtext = g_strdup_printf ("%s (%s)", alrm->name, alrm->info);
-
-      /* The selected timer is always active */
-      if(alrm->timer_on){
-		menuitem=gtk_menu_item_new_with_label(itemtext);
-		gtk_menu_shell_append(GTK_MENU_SHELL(pd->menu),menuitem);
-		gtk_widget_set_sensitive(GTK_WIDGET(menuitem),FALSE);
-
-		gtk_check_menu_item_set_active(GTK_CHECK_MENU_ITEM(menuitem),TRUE);
-
-		/* Pause menu item */
-		if(!alrm->is_paused && alrm->is_countdown) {
-			menuitem=gtk_menu_item_new_with_label(_("Pause timer"));
-
-			gtk_menu_shell_append   (GTK_MENU_SHELL(pd->menu),menuitem);
-			g_signal_connect    (G_OBJECT(menuitem),"activate",
-					G_CALLBACK(pause_resume_selected),alrm);
-		}
-		/* If the alarm is paused, the only option is to resume or stop */
-		else if (alrm->is_paused) {
-			menuitem=gtk_menu_item_new_with_label(_("Resume timer"));
-
-			gtk_menu_shell_append (GTK_MENU_SHELL(pd->menu),menuitem);
-			g_signal_connect  (G_OBJECT(menuitem),"activate",
-					G_CALLBACK(pause_resume_selected),alrm);
-			gtk_widget_show(menuitem);
-
-			gtk_widget_show(menuitem);
-			gtk_widget_show(pd->menu);
-		}
-
-		menuitem=gtk_menu_item_new_with_label(_("Stop timer"));
-
-		gtk_menu_shell_append (GTK_MENU_SHELL(pd->menu),menuitem);
-		g_signal_connect  (G_OBJECT(menuitem),"activate",
-				G_CALLBACK(start_stop_callback),list);
-
-
-	}else{
-		menuitem=gtk_menu_item_new_with_label(itemtext);
-		gtk_menu_shell_append(GTK_MENU_SHELL(pd->menu),menuitem);
-		g_signal_connect  (G_OBJECT(menuitem),"activate",
-				G_CALLBACK (timer_selected), list);
-		/* disable alarm menu entry if repeating command */
-		if(alrm->is_repeating)
-		  gtk_widget_set_sensitive(GTK_WIDGET(menuitem),FALSE);
-	}
-
-    g_free (itemtext);
-    list = list->next;
-    if(list){
-	  /* Horizontal line (empty item) */
-	  menuitem=gtk_separator_menu_item_new();
-	  gtk_menu_shell_append(GTK_MENU_SHELL(pd->menu),menuitem);
-	}
-  }
-
-  gtk_widget_show_all (pd->menu);
-}
-
-
-
 /* Callback to the OK button in the Add window */
 static void
 ok_add (GtkButton *button, gpointer data)
@@ -546,33 +1219,26 @@ ok_add (GtkButton *button, gpointer data)
   alarm_t *newalarm;
   GtkTreeIter iter;
   gint t1, t2, t3, t;
-  gchar *timeinfo = NULL;
+  gchar *timeinfo;
 
   /* Add item to the alarm list and liststore */
-  newalarm = g_new0 (alarm_t, 1);
-  newalarm->name = g_strdup (gtk_entry_get_text (GTK_ENTRY (adata->name)));
-  newalarm->command = g_strdup (
-      gtk_entry_get_text (GTK_ENTRY (adata->command)));
+  newalarm = alarm_new (adata->pd);
+  timer_core_set_name (adata->pd->core, newalarm,
+                       gtk_entry_get_text (GTK_ENTRY (adata->name)));
+  timer_core_set_command (adata->pd->core, newalarm,
+                          gtk_entry_get_text (GTK_ENTRY (adata->command)));
   newalarm->is_countdown = gtk_toggle_button_get_active (
       GTK_TOGGLE_BUTTON (adata->rb1));
-  newalarm->pd = (gpointer) adata->pd;
-  newalarm->timer_on = FALSE;
-  newalarm->timeout = 0;
-  newalarm->timer = NULL;
-  newalarm->is_paused = FALSE;
-  newalarm->rem_repetitions = 1;
-  newalarm->is_repeating = FALSE;
-  newalarm->repeat_timeout = 0;
-
-  adata->pd->alarm_list = g_list_append (adata->pd->alarm_list, newalarm);
-  if (g_list_length (adata->pd->alarm_list) == 1)
-    adata->pd->selected = adata->pd->alarm_list;
+
+  if (timer_core_n_alarms (adata->pd->core) == 1)
+    adata->pd->selected = newalarm;
 
   gtk_list_store_append (adata->pd->liststore, &iter);
 
   gtk_list_store_set (GTK_LIST_STORE (adata->pd->liststore), &iter, 0,
-                      g_list_last (adata->pd->alarm_list), 1, newalarm->name, 3,
-                      newalarm->command, -1);
+                      newalarm->id, 1, newalarm->name, 3,
+                      newalarm->command, 4, COMMAND_ICON (newalarm), 5,
+                      newalarm->command_error, -1);
 
   /* Item count goes up by one */
   adata->pd->count = adata->pd->count + 1;
@@ -585,13 +1251,6 @@ ok_add (GtkButton *button, gpointer data)
       t2 = gtk_spin_button_get_value_as_int (GTK_SPIN_BUTTON (adata->timem));
       t3 = gtk_spin_button_get_value_as_int (GTK_SPIN_BUTTON (adata->times));
       t = t1 * 3600 + t2 * 60 + t3;
-
-      if (t1 > 0)
-        timeinfo = g_strdup_printf (_("%dh %dm %ds"), t1, t2, t3);
-      else if (t2 > 0)
-        timeinfo = g_strdup_printf (_("%dm %ds"), t2, t3);
-      else
-        timeinfo = g_strdup_printf (_("%ds"), t3);
     }
   else
     {
@@ -599,13 +1258,16 @@ ok_add (GtkButton *button, gpointer data)
       t1 = gtk_spin_button_get_value_as_int (GTK_SPIN_BUTTON (adata->time_h));
       t2 = gtk_spin_button_get_value_as_int (GTK_SPIN_BUTTON (adata->time_m));
       t = t1 * 60 + t2;
-      timeinfo = g_strdup_printf (_("At %02d:%02d"), t1, t2);
     }
 
   newalarm->time = t;
+  timeinfo = alarm_time_info (newalarm->is_countdown, t);
   newalarm->info = timeinfo;
   gtk_list_store_set (GTK_LIST_STORE (adata->pd->liststore), &iter, 2, timeinfo,
                       -1);
+  menu_add_alarm (adata->pd, newalarm,
+                  timer_core_n_alarms (adata->pd->core) - 1);
+  adata->pd->settings_dirty = TRUE;
 
   /* Free resources */
   gtk_widget_destroy (GTK_WIDGET (adata->dialog));
@@ -622,24 +1284,18 @@ ok_edit (GtkButton *button, gpointer data)
   alarm_data *adata = (alarm_data *) data;
   GtkTreeIter iter;
   gint t1, t2, t3, t;
-  gchar *timeinfo = NULL;
-  GList *list;
+  gchar *timeinfo;
   alarm_t *alrm;
-  GtkTreeSelection *select;
-  GtkTreeModel *model;
 
-  select = gtk_tree_view_get_selection (GTK_TREE_VIEW (adata->pd->tree));
+  alrm = get_selected_alarm (adata->pd, &iter, NULL);
 
-  if (gtk_tree_selection_get_selected (select, &model, &iter))
+  if (alrm)
     {
 
-      gtk_tree_model_get (GTK_TREE_MODEL (adata->pd->liststore), &iter, 0,
-                          &list, -1);
-      alrm = (alarm_t *) list->data;
-
-      alrm->name = g_strdup (gtk_entry_get_text (GTK_ENTRY (adata->name)));
-      alrm->command = g_strdup (
-          gtk_entry_get_text (GTK_ENTRY (adata->command)));
+      timer_core_set_name (adata->pd->core, alrm,
+                           gtk_entry_get_text (GTK_ENTRY (adata->name)));
+      timer_core_set_command (adata->pd->core, alrm,
+                              gtk_entry_get_text (GTK_ENTRY (adata->command)));
       alrm->is_countdown = gtk_toggle_button_get_active (
           GTK_TOGGLE_BUTTON (adata->rb1));
       alrm->is_recurring = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(adata->
@@ -648,11 +1304,12 @@ ok_edit (GtkButton *button, gpointer data)
                                  autostart_cb));
 
 
-      /* This should be unnecessary, but do it anyway */
-      alrm->pd = (gpointer) adata->pd;
+      /* The tooltip line shows the name */
+      ALARM_VIEW (alrm)->tip_remaining = -1;
 
       gtk_list_store_set (GTK_LIST_STORE (adata->pd->liststore), &iter, 1,
-                          alrm->name, 3, alrm->command, -1);
+                          alrm->name, 3, alrm->command, 4,
+                          COMMAND_ICON (alrm), 5, alrm->command_error, -1);
 
       if (gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (adata->rb1)))
         {
@@ -664,13 +1321,6 @@ ok_edit (GtkButton *button, gpointer data)
           t3 = gtk_spin_button_get_value_as_int (
               GTK_SPIN_BUTTON (adata->times));
           t = t1 * 3600 + t2 * 60 + t3;
-
-          if (t1 > 0)
-            timeinfo = g_strdup_printf (_("%dh %dm %ds"), t1, t2, t3);
-          else if (t2 > 0)
-            timeinfo = g_strdup_printf (_("%dm %ds"), t2, t3);
-          else
-            timeinfo = g_strdup_printf (_("%ds"), t3);
         }
       else
         {
@@ -679,13 +1329,16 @@ ok_edit (GtkButton *button, gpointer data)
           t2 = gtk_spin_button_get_value_as_int (
               GTK_SPIN_BUTTON (adata->time_m));
           t = t1 * 60 + t2;
-          timeinfo = g_strdup_printf (_("At %02d:%02d"), t1, t2);
         }
 
       alrm->time = t;
+      timeinfo = alarm_time_info (alrm->is_countdown, t);
+      timer_core_string_free (adata->pd->core, alrm->info);
       alrm->info = timeinfo;
       gtk_list_store_set (GTK_LIST_STORE (adata->pd->liststore), &iter, 2,
                           timeinfo, -1);
+      menu_update_alarm (adata->pd, alrm);
+      adata->pd->settings_dirty = TRUE;
     }
 
   gtk_widget_destroy (GTK_WIDGET (adata->dialog));
@@ -754,9 +1407,6 @@ add_edit_clicked (GtkButton *buttonn, gpointer data)
   alarm_data *adata = g_new0 (alarm_data, 1);
   gint time;
   GtkTreeIter iter;
-  GtkTreeSelection *select;
-  GtkTreeModel *model;
-  GList *list;
   alarm_t *alrm;
 
   parent_window = (GtkWindow *) gtk_widget_get_toplevel (GTK_WIDGET (buttonn));
@@ -915,14 +1565,11 @@ add_edit_clicked (GtkButton *buttonn, gpointer data)
     }
 
   /* Else fill the values in the boxes with the current choices */
-  select = gtk_tree_view_get_selection (GTK_TREE_VIEW (pd->tree));
+  alrm = get_selected_alarm (pd, &iter, NULL);
 
-  if (gtk_tree_selection_get_selected (select, &model, &iter))
+  if (alrm)
     {
 
-      gtk_tree_model_get (model, &iter, 0, &list, -1);
-      alrm = (alarm_t *) list->data;
-
       gtk_entry_set_text (GTK_ENTRY (name), alrm->name);
       gtk_entry_set_text (GTK_ENTRY (command), alrm->command);
 
@@ -955,37 +1602,66 @@ add_edit_clicked (GtkButton *buttonn, gpointer data)
 
 
 
+/* Removes the alarm at index from the core, the menu and the tooltip */
+static void
+remove_alarm (plugin_data *pd, alarm_t *alrm, guint index)
+{
+  if (pd->selected == alrm)
+    pd->selected = NULL;
+
+  /* The core stops it, so a removed alarm does not fire anymore */
+  menu_remove_alarm (pd, alrm);
+  alarm_queue_remove (pd, alrm);
+  alarm_view_free (alrm);
+  pd->tooltip_dirty = TRUE;
+  timer_core_remove (pd->core, index);
+  pd->settings_dirty = TRUE;
+
+  if (pd->selected == NULL && timer_core_n_alarms (pd->core) > 0)
+    pd->selected = timer_core_get (pd->core, 0);
+
+  /* The new first alarm loses its separator */
+  if (index == 0 && timer_core_n_alarms (pd->core) > 0)
+    menu_update_alarm (pd, timer_core_get (pd->core, 0));
+}
+
+
+
 /* Calllback for the remove button in the options */
 static void
 remove_clicked (GtkButton *button, gpointer data)
 {
   plugin_data *pd = (plugin_data *) data;
   GtkTreeIter iter;
-  GtkTreeModel *model;
-  GtkTreeSelection *select;
-  GList *list;
+  alarm_t *alrm;
+  guint index;
 
   /* Get the selected row */
-  select = gtk_tree_view_get_selection (GTK_TREE_VIEW (pd->tree));
+  alrm = get_selected_alarm (pd, &iter, &index);
 
-  if (!select)
+  if (!alrm)
     return;
 
-  if (!gtk_tree_selection_get_selected (select, &model, &iter))
-    return;
+  remove_alarm (pd, alrm, index);
 
-  gtk_tree_model_get (model, &iter, 0, &list, -1);
+  /* iter now points at the next row, which takes over the selection */
+  if (gtk_list_store_remove (pd->liststore, &iter))
+    gtk_tree_selection_select_iter (
+        gtk_tree_view_get_selection (GTK_TREE_VIEW (pd->tree)), &iter);
+}
 
-  if (pd->selected == list)
-    {
-      pd->alarm_list = g_list_delete_link (pd->alarm_list, list);
-      pd->selected = pd->alarm_list;
-    }
-  else
-    {
-      pd->alarm_list = g_list_delete_link (pd->alarm_list, list);
-    }
-  fill_liststore (pd, NULL);
+
+
+/* Keeps a moved row in view */
+static void
+liststore_scroll_to (plugin_data *pd, GtkTreeIter *iter)
+{
+  GtkTreePath *path;
+
+  path = gtk_tree_model_get_path (GTK_TREE_MODEL (pd->liststore), iter);
+  gtk_tree_view_scroll_to_cell (GTK_TREE_VIEW (pd->tree), path, NULL, FALSE,
+                                0, 0);
+  gtk_tree_path_free (path);
 }
 
 
@@ -995,41 +1671,31 @@ static void
 up_clicked (GtkButton *button, gpointer data)
 {
   plugin_data *pd = (plugin_data *) data;
-  GtkTreeIter iter;
-  GtkTreeModel *model;
-  GtkTreeSelection *select;
-  GList *list, *list_prev;
-
-  /* Get the selected row */
-  select = gtk_tree_view_get_selection (GTK_TREE_VIEW (pd->tree));
+  GtkTreeIter iter, other;
+  alarm_t *alrm;
+  guint index;
 
-  if (!select)
-    return;
+  /* This is the item to be moved up */
+  alrm = get_selected_alarm (pd, &iter, &index);
 
-  if (!gtk_tree_selection_get_selected (select, &model, &iter))
+  if (!alrm)
     return;
 
-  /* This is the item to be moved up */
-  gtk_tree_model_get (model, &iter, 0, &list, -1);
-
   /* First item can't be moved up */
-  if (g_list_position (pd->alarm_list, list) <= 0)
+  if (index == 0)
     return;
 
   /* swap places */
-  list_prev = list->prev;
-  if (list_prev->prev)
-    list_prev->prev->next = list;
-  if (list->next)
-    list->next->prev = list_prev;
-  list_prev->next = list->next;
-  list->prev = list_prev->prev;
-  list->next = list_prev;
-  list_prev->prev = list;
-
-  pd->alarm_list = g_list_first (list);
-
-  fill_liststore (pd, list);
+  timer_core_swap (pd->core, index, index - 1);
+  pd->settings_dirty = TRUE;
+  menu_move_alarm (pd, alrm, index - 1);
+  menu_move_alarm (pd, timer_core_get (pd->core, index), index);
+
+  /* The selection moves along with the row */
+  other = iter;
+  gtk_tree_model_iter_previous (GTK_TREE_MODEL (pd->liststore), &other);
+  gtk_list_store_swap (pd->liststore, &iter, &other);
+  liststore_scroll_to (pd, &iter);
 }
 
 
@@ -1039,41 +1705,153 @@ static void
 down_clicked (GtkButton *button, gpointer data)
 {
   plugin_data *pd = (plugin_data *) data;
-  GtkTreeIter iter;
-  GtkTreeSelection *select;
-  GtkTreeModel *model;
-  GList *list, *list_next;
-
-  /* Get the selected row */
-  select = gtk_tree_view_get_selection (GTK_TREE_VIEW (pd->tree));
+  GtkTreeIter iter, other;
+  alarm_t *alrm;
+  guint index;
 
-  if (!select)
-    return;
+  /* This is the item to be moved down */
+  alrm = get_selected_alarm (pd, &iter, &index);
 
-  if (!gtk_tree_selection_get_selected (select, &model, &iter))
+  if (!alrm)
     return;
 
-  /* This is the item to be moved down */
-  gtk_tree_model_get (model, &iter, 0, &list, -1);
-
   /* Last item can't go down) */
-  if (list == g_list_last (pd->alarm_list))
+  if (index + 1 >= timer_core_n_alarms (pd->core))
     return;
 
   /* swap places */
-  list_next = list->next;
-  if (list_next->next)
-    list_next->next->prev = list;
-  if (list->prev)
-    list->prev->next = list_next;
-  list_next->prev = list->prev;
-  list->next = list_next->next;
-  list_next->next = list;
-  list->prev = list_next;
+  timer_core_swap (pd->core, index, index + 1);
+  pd->settings_dirty = TRUE;
+  menu_move_alarm (pd, timer_core_get (pd->core, index), index);
+  menu_move_alarm (pd, alrm, index + 1);
+
+  /* The selection moves along with the row */
+  other = iter;
+  gtk_tree_model_iter_next (GTK_TREE_MODEL (pd->liststore), &other);
+  gtk_list_store_swap (pd->liststore, &iter, &other);
+  liststore_scroll_to (pd, &iter);
+}
+
+
+
+/**
+ * Appends all the alarms of a CSV or JSON file. The file is checked
+ * as a whole first, so on error nothing is added. The rows go into
+ * the liststore while the treeview is detached from it, so that it
+ * is only refreshed once.
+ **/
+static gboolean
+import_alarms (plugin_data *pd, const gchar *path, GError **error)
+{
+  TimerImport *import;
+  const TimerConfigAlarm *entry;
+  alarm_t *alrm;
+  guint i, n, first;
+
+  import = timer_import_read (path, error);
+  if (import == NULL)
+    return FALSE;
+
+  n = timer_import_n_alarms (import);
+  first = timer_core_n_alarms (pd->core);
+
+  if (pd->tree)
+    gtk_tree_view_set_model (GTK_TREE_VIEW (pd->tree), NULL);
+
+  for (i = 0; i < n; i++)
+    {
+      entry = timer_import_get (import, i);
+
+      alrm = alarm_new (pd);
+      timer_core_set_name (pd->core, alrm, entry->name);
+      timer_core_set_command (pd->core, alrm,
+                              entry->command ? entry->command : "");
+      alrm->is_countdown = entry->is_countdown;
+      alrm->is_recurring = entry->is_recurring;
+      alrm->is_auto_start = entry->is_auto_start;
+      alrm->time = entry->time;
+      alrm->info = alarm_time_info (alrm->is_countdown, alrm->time);
+
+      gtk_list_store_insert_with_values (pd->liststore, NULL, -1, 0, alrm->id,
+                                         1, alrm->name, 2, alrm->info, 3,
+                                         alrm->command, 4,
+                                         COMMAND_ICON (alrm), 5,
+                                         alrm->command_error, -1);
+      menu_add_alarm (pd, alrm, first + i);
+    }
+
+  if (pd->tree)
+    gtk_tree_view_set_model (GTK_TREE_VIEW (pd->tree),
+                             GTK_TREE_MODEL (pd->liststore));
+
+  timer_import_free (import);
+
+  pd->count = timer_core_n_alarms (pd->core);
+  if (pd->selected == NULL && n > 0)
+    pd->selected = timer_core_get (pd->core, first);
+  if (n > 0)
+    pd->settings_dirty = TRUE;
+
+  /* Auto-start alarms would be running had they been loaded */
+  timer_core_freeze (pd->core);
+  for (i = first; i < timer_core_n_alarms (pd->core); i++)
+    {
+      alrm = timer_core_get (pd->core, i);
+      if (alrm->is_auto_start)
+        timer_core_start (pd->core, alrm);
+    }
+  timer_core_thaw (pd->core);
+
+  g_debug ("Imported %u alarms from %s", n, path);
+
+  return TRUE;
+}
+
+
+
+/* Callback for the import button in the options */
+static void
+import_clicked (GtkButton *button, gpointer data)
+{
+  plugin_data *pd = (plugin_data *) data;
+  GtkWidget *chooser, *dialog;
+  GtkFileFilter *filter;
+  GError *error = NULL;
+  gchar *path;
+
+  chooser = gtk_file_chooser_dialog_new (
+      _("Import alarms"),
+      GTK_WINDOW (gtk_widget_get_toplevel (GTK_WIDGET (button))),
+      GTK_FILE_CHOOSER_ACTION_OPEN, _("Cancel"), GTK_RESPONSE_CANCEL,
+      _("Import"), GTK_RESPONSE_ACCEPT, NULL);
+
+  filter = gtk_file_filter_new ();
+  gtk_file_filter_set_name (filter, _("CSV or JSON files"));
+  gtk_file_filter_add_pattern (filter, "*.csv");
+  gtk_file_filter_add_pattern (filter, "*.json");
+  gtk_file_chooser_add_filter (GTK_FILE_CHOOSER (chooser), filter);
+
+  if (gtk_dialog_run (GTK_DIALOG (chooser)) == GTK_RESPONSE_ACCEPT)
+    {
+      path = gtk_file_chooser_get_filename (GTK_FILE_CHOOSER (chooser));
 
-  pd->alarm_list = g_list_first (list_next);
+      if (!import_alarms (pd, path, &error))
+        {
+          dialog = gtk_message_dialog_new (GTK_WINDOW (chooser),
+                                           GTK_DIALOG_MODAL,
+                                           GTK_MESSAGE_ERROR, GTK_BUTTONS_CLOSE,
+                                           _("Could not import %s"), path);
+          gtk_message_dialog_format_secondary_text (
+              GTK_MESSAGE_DIALOG (dialog), "%s", error->message);
+          gtk_dialog_run (GTK_DIALOG (dialog));
+          gtk_widget_destroy (dialog);
+          g_error_free (error);
+        }
+
+      g_free (path);
+    }
 
-  fill_liststore (pd, list);
+  gtk_widget_destroy (chooser);
 }
 
 
@@ -1138,279 +1916,602 @@ size_changed (XfcePanelPlugin *plugin, gint size, plugin_data *pd)
 
 
 /**
- * Loads the settings and alarm list from a keyfile, saves the
- * alarm list in the linked list pd->alarm_list 
+ * Loads the settings and alarm list from the binary snapshot next
+ * to the rc file. Returns FALSE if there is no usable snapshot.
+ * Its string block is copied once and handed over to the core,
+ * and the alarm strings point into it instead of being copied.
  **/
-static void
-load_settings (plugin_data *pd)
+static gboolean
+load_snapshot (plugin_data *pd, const gchar *rc_path)
 {
-  gchar groupname[8];
-  const gchar *timerstring;
-  gint groupnum, time;
-  gboolean is_cd, is_recur, autostart;
+  TimerSnapshot *snapshot;
+  TimerSnapshotAlarm entry;
+  TimerSnapshotOptions options;
   alarm_t *alrm;
-  XfceRc *rc;
-  gchar* rc_path;
+  gchar *path, *strings;
+  gsize len;
+  guint i, n;
+
+  path = g_strconcat (rc_path, TIMER_SNAPSHOT_SUFFIX, NULL);
+  snapshot = timer_snapshot_open (path, rc_path);
+  g_free (path);
 
-  if (rc_path = xfce_panel_plugin_lookup_rc_file (pd->base))
+  if (snapshot == NULL)
+    return FALSE;
+
+  strings = timer_snapshot_take_strings (snapshot, &len);
+  timer_core_adopt_buffer (pd->core, strings, len);
+
+  n = timer_snapshot_n_alarms (snapshot);
+  for (i = 0; i < n; i++)
     {
-      rc = xfce_rc_simple_open (rc_path, TRUE);
+      timer_snapshot_get_alarm (snapshot, i, &entry);
+
+      alrm = alarm_new (pd);
+
+      alrm->name = (gchar *) entry.name;
+      alrm->info = (gchar *) entry.info;
+      timer_core_take_command (pd->core, alrm, (gchar *) entry.command);
+      alrm->is_countdown = (entry.flags & TIMER_SNAPSHOT_COUNTDOWN) != 0;
+      alrm->is_recurring = (entry.flags & TIMER_SNAPSHOT_RECURRING) != 0;
+      alrm->is_auto_start = (entry.flags & TIMER_SNAPSHOT_AUTOSTART) != 0;
+      alrm->time = entry.time;
+    }
+
+  pd->count = n;
+
+  timer_snapshot_get_options (snapshot, &options);
+  pd->nowin_if_alarm = options.nowin_if_alarm;
+  pd->use_global_command = options.use_global_command;
+  set_global_command (pd, options.global_command);
+  pd->repeat_alarm_command = options.repeat_alarm_command;
+  pd->repetitions = options.repetitions;
+  pd->repeat_interval = options.repeat_interval;
+  pd->coalesce_window = MAX (options.coalesce_window, 0);
+  pd->snooze_time = options.snooze_time > 0 ? options.snooze_time
+                                            : SNOOZE_TIME_DEFAULT;
+  pd->skip_missed = options.skip_missed;
+  pd->use_notifications = options.use_notifications;
+  pd->use_snapshot = TRUE;
+  command_options_changed (pd);
+
+  timer_snapshot_close (snapshot);
+
+  return TRUE;
+}
 
-      if (rc != NULL)
-        {
-          groupnum = 0;
-          g_sprintf (groupname, "G0");
 
-          while (xfce_rc_has_group (rc, groupname))
-            {
-              xfce_rc_set_group (rc, groupname);
 
-              alrm = g_new0 (alarm_t, 1);
-              pd->alarm_list = g_list_append (pd->alarm_list, alrm);
+/* Adds an alarm read from the rc file, keeping its strings where they are */
+static void
+load_alarm (const TimerConfigAlarm *entry, gpointer data)
+{
+  plugin_data *pd = (plugin_data *) data;
+  alarm_t *alrm;
+
+  alrm = alarm_new (pd);
 
-              timerstring = (gchar *) xfce_rc_read_entry (rc, "timername",
-                                                          "No name");
-              alrm->name = g_strdup (timerstring);
+  alrm->name = entry->name ? entry->name : g_strdup ("No name");
+  alrm->info = entry->info ? entry->info : g_strdup ("");
+  if (entry->command)
+    timer_core_take_command (pd->core, alrm, entry->command);
+  else
+    timer_core_set_command (pd->core, alrm, "");
+  alrm->is_countdown = entry->is_countdown;
+  alrm->is_recurring = entry->is_recurring;
+  alrm->is_auto_start = entry->is_auto_start;
+  alrm->time = entry->time;
+}
 
-              timerstring = (gchar *) xfce_rc_read_entry (rc, "timercommand",
-                                                          "");
-              alrm->command = g_strdup (timerstring);
 
-              timerstring = (gchar *) xfce_rc_read_entry (rc, "timerinfo", "");
-              alrm->info = g_strdup (timerstring);
 
-              is_cd = xfce_rc_read_bool_entry (rc, "is_countdown", TRUE);
-              alrm->is_countdown = is_cd;
+/**
+ * Loads the settings and alarm list from a keyfile, adds the
+ * alarms to the core.
+ * The file is handed over to the core and parsed in place, so
+ * the alarm strings can point into it instead of being copied.
+ **/
+static void
+load_settings (plugin_data *pd)
+{
+  TimerConfigOptions options;
+  gchar *rc_path, *buffer;
+  gsize len;
 
-              is_recur=xfce_rc_read_bool_entry(rc,"is_recur",FALSE);
-			  alrm->is_recurring = is_recur;
+  if (!(rc_path = xfce_panel_plugin_lookup_rc_file (pd->base)))
+    return;
 
-			  autostart=xfce_rc_read_bool_entry(rc,"autostart",FALSE);
-			  alrm->is_auto_start = autostart;
+  if (load_snapshot (pd, rc_path)
+      || !g_file_get_contents (rc_path, &buffer, &len, NULL))
+    {
+      update_pbar_orientation (pd->base, pd);
+      g_free (rc_path);
+      return;
+    }
 
-              time = xfce_rc_read_int_entry (rc, "time", 0);
-              alrm->time = time;
+  options.nowin_if_alarm = pd->nowin_if_alarm;
+  options.use_global_command = pd->use_global_command;
+  options.global_command = NULL;
+  options.repeat_alarm_command = pd->repeat_alarm_command;
+  options.repetitions = pd->repetitions;
+  options.repeat_interval = pd->repeat_interval;
+  options.coalesce_window = pd->coalesce_window;
+  options.snooze_time = pd->snooze_time;
+  options.use_snapshot = pd->use_snapshot;
+  options.skip_missed = pd->skip_missed;
+  options.use_notifications = pd->use_notifications;
+
+  timer_core_adopt_buffer (pd->core, buffer, len);
+  timer_config_parse (buffer, &options, load_alarm, pd);
+
+  pd->count = timer_core_n_alarms (pd->core);
+  pd->nowin_if_alarm = options.nowin_if_alarm;
+  pd->use_global_command = options.use_global_command;
+  if (options.global_command)
+    set_global_command (pd, options.global_command);
+  pd->repeat_alarm_command = options.repeat_alarm_command;
+  pd->repetitions = options.repetitions;
+  pd->repeat_interval = options.repeat_interval;
+  pd->coalesce_window = MAX (options.coalesce_window, 0);
+  pd->snooze_time = options.snooze_time > 0 ? options.snooze_time
+                                            : SNOOZE_TIME_DEFAULT;
+  pd->use_snapshot = options.use_snapshot;
+  pd->skip_missed = options.skip_missed;
+  pd->use_notifications = options.use_notifications;
+  command_options_changed (pd);
 
-              /* Include a link to the whole data */
-              alrm->pd = (gpointer) pd;
+  update_pbar_orientation (pd->base, pd);
 
-              groupnum++;
-              g_snprintf (groupname, 5, "G%d", groupnum);
+  g_free (rc_path);
+}
 
-            } /* end of while loop */
 
-          pd->count = groupnum;
 
-          /* Read other options */
-          if (xfce_rc_has_group (rc, "others"))
-            {
-              xfce_rc_set_group (rc, "others");
-              pd->nowin_if_alarm = xfce_rc_read_bool_entry (rc,
-                                                            "nowin_if_alarm",
-                                                            FALSE);
-              pd->use_global_command = xfce_rc_read_bool_entry (
-                  rc, "use_global_command", FALSE);
+/**
+ * Writes the binary snapshot for the rc file just saved,
+ * or removes it if it was turned off.
+ **/
+static void
+save_snapshot (plugin_data *pd, const gchar *rc_path)
+{
+  TimerSnapshotAlarm *entries;
+  TimerSnapshotOptions options;
+  GError *error = NULL;
+  alarm_t *alrm;
+  gchar *path;
+  guint i, n;
 
-              if (pd->global_command)
-                g_free (pd->global_command);
-              pd->global_command = g_strdup (
-                  (gchar *) xfce_rc_read_entry (rc, "global_command", ""));
+  path = g_strconcat (rc_path, TIMER_SNAPSHOT_SUFFIX, NULL);
 
-              pd->repeat_alarm_command = xfce_rc_read_bool_entry (rc, "repeat_alarm",
-                                                          FALSE);
-              pd->repetitions = xfce_rc_read_int_entry (rc, "repetitions", 1);
-              pd->repeat_interval = xfce_rc_read_int_entry (rc,
-                                                            "repeat_interval",
-                                                            10);
-            }
+  if (!pd->use_snapshot)
+    {
+      g_unlink (path);
+      g_free (path);
+      return;
+    }
 
-          update_pbar_orientation (pd->base, pd);
+  n = timer_core_n_alarms (pd->core);
+  entries = g_new (TimerSnapshotAlarm, MAX (n, 1));
+  for (i = 0; i < n; i++)
+    {
+      alrm = timer_core_get (pd->core, i);
+      entries[i].name = alrm->name;
+      entries[i].info = alrm->info;
+      entries[i].command = alrm->command;
+      entries[i].time = alrm->time;
+      entries[i].flags = (alrm->is_countdown ? TIMER_SNAPSHOT_COUNTDOWN : 0)
+                         | (alrm->is_recurring ? TIMER_SNAPSHOT_RECURRING : 0)
+                         | (alrm->is_auto_start ? TIMER_SNAPSHOT_AUTOSTART : 0);
+    }
 
-          xfce_rc_close (rc);
-        }
+  options.nowin_if_alarm = pd->nowin_if_alarm;
+  options.use_global_command = pd->use_global_command;
+  options.global_command = pd->global_command;
+  options.repeat_alarm_command = pd->repeat_alarm_command;
+  options.repetitions = pd->repetitions;
+  options.repeat_interval = pd->repeat_interval;
+  options.coalesce_window = pd->coalesce_window;
+  options.snooze_time = pd->snooze_time;
+  options.skip_missed = pd->skip_missed;
+  options.use_notifications = pd->use_notifications;
+
+  if (!timer_snapshot_write (path, rc_path, &options, entries, n, &error))
+    {
+      /* A stale snapshot would be ignored anyway, but don't leave it */
+      g_warning ("Could not write %s: %s", path, error->message);
+      g_error_free (error);
+      g_unlink (path);
     }
 
-  g_free (rc_path);
+  g_free (entries);
+  g_free (path);
 }
 
 
 
-/* Saves the list to a keyfile, backup a permanent copy */
+/**
+ * Saves the list to a keyfile, backup a permanent copy.
+ * Nothing is written unless a setting changed since the last save.
+ **/
 static void
 save_settings (XfcePanelPlugin *plugin, plugin_data *pd)
 {
-  gchar groupname[8];
-  gint row_count;
-  GList *list;
+  TimerConfigWriter *writer;
+  TimerConfigAlarm entry;
+  TimerConfigOptions options;
+  GError *error = NULL;
   alarm_t *alrm;
-  FILE *conffile;
-  XfceRc *rc;
   gchar *file;
+  guint i;
+
+  if (!pd->settings_dirty)
+    return;
 
   if (!(file = xfce_panel_plugin_save_location (plugin, TRUE)))
     return;
 
-  /**
-   * We do this to start a fresh config file, otherwise if the old config file
-   * is longer,   the tail will not get truncated
-   * See http://bugzilla.xfce.org/show_bug.cgi?id=2647
-   * for a related bug report
-   **/
-  conffile = fopen (file, "w");
-  if (conffile)
-    fclose (conffile);
+  writer = timer_config_writer_new ();
+  for (i = 0; i < timer_core_n_alarms (pd->core); i++)
+    {
+      alrm = timer_core_get (pd->core, i);
+
+      entry.name = alrm->name;
+      entry.info = alrm->info;
+      entry.command = alrm->command;
+      entry.time = alrm->time;
+      entry.is_countdown = alrm->is_countdown;
+      entry.is_recurring = alrm->is_recurring;
+      entry.is_auto_start = alrm->is_auto_start;
+      timer_config_writer_add_alarm (writer, &entry);
+    }
+
+  /* save the other options */
+  options.nowin_if_alarm = pd->nowin_if_alarm;
+  options.use_global_command = pd->use_global_command;
+  options.global_command = pd->global_command;
+  options.repeat_alarm_command = pd->repeat_alarm_command;
+  options.repetitions = pd->repetitions;
+  options.repeat_interval = pd->repeat_interval;
+  options.coalesce_window = pd->coalesce_window;
+  options.snooze_time = pd->snooze_time;
+  options.use_snapshot = pd->use_snapshot;
+  options.skip_missed = pd->skip_missed;
+  options.use_notifications = pd->use_notifications;
+
+  /* A crash midway never leaves a half-written config */
+  if (timer_config_writer_finish (writer, &options, file, &error))
+    {
+      pd->settings_dirty = FALSE;
+      save_snapshot (pd, file);
+    }
+  else
+    {
+      g_warning ("Could not save the settings: %s", error->message);
+      g_error_free (error);
+    }
+
+  g_free (file);
+}
 
-  rc = xfce_rc_simple_open (file, FALSE);
 
-  if (!rc)
-    return;
 
-  list = pd->alarm_list;
+/* Activates the Edit and Remove buttons when an item in the list is selected */
+static void
+tree_selected (GtkTreeSelection *select, gpointer data)
+{
+  plugin_data *pd = (plugin_data *) data;
+  gtk_widget_set_sensitive (pd->buttonedit, TRUE);
+  gtk_widget_set_sensitive (pd->buttonremove, TRUE);
+  gtk_widget_set_sensitive (pd->buttonup, TRUE);
+  gtk_widget_set_sensitive (pd->buttondown, TRUE);
+
+}
+
+
+
+static void
+plugin_free (XfcePanelPlugin *plugin, plugin_data *pd)
+{
+  guint i;
+
+  if (pd->dbus)
+    timer_dbus_free (pd->dbus);
+
+  /* Unless the alarms were never loaded, which would wipe the journal */
+  if (pd->load_idle == 0)
+    journal_flush (pd);
+  else if (pd->journal_idle != 0)
+    g_source_remove (pd->journal_idle);
+  g_free (pd->journal_path);
+
+  for (i = 0; i < timer_core_n_alarms (pd->core); i++)
+    alarm_view_free (timer_core_get (pd->core, i));
+  timer_core_free (pd->core);
+  if (pd->history)
+    timer_history_free (pd->history);
+
+  if (pd->load_idle != 0)
+    g_source_remove (pd->load_idle);
+  if (pd->update_timeout != 0)
+    g_source_remove (pd->update_timeout);
+  g_string_free (pd->tooltip, TRUE);
+  if (pd->alarm_window)
+    gtk_widget_destroy (pd->alarm_window);
+  if (pd->notify)
+    timer_notify_free (pd->notify);
+  g_array_unref (pd->alarm_queue);
+  timer_stats_shutdown ();
+
+  g_free (pd->global_command);
+
+  if (pd->liststore)
+    {
+      gtk_list_store_clear (pd->liststore);
+    }
+
+  /* destroy all widgets */
+  if (pd->menu)
+    gtk_widget_destroy (pd->menu);
+  gtk_widget_destroy (GTK_WIDGET (pd->box));
+
+  /* free the plugin data structure */
+  g_free (pd);
+
+  gtk_main_quit ();
+}
+
+
 
-  row_count = 0;
+/* options dialog response */
+static void
+options_dialog_response (GtkWidget *dlg, int reponse, plugin_data *pd)
+{
+  const gchar *command;
 
-  while (list)
+  command = gtk_entry_get_text ((GtkEntry *) pd->glob_command_entry);
+  if (g_strcmp0 (command, pd->global_command) != 0)
     {
-      g_snprintf (groupname, 7, "G%d", row_count);
+      set_global_command (pd, command);
+      pd->settings_dirty = TRUE;
+    }
+  gtk_widget_destroy (dlg);
+  pd->tree = NULL;
+  xfce_panel_plugin_unblock_menu (pd->base);
+  save_settings (pd->base, pd);
+}
+
+
+
+/* Alarm dialog response */
+static void
+dialog_response (GtkWidget *dlg, int response, plugin_data *pd)
+{
+  gint active, snooze;
+
+  active = gtk_combo_box_get_active (GTK_COMBO_BOX (pd->snooze_combo));
+  snooze = active >= 0 && active < (gint) G_N_ELEMENTS (snooze_presets)
+           ? snooze_presets[active] : pd->snooze_time;
+
+  /* The window is hidden, not destroyed, closing it included */
+  alarm_queue_act (pd, response, snooze);
+}
 
-      xfce_rc_set_group (rc, groupname);
 
-      alrm = (alarm_t *) list->data;
 
-      xfce_rc_write_entry (rc, "timername", alrm->name);
+/* nowin_if_alarm toggle callback */
+static void
+toggle_nowin_if_alarm (GtkToggleButton *button, gpointer data)
+{
+  plugin_data *pd = (plugin_data *) data;
 
-      xfce_rc_write_int_entry (rc, "time", alrm->time);
+  pd->nowin_if_alarm = gtk_toggle_button_get_active (button);
+  pd->settings_dirty = TRUE;
 
-      xfce_rc_write_entry (rc, "timercommand", alrm->command);
+}
 
-      xfce_rc_write_entry (rc, "timerinfo", alrm->info);
 
-      xfce_rc_write_bool_entry (rc, "is_countdown", alrm->is_countdown);
 
-      xfce_rc_write_bool_entry(rc,"is_recur",alrm->is_recurring);
+/* Moves the alarms still waiting over to the other kind of display */
+static void
+toggle_notifications (GtkToggleButton *button, gpointer data)
+{
+  plugin_data *pd = (plugin_data *) data;
 
-	  xfce_rc_write_bool_entry(rc,"autostart",alrm->is_auto_start);
+  pd->use_notifications = gtk_toggle_button_get_active (button);
+  pd->settings_dirty = TRUE;
 
+  if (pd->use_notifications && pd->alarm_window)
+    gtk_widget_hide (pd->alarm_window);
+  else if (!pd->use_notifications && pd->notify)
+    timer_notify_close (pd->notify);
 
-      row_count++;
-      list = list->next;
-    }
+  alarm_queue_update (pd, FALSE);
+}
 
-  /* save the other options */
-  xfce_rc_set_group (rc, "others");
-  xfce_rc_write_bool_entry (rc, "nowin_if_alarm", pd->nowin_if_alarm);
-  xfce_rc_write_bool_entry (rc, "use_global_command", pd->use_global_command);
-  xfce_rc_write_entry (rc, "global_command", pd->global_command);
-  xfce_rc_write_bool_entry (rc, "repeat_alarm", pd->repeat_alarm_command);
-  xfce_rc_write_int_entry (rc, "repetitions", pd->repetitions);
-  xfce_rc_write_int_entry (rc, "repeat_interval", pd->repeat_interval);
-  xfce_rc_close (rc);
 
-  g_free (file);
+/* Flags the default command entry while it cannot be parsed */
+static void
+global_command_changed (GtkEditable *editable, gpointer data)
+{
+  gchar **argv, *error_message;
+
+  argv = timer_core_parse_command (gtk_entry_get_text (GTK_ENTRY (editable)),
+                                   &error_message);
+  gtk_entry_set_icon_from_icon_name (GTK_ENTRY (editable),
+                                     GTK_ENTRY_ICON_SECONDARY,
+                                     error_message ? "dialog-warning" : NULL);
+  gtk_entry_set_icon_tooltip_text (GTK_ENTRY (editable),
+                                   GTK_ENTRY_ICON_SECONDARY, error_message);
+  g_strfreev (argv);
+  g_free (error_message);
 }
 
 
 
-/* Activates the Edit and Remove buttons when an item in the list is selected */
+/* toggle_snapshot toggle callback */
 static void
-tree_selected (GtkTreeSelection *select, gpointer data)
+toggle_snapshot (GtkToggleButton *button, gpointer data)
 {
   plugin_data *pd = (plugin_data *) data;
-  gtk_widget_set_sensitive (pd->buttonedit, TRUE);
-  gtk_widget_set_sensitive (pd->buttonremove, TRUE);
-  gtk_widget_set_sensitive (pd->buttonup, TRUE);
-  gtk_widget_set_sensitive (pd->buttondown, TRUE);
 
+  pd->use_snapshot = gtk_toggle_button_get_active (button);
+  pd->settings_dirty = TRUE;
 }
 
 
 
 static void
-plugin_free (XfcePanelPlugin *plugin, plugin_data *pd)
+toggle_skip_missed (GtkToggleButton *button, gpointer data)
 {
-  GList *list = NULL;
-  alarm_t *alrm;
-  list = pd->alarm_list;
-
-  while (list){
-	alrm = (alarm_t *) list->data;
-	/* remove timeouts */
-	if (alrm->timeout!=0) g_source_remove(alrm->timeout);
-	if (alrm->repeat_timeout!=0) g_source_remove(alrm->repeat_timeout);
-
-	if(alrm->timer)
-	  g_timer_destroy(alrm->timer);
+  plugin_data *pd = (plugin_data *) data;
 
-	list = g_list_next (list);
-  }
+  pd->skip_missed = gtk_toggle_button_get_active (button);
+  pd->settings_dirty = TRUE;
+}
 
-  if (pd->global_command)
-    g_free (pd->global_command);
 
-  if (pd->liststore)
-    {
-      gtk_list_store_clear (pd->liststore);
-    }
 
-  if (pd->alarm_list)
-    g_list_free (pd->alarm_list);
+/* Columns of the firing history list */
+enum
+{
+  HISTORY_FIRED,
+  HISTORY_TIMER,
+  HISTORY_LATE,
+  HISTORY_RESULT,
+  HISTORY_DURATION,
+  HISTORY_N_COLUMNS
+};
+
+/* The history list of the options dialog */
+typedef struct
+{
+  plugin_data *pd;
+  GtkListStore *store;
+} history_view;
 
-  /* destroy all widgets */
-  gtk_widget_destroy (GTK_WIDGET (pd->box));
 
-  /* free the plugin data structure */
-  g_free (pd);
 
-  gtk_main_quit ();
+/* Adds a firing at the top of the history list, so the latest comes first */
+static void
+history_add_row (const TimerHistoryEvent *event, gpointer data)
+{
+  history_view *view = (history_view *) data;
+  GDateTime *fired;
+  alarm_t *alrm;
+  gchar *when, *timer, *late, *result, *duration = NULL;
+
+  fired = g_date_time_new_from_unix_local (event->fired / G_USEC_PER_SEC);
+  when = g_date_time_format (fired, "%x %X");
+  g_date_time_unref (fired);
+
+  alrm = timer_core_lookup (view->pd->core, event->alarm_id);
+  timer = alrm ? g_strdup (alrm->name)
+               : g_strdup_printf (_("Removed timer %u"), event->alarm_id);
+
+  late = g_strdup_printf (_("%.1fs"),
+                          (gdouble) (event->fired - event->due) / G_USEC_PER_SEC);
+
+  if (!(event->flags & TIMER_HISTORY_COMMAND))
+    result = g_strdup (_("No command"));
+  else if (event->flags & TIMER_HISTORY_FAILED)
+    result = g_strdup (_("Could not start"));
+  else if (event->flags & TIMER_HISTORY_DROPPED)
+    result = g_strdup (_("Dropped"));
+  else if (!(event->flags & TIMER_HISTORY_DONE))
+    result = g_strdup (_("Running"));
+  else if (WIFEXITED (event->status))
+    result = g_strdup_printf (_("Exit %d"), WEXITSTATUS (event->status));
+  else
+    result = g_strdup_printf (_("Signal %d"), WTERMSIG (event->status));
+
+  if ((event->flags & TIMER_HISTORY_DONE) && event->pid != 0)
+    duration = g_strdup_printf (_("%.1fs"),
+                                (gdouble) event->duration / G_USEC_PER_SEC);
+
+  gtk_list_store_insert_with_values (view->store, NULL, 0,
+                                     HISTORY_FIRED, when, HISTORY_TIMER, timer,
+                                     HISTORY_LATE, late, HISTORY_RESULT, result,
+                                     HISTORY_DURATION, duration, -1);
+
+  g_free (when);
+  g_free (timer);
+  g_free (late);
+  g_free (result);
+  g_free (duration);
 }
 
 
 
-/* options dialog response */
+/* The history is only read when it is shown, and again every time */
 static void
-options_dialog_response (GtkWidget *dlg, int reponse, plugin_data *pd)
+history_expanded (GObject *expander, GParamSpec *pspec, gpointer data)
 {
-  if (pd->global_command)
-    g_free (pd->global_command);
-  pd->global_command = g_strdup (
-      gtk_entry_get_text ((GtkEntry *) pd->glob_command_entry));
-  gtk_widget_destroy (dlg);
-  xfce_panel_plugin_unblock_menu (pd->base);
-  save_settings (pd->base, pd);
+  history_view *view = (history_view *) data;
+
+  if (!gtk_expander_get_expanded (GTK_EXPANDER (expander)))
+    return;
+
+  gtk_list_store_clear (view->store);
+  timer_history_foreach (view->pd->history, history_add_row, view);
 }
 
 
 
-/* Alarm dialog response */
 static void
-dialog_response (GtkWidget *dlg, int response, alarm_t* alrm)
+history_view_free (gpointer data, GClosure *closure)
 {
-  plugin_data *pd;
-  pd = (plugin_data *) alrm->pd;
-
-  if (response != 1)
-    {
-      gtk_widget_destroy (dlg);
-      return;
-    }
+  history_view *view = (history_view *) data;
 
-  start_timer (pd, alrm);
-  gtk_widget_destroy (dlg);
+  g_object_unref (view->store);
+  g_free (view);
 }
 
 
 
-/* nowin_if_alarm toggle callback */
-static void
-toggle_nowin_if_alarm (GtkToggleButton *button, gpointer data)
+/* An expander with the firing history */
+static GtkWidget *
+history_view_new (plugin_data *pd)
 {
-  plugin_data *pd = (plugin_data *) data;
+  static const gchar *titles[HISTORY_N_COLUMNS] =
+    { N_("Fired"), N_("Timer"), N_("Late"), N_("Command"), N_("Duration") };
+  GtkWidget *expander, *sw, *tree;
+  GtkCellRenderer *renderer;
+  history_view *view;
+  guint i;
 
-  pd->nowin_if_alarm = gtk_toggle_button_get_active (button);
+  view = g_new0 (history_view, 1);
+  view->pd = pd;
+  view->store = gtk_list_store_new (HISTORY_N_COLUMNS, G_TYPE_STRING,
+                                    G_TYPE_STRING, G_TYPE_STRING,
+                                    G_TYPE_STRING, G_TYPE_STRING);
+
+  tree = gtk_tree_view_new_with_model (GTK_TREE_MODEL (view->store));
+  renderer = gtk_cell_renderer_text_new ();
+  for (i = 0; i < HISTORY_N_COLUMNS; i++)
+    gtk_tree_view_append_column (
+        GTK_TREE_VIEW (tree),
+        gtk_tree_view_column_new_with_attributes (_(titles[i]), renderer,
+                                                  "text", i, NULL));
+
+  sw = gtk_scrolled_window_new (NULL, NULL);
+  gtk_scrolled_window_set_shadow_type (GTK_SCROLLED_WINDOW (sw),
+                                       GTK_SHADOW_ETCHED_IN);
+  gtk_scrolled_window_set_policy (GTK_SCROLLED_WINDOW (sw),
+                                  GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC);
+  gtk_widget_set_size_request (sw, -1, 150);
+  gtk_container_add (GTK_CONTAINER (sw), tree);
+
+  expander = gtk_expander_new (_("History"));
+  gtk_container_add (GTK_CONTAINER (expander), sw);
+  g_signal_connect_data (G_OBJECT (expander), "notify::expanded",
+                         G_CALLBACK (history_expanded), view,
+                         history_view_free, 0);
 
+  return expander;
 }
 
 
+
 /* toggle_global_command toggle callback */
 static void
 toggle_global_command (GtkToggleButton *button, gpointer data)
@@ -1419,6 +2520,8 @@ toggle_global_command (GtkToggleButton *button, gpointer data)
 
   pd->use_global_command = gtk_toggle_button_get_active (button);
   gtk_widget_set_sensitive (pd->global_command_box, pd->use_global_command);
+  command_options_changed (pd);
+  pd->settings_dirty = TRUE;
 
 }
 
@@ -1432,6 +2535,8 @@ toggle_repeat_alarm (GtkToggleButton *button, gpointer data)
 
   pd->repeat_alarm_command = gtk_toggle_button_get_active (button);
   gtk_widget_set_sensitive (pd->repeat_alarm_box, pd->repeat_alarm_command);
+  command_options_changed (pd);
+  pd->settings_dirty = TRUE;
 }
 
 
@@ -1443,6 +2548,8 @@ spin1_changed (GtkSpinButton *button, gpointer data)
   plugin_data *pd = (plugin_data *) data;
 
   pd->repetitions = gtk_spin_button_get_value_as_int (button);
+  command_options_changed (pd);
+  pd->settings_dirty = TRUE;
 }
 
 
@@ -1454,6 +2561,38 @@ spin2_changed (GtkSpinButton *button, gpointer data)
   plugin_data *pd = (plugin_data *) data;
 
   pd->repeat_interval = gtk_spin_button_get_value_as_int (button);
+  command_options_changed (pd);
+  pd->settings_dirty = TRUE;
+}
+
+
+
+/* Snooze time spinbutton value change callback */
+static void
+snooze_time_changed (GtkSpinButton *button, gpointer data)
+{
+  plugin_data *pd = (plugin_data *) data;
+  guint i;
+
+  pd->snooze_time = gtk_spin_button_get_value_as_int (button);
+  pd->settings_dirty = TRUE;
+
+  /* The menus offer it too */
+  for (i = 0; i < timer_core_n_alarms (pd->core); i++)
+    menu_update_alarm (pd, timer_core_get (pd->core, i));
+}
+
+
+
+/* Coalescing window spinbutton value change callback */
+static void
+coalesce_changed (GtkSpinButton *button, gpointer data)
+{
+  plugin_data *pd = (plugin_data *) data;
+
+  pd->coalesce_window = gtk_spin_button_get_value_as_int (button);
+  command_options_changed (pd);
+  pd->settings_dirty = TRUE;
 }
 
 
@@ -1469,7 +2608,7 @@ plugin_create_options (XfcePanelPlugin *plugin, plugin_data *pd)
   GtkTreeSelection *select;
   GtkTreeViewColumn *column;
   GtkWidget *dlg = NULL, *header = NULL;
-  GtkCellRenderer *renderer;
+  GtkCellRenderer *renderer, *icon_renderer;
 
   xfce_panel_plugin_block_menu (plugin);
 
@@ -1506,7 +2645,7 @@ plugin_create_options (XfcePanelPlugin *plugin, plugin_data *pd)
 
   gtk_box_pack_start (GTK_BOX (hbox), sw, TRUE, TRUE, 0);
 
-  fill_liststore (pd, NULL);
+  fill_liststore (pd);
 
   tree = gtk_tree_view_new_with_model (GTK_TREE_MODEL (pd->liststore));
   pd->tree = tree;
@@ -1522,9 +2661,16 @@ plugin_create_options (XfcePanelPlugin *plugin, plugin_data *pd)
       _("Countdown period /\nAlarm time"), renderer, "text", 2, NULL);
   gtk_tree_view_append_column (GTK_TREE_VIEW (tree), column);
 
-  column = gtk_tree_view_column_new_with_attributes (_("Alarm command"),
-                                                     renderer, "text", 3, NULL);
+  /* Invalid commands get a warning icon, with the reason as tooltip */
+  column = gtk_tree_view_column_new ();
+  gtk_tree_view_column_set_title (column, _("Alarm command"));
+  icon_renderer = gtk_cell_renderer_pixbuf_new ();
+  gtk_tree_view_column_pack_start (column, icon_renderer, FALSE);
+  gtk_tree_view_column_add_attribute (column, icon_renderer, "icon-name", 4);
+  gtk_tree_view_column_pack_start (column, renderer, TRUE);
+  gtk_tree_view_column_add_attribute (column, renderer, "text", 3);
   gtk_tree_view_append_column (GTK_TREE_VIEW (tree), column);
+  gtk_tree_view_set_tooltip_column (GTK_TREE_VIEW (tree), 5);
 
   if (tree)
     gtk_container_add (GTK_CONTAINER (sw), tree);
@@ -1578,6 +2724,12 @@ plugin_create_options (XfcePanelPlugin *plugin, plugin_data *pd)
   g_signal_connect (G_OBJECT (button), "clicked", G_CALLBACK (down_clicked),
                     pd);
 
+  button = gtk_button_new_with_label (_("Import..."));
+  gtk_box_pack_start (GTK_BOX (buttonbox), button, FALSE, FALSE,
+  WIDGET_SPACING);
+  g_signal_connect (G_OBJECT (button), "clicked", G_CALLBACK (import_clicked),
+                    pd);
+
   gtk_widget_set_size_request (hbox, -1, -1);
 
   gtk_box_pack_start (GTK_BOX (vbox),
@@ -1592,6 +2744,14 @@ plugin_create_options (XfcePanelPlugin *plugin, plugin_data *pd)
                     G_CALLBACK (toggle_nowin_if_alarm), pd);
   gtk_box_pack_start (GTK_BOX (vbox), button, FALSE, FALSE, WIDGET_SPACING);
 
+  button = gtk_check_button_new_with_label (
+      _("Show alarms as desktop notifications"));
+  gtk_toggle_button_set_active (GTK_TOGGLE_BUTTON (button),
+                                pd->use_notifications);
+  g_signal_connect (G_OBJECT (button), "toggled",
+                    G_CALLBACK (toggle_notifications), pd);
+  gtk_box_pack_start (GTK_BOX (vbox), button, FALSE, FALSE, WIDGET_SPACING);
+
   gtk_box_pack_start (GTK_BOX (vbox),
                       gtk_separator_new (GTK_ORIENTATION_HORIZONTAL), FALSE,
                       FALSE,
@@ -1613,6 +2773,9 @@ plugin_create_options (XfcePanelPlugin *plugin, plugin_data *pd)
   pd->glob_command_entry = (GtkWidget *) gtk_entry_new ();
   gtk_widget_set_size_request (pd->glob_command_entry, 400, -1);
   gtk_entry_set_text (GTK_ENTRY (pd->glob_command_entry), pd->global_command);
+  g_signal_connect (G_OBJECT (pd->glob_command_entry), "changed",
+                    G_CALLBACK (global_command_changed), NULL);
+  global_command_changed (GTK_EDITABLE (pd->glob_command_entry), NULL);
   gtk_box_pack_start (GTK_BOX (hbox), pd->glob_command_entry, FALSE, FALSE, 10);
 
   gtk_box_pack_start (GTK_BOX (vbox), hbox, FALSE, FALSE, WIDGET_SPACING);
@@ -1656,6 +2819,60 @@ plugin_create_options (XfcePanelPlugin *plugin, plugin_data *pd)
   gtk_box_pack_start (GTK_BOX (vbox), hbox, FALSE, FALSE, WIDGET_SPACING);
   gtk_widget_set_sensitive (hbox, pd->repeat_alarm_command);
 
+  /* Alarms going off together */
+  hbox = gtk_box_new (GTK_ORIENTATION_HORIZONTAL, 0);
+  gtk_box_pack_start (GTK_BOX (hbox),
+                      gtk_label_new (_("Alarms due within (sec.)")), FALSE,
+                      FALSE, 0);
+  spinbutton = gtk_spin_button_new_with_range (0, 60, 1);
+  gtk_spin_button_set_value (GTK_SPIN_BUTTON (spinbutton), pd->coalesce_window);
+  g_signal_connect (G_OBJECT (spinbutton), "value-changed",
+                    G_CALLBACK (coalesce_changed), pd);
+  gtk_box_pack_start (GTK_BOX (hbox), spinbutton, FALSE, FALSE, 10);
+  gtk_box_pack_start (GTK_BOX (hbox),
+                      gtk_label_new (_("go off together")), FALSE, FALSE, 0);
+  gtk_widget_set_tooltip_text (hbox,
+      _("Alarms that come due this close to each other are shown in one "
+        "window and their commands are run together"));
+  gtk_box_pack_start (GTK_BOX (vbox), hbox, FALSE, FALSE, WIDGET_SPACING);
+
+  /* Snooze time besides the fixed ones */
+  hbox = gtk_box_new (GTK_ORIENTATION_HORIZONTAL, 0);
+  gtk_box_pack_start (GTK_BOX (hbox),
+                      gtk_label_new (_("Snooze time (sec.)")), FALSE,
+                      FALSE, 0);
+  spinbutton = gtk_spin_button_new_with_range (1, 24 * 3600, 1);
+  gtk_spin_button_set_value (GTK_SPIN_BUTTON (spinbutton), pd->snooze_time);
+  g_signal_connect (G_OBJECT (spinbutton), "value-changed",
+                    G_CALLBACK (snooze_time_changed), pd);
+  gtk_box_pack_start (GTK_BOX (hbox), spinbutton, FALSE, FALSE, 10);
+  gtk_box_pack_start (GTK_BOX (vbox), hbox, FALSE, FALSE, WIDGET_SPACING);
+
+  gtk_box_pack_start (GTK_BOX (vbox),
+                      gtk_separator_new (GTK_ORIENTATION_HORIZONTAL), FALSE,
+                      FALSE,
+                      BORDER);
+
+  /* Binary copy of the settings */
+  button = gtk_check_button_new_with_label (
+      _("Keep a binary copy of the settings for faster loading"));
+  gtk_toggle_button_set_active (GTK_TOGGLE_BUTTON (button), pd->use_snapshot);
+  g_signal_connect (G_OBJECT (button), "toggled",
+                    G_CALLBACK (toggle_snapshot), pd);
+  gtk_box_pack_start (GTK_BOX (vbox), button, FALSE, FALSE, WIDGET_SPACING);
+
+  /* Catch-up policy of the state journal */
+  button = gtk_check_button_new_with_label (
+      _("Skip alarms that went off while the panel was not running"));
+  gtk_toggle_button_set_active (GTK_TOGGLE_BUTTON (button), pd->skip_missed);
+  g_signal_connect (G_OBJECT (button), "toggled",
+                    G_CALLBACK (toggle_skip_missed), pd);
+  gtk_box_pack_start (GTK_BOX (vbox), button, FALSE, FALSE, WIDGET_SPACING);
+
+  if (pd->history)
+    gtk_box_pack_start (GTK_BOX (vbox), history_view_new (pd), FALSE, FALSE,
+                        WIDGET_SPACING);
+
   gtk_widget_show_all (GTK_WIDGET (dlg));
 }
 
@@ -1721,6 +2938,249 @@ Cheng-Chia Tseng <pswo10680@gmail.com>\n";
 
 
 
+/* Responses of the statistics dialog besides closing it */
+#define STATS_RESPONSE_REFRESH 1
+#define STATS_RESPONSE_RESET   2
+
+/* Statistics dialog response, also used to fill it in */
+static void
+stats_dialog_response (GtkWidget *dlg, gint response, gpointer data)
+{
+  GtkLabel *label = GTK_LABEL (data);
+  GString *text;
+  gchar *markup;
+
+  if (response == STATS_RESPONSE_RESET)
+    timer_stats_reset ();
+  else if (response != STATS_RESPONSE_REFRESH)
+    {
+      gtk_widget_destroy (dlg);
+      return;
+    }
+
+  text = g_string_new (NULL);
+  timer_stats_format (text);
+  markup = g_markup_printf_escaped ("<tt>%s</tt>", text->str);
+  gtk_label_set_markup (label, markup);
+  g_free (markup);
+  g_string_free (text, TRUE);
+}
+
+
+
+static void
+stats_record_toggled (GtkToggleButton *button, gpointer data)
+{
+  timer_stats_enable (gtk_toggle_button_get_active (button));
+}
+
+
+
+/**
+ * Debug dialog with the statistics, and the switch that records
+ * them. Recording is on from the start if TIMER_STATS_ENV is set.
+ **/
+static void
+show_stats_window (GtkMenuItem *item, gpointer data)
+{
+  GtkWidget *dialog, *content, *record, *label;
+
+  dialog = gtk_dialog_new_with_buttons (_("Timer statistics"), NULL, 0,
+                                        _("Refresh"), STATS_RESPONSE_REFRESH,
+                                        _("Reset"), STATS_RESPONSE_RESET,
+                                        _("Close"), GTK_RESPONSE_CLOSE, NULL);
+  gtk_container_set_border_width (GTK_CONTAINER (dialog), BORDER);
+  content = gtk_dialog_get_content_area (GTK_DIALOG (dialog));
+
+  record = gtk_check_button_new_with_label (_("Record statistics"));
+  gtk_toggle_button_set_active (GTK_TOGGLE_BUTTON (record),
+                                timer_stats_enabled);
+  g_signal_connect (record, "toggled", G_CALLBACK (stats_record_toggled),
+                    NULL);
+  gtk_box_pack_start (GTK_BOX (content), record, FALSE, FALSE, 0);
+
+  label = gtk_label_new (NULL);
+  gtk_label_set_selectable (GTK_LABEL (label), TRUE);
+  gtk_box_pack_start (GTK_BOX (content), label, TRUE, TRUE, 0);
+
+  g_signal_connect (dialog, "response", G_CALLBACK (stats_dialog_response),
+                    label);
+  stats_dialog_response (dialog, STATS_RESPONSE_REFRESH, label);
+
+  gtk_widget_show_all (dialog);
+}
+
+
+
+/* Startup probe: logs when the plugin is painted for the first time */
+static gboolean
+first_draw (GtkWidget *widget, cairo_t *cr, gpointer data)
+{
+  plugin_data *pd = (plugin_data *) data;
+
+  g_debug ("First paint after %.1f ms",
+           (g_get_monotonic_time () - pd->startup_time) / 1000.0);
+  g_signal_handlers_disconnect_by_func (widget, first_draw, data);
+
+  return FALSE;
+}
+
+
+
+/* D-Bus callback: Add made an alarm, show it like one from the Add dialog */
+static void
+dbus_alarm_added (TimerCore *core, alarm_t *alrm, gpointer data)
+{
+  plugin_data *pd = (plugin_data *) data;
+  guint n = timer_core_n_alarms (core);
+
+  alarm_view_new (pd, alrm);
+  timer_core_string_free (core, alrm->info);
+  alrm->info = alarm_time_info (alrm->is_countdown, alrm->time);
+
+  if (n == 1)
+    pd->selected = alrm;
+
+  gtk_list_store_insert_with_values (pd->liststore, NULL, -1, 0, alrm->id,
+                                     1, alrm->name, 2, alrm->info, 3,
+                                     alrm->command, 4, COMMAND_ICON (alrm),
+                                     5, alrm->command_error, -1);
+  pd->count = n;
+  menu_add_alarm (pd, alrm, n - 1);
+  pd->settings_dirty = TRUE;
+}
+
+
+
+/* D-Bus callback: Remove, the options list loses the row too */
+static void
+dbus_alarm_remove (TimerCore *core, alarm_t *alrm, guint index, gpointer data)
+{
+  plugin_data *pd = (plugin_data *) data;
+  GtkTreeIter iter;
+
+  remove_alarm (pd, alrm, index);
+  pd->count = timer_core_n_alarms (core);
+
+  if (gtk_tree_model_iter_nth_child (GTK_TREE_MODEL (pd->liststore), &iter,
+                                     NULL, index))
+    gtk_list_store_remove (pd->liststore, &iter);
+}
+
+
+
+static void
+dbus_alarm_snooze (TimerCore *core, alarm_t *alrm, gint seconds, gpointer data)
+{
+  alarm_snooze ((plugin_data *) data, alrm, seconds);
+}
+
+
+
+static const TimerDBusCallbacks dbus_callbacks =
+{
+  dbus_alarm_added, dbus_alarm_remove, dbus_alarm_snooze
+};
+
+
+
+/**
+ * Loads the alarms and starts the auto-start ones. This runs once
+ * the panel is idle, so it does not hold up showing the plugin.
+ **/
+static gboolean
+load_idle (gpointer data)
+{
+  plugin_data *pd = (plugin_data *) data;
+  alarm_t *alrm;
+  gchar *path;
+  guint i, n;
+
+  pd->load_idle = 0;
+
+  load_settings (pd);
+  n = timer_core_n_alarms (pd->core);
+  pd->selected = n > 0 ? timer_core_get (pd->core, 0) : NULL;
+
+  /* Timers that were on when the panel went away go on from there */
+  if (pd->journal_path)
+    timer_journal_restore (pd->core, pd->journal_path,
+                           pd->skip_missed ? TIMER_CATCH_UP_SKIP
+                                           : TIMER_CATCH_UP_FIRE);
+
+  /* A menu opened meanwhile has none of the loaded alarms */
+  if (pd->menu)
+    {
+      gtk_widget_destroy (pd->menu);
+      pd->menu = NULL;
+    }
+
+  //Check if an alarm is auto start to start it at creation
+  timer_core_freeze (pd->core);
+  for (i = 0; i < n; i++){
+      alrm = timer_core_get (pd->core, i);
+      if(alrm->is_auto_start){
+          timer_core_start (pd->core, alrm);
+      }
+  }
+  timer_core_thaw (pd->core);
+
+  /* Scripts can drive the alarms once they are loaded */
+  path = g_strdup_printf ("%s/%d", TIMER_DBUS_PATH,
+                          xfce_panel_plugin_get_unique_id (pd->base));
+  pd->dbus = timer_dbus_new (pd->core, path, &dbus_callbacks, pd);
+  g_free (path);
+
+  g_debug ("%u alarms armed after %.1f ms", n,
+           (g_get_monotonic_time () - pd->startup_time) / 1000.0);
+
+  /* The options can only be edited once they are loaded */
+  xfce_panel_plugin_menu_show_configure (pd->base);
+
+  return FALSE;
+}
+
+
+
+/**
+ * Panel remote events, sent with
+ *   xfce4-panel --plugin-event=xfcetimer:import:string:FILE
+ * import: adds the alarms of a CSV or JSON file, see timerimport.c
+ **/
+static gboolean
+remote_event (XfcePanelPlugin *plugin, const gchar *name,
+              const GValue *value, plugin_data *pd)
+{
+  GError *error = NULL;
+
+  if (strcmp (name, "import") != 0)
+    return FALSE;
+
+  if (value == NULL || !G_VALUE_HOLDS_STRING (value))
+    {
+      g_warning ("The import event needs a file name");
+      return TRUE;
+    }
+
+  /* Loading would add the file's alarms again */
+  if (pd->load_idle != 0)
+    {
+      g_source_remove (pd->load_idle);
+      load_idle (pd);
+    }
+
+  if (!import_alarms (pd, g_value_get_string (value), &error))
+    {
+      g_warning ("Could not import %s: %s", g_value_get_string (value),
+                 error->message);
+      g_error_free (error);
+    }
+
+  return TRUE;
+}
+
+
+
 /**
  * create_sample_control
  * Create a new instance of the plugin.
@@ -1731,18 +3191,22 @@ static void
 create_plugin_control (XfcePanelPlugin *plugin)
 {
   plugin_data *pd = g_new0 (plugin_data, 1);
-  GList *list = NULL;
-  alarm_t *alrm;
+  GtkWidget *item;
+  gchar *journal, *history, *path;
+
+  pd->startup_time = g_get_monotonic_time ();
 
   xfce_textdomain (GETTEXT_PACKAGE, PACKAGE_LOCALE_DIR, "UTF-8");
 
   pd->base = plugin;
   pd->count = 0;
   pd->pbar = gtk_progress_bar_new ();
-  pd->liststore = gtk_list_store_new (4, G_TYPE_POINTER, /* Column 0: GList alarm list node */
+  pd->liststore = gtk_list_store_new (6, G_TYPE_UINT, /* Column 0: Alarm id */
                                       G_TYPE_STRING, /* Column 1: Name */
                                       G_TYPE_STRING, /* Column 2: Timer period/alarm time - info string */
-                                      G_TYPE_STRING); /* Command to run */
+                                      G_TYPE_STRING, /* Command to run */
+                                      G_TYPE_STRING, /* Column 4: Icon of an invalid command */
+                                      G_TYPE_STRING); /* Column 5: Why the command is invalid */
   pd->box = gtk_box_new (GTK_ORIENTATION_HORIZONTAL, 0);
   pd->buttonadd = NULL;
   pd->buttonedit = NULL;
@@ -1753,30 +3217,53 @@ create_plugin_control (XfcePanelPlugin *plugin)
   pd->use_global_command = FALSE;
   pd->glob_command_entry = NULL;
   pd->global_command = g_strdup (""); /* For Gtk >= 3.4 one could just set = NULL */
+  pd->settings_dirty = FALSE;
+  pd->use_snapshot = FALSE;
+  pd->skip_missed = FALSE;
+  pd->journal_idle = 0;
   pd->global_command_box = NULL;
   pd->repeat_alarm_box = NULL;
   pd->repetitions = 1;
   pd->repeat_interval = 10;
-  pd->alarm_list = NULL;
+  pd->coalesce_window = 0;
+  pd->snooze_time = SNOOZE_TIME_DEFAULT;
+  pd->snooze_combo = NULL;
+  pd->alarm_queue = g_array_new (FALSE, FALSE, sizeof (guint));
+  pd->alarm_queue_dirty = FALSE;
+  pd->alarm_window = NULL;
+  pd->notify = NULL;
+  pd->use_notifications = FALSE;
+  pd->core = timer_core_new (&core_callbacks, pd);
+  command_options_changed (pd);
+  journal = g_strdup_printf ("xfce4/timer-plugin/%s-%d.journal",
+                             xfce_panel_plugin_get_name (plugin),
+                             xfce_panel_plugin_get_unique_id (plugin));
+  pd->journal_path = xfce_resource_save_location (XFCE_RESOURCE_CACHE,
+                                                  journal, TRUE);
+  g_free (journal);
+  history = g_strdup_printf ("xfce4/timer-plugin/%s-%d.history",
+                             xfce_panel_plugin_get_name (plugin),
+                             xfce_panel_plugin_get_unique_id (plugin));
+  path = xfce_resource_save_location (XFCE_RESOURCE_CACHE, history, TRUE);
+  g_free (history);
+  pd->history = path ? timer_history_new (path, TIMER_HISTORY_MAX_SIZE) : NULL;
+  g_free (path);
+  timer_core_set_history (pd->core, pd->history);
+  pd->dbus = NULL;
   pd->selected = NULL;
-  pd->num_active_timers=0;
+  pd->update_timeout = 0;
+  pd->hovered = FALSE;
+  pd->menu_open = FALSE;
+  pd->tooltip = g_string_new (NULL);
+  pd->tooltip_dirty = TRUE;
+  pd->wakeups = 0;
+  pd->wakeups_since = g_get_monotonic_time ();
+  pd->expiry_wakeups = 0;
 
   gtk_widget_set_tooltip_text (GTK_WIDGET (plugin), "");
 
   g_object_ref (pd->liststore);
 
-  load_settings (pd);
-  pd->selected = pd->alarm_list;
-  //Check if an alarm is auto start to start it at creation
-  list = pd->alarm_list;
-  while (list){
-      alrm = (alarm_t *) list->data;
-      if(alrm->is_auto_start){
-          start_timer(pd,alrm);
-      }
-      list = g_list_next (list);
-  }
-
   gtk_container_set_border_width (GTK_CONTAINER (pd->box), BORDER / 2);
   gtk_container_add (GTK_CONTAINER (plugin), pd->box);
 
@@ -1788,21 +3275,41 @@ create_plugin_control (XfcePanelPlugin *plugin)
   g_signal_connect (G_OBJECT (plugin), "button_press_event",
                     G_CALLBACK (pbar_clicked), pd);
 
+  gtk_widget_add_events (GTK_WIDGET (plugin),
+                         GDK_ENTER_NOTIFY_MASK | GDK_LEAVE_NOTIFY_MASK);
+  g_signal_connect (G_OBJECT (plugin), "enter-notify-event",
+                    G_CALLBACK (crossing_event), pd);
+  g_signal_connect (G_OBJECT (plugin), "leave-notify-event",
+                    G_CALLBACK (crossing_event), pd);
+
+  g_signal_connect (G_OBJECT (plugin), "draw", G_CALLBACK (first_draw), pd);
+
   gtk_widget_show_all (GTK_WIDGET (plugin));
 
+  /* The alarms are loaded once the panel got to show us */
+  pd->load_idle = g_idle_add (load_idle, pd);
+
   g_signal_connect (plugin, "free-data", G_CALLBACK (plugin_free), pd);
 
   g_signal_connect (plugin, "save", G_CALLBACK (save_settings), pd);
 
+  g_signal_connect (plugin, "remote-event", G_CALLBACK (remote_event), pd);
+
   g_signal_connect (plugin, "orientation-changed", G_CALLBACK (orient_change),
                     pd);
 
   g_signal_connect (plugin, "size-changed", G_CALLBACK (size_changed), pd);
 
-  xfce_panel_plugin_menu_show_configure (plugin);
   g_signal_connect (plugin, "configure-plugin",
                     G_CALLBACK (plugin_create_options), pd);
 
   xfce_panel_plugin_menu_show_about (plugin);
   g_signal_connect (plugin, "about", G_CALLBACK (show_about_window), pd);
+
+  timer_stats_init ();
+  item = gtk_menu_item_new_with_label (_("Statistics"));
+  g_signal_connect (G_OBJECT (item), "activate",
+                    G_CALLBACK (show_stats_window), NULL);
+  gtk_widget_show (item);
+  xfce_panel_plugin_menu_insert_item (plugin, GTK_MENU_ITEM (item));
 }
@@ -17,22 +17,19 @@
  *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
  */
 
+typedef TimerAlarm alarm_t;
+
+/* What the plugin keeps of an alarm, in alarm_t.user_data */
 typedef struct
 {
-  gchar *name, *info;
-  gchar *command; /* Command when countdown ends */
-  gint time;
-  gboolean is_recurring, is_auto_start, timer_on;
-
-  gboolean is_repeating; /* True while alarm repeats */
-  gboolean is_paused; /* True if the countdown is paused */
-  gboolean is_countdown; /* True if the alarm type is contdown */
-  gpointer pd;
-  gint timeout_period_in_sec,    /* Active countdown period */
-          rem_repetitions;      /* Remaining repeats */
-  guint timeout,repeat_timeout;	/* The timeout IDs */
-  GTimer *timer; /* Keeps track of the time elapsed */
-} alarm_t;
+  gpointer pd; /* The plugin */
+  GString *tip_line; /* Cached tooltip line */
+  gint tip_remaining; /* Remaining seconds shown in tip_line, -1 if stale */
+  gboolean tip_paused; /* Paused state shown in tip_line */
+  GtkWidget *menu_sep, *menu_item; /* Popup menu items, NULL until the menu is built */
+  GtkWidget *menu_pause, *menu_snooze, *menu_stop;
+  GtkWidget *menu_snooze_custom; /* Snooze submenu item for the snooze time */
+} alarm_view;
 
 typedef struct
 {
@@ -51,13 +48,37 @@ typedef struct
   gint count;
   gint repetitions; /* Number of alarm repeats */
   gint repeat_interval; /* Time interval between repeats (in secs) */
+  gint coalesce_window; /* Alarms due this close (in secs) go off together */
+  gint snooze_time; /* Snooze time of the settings (in secs) */
+  GArray *alarm_queue; /* Ids of the alarms that went off, not seen to yet */
+  gboolean alarm_queue_dirty; /* Alarms were queued since it was shown */
+  GtkWidget *alarm_window; /* Shows the alarm queue, NULL until needed */
+  GtkWidget *snooze_combo; /* Snooze time picker of the alarm window */
+  gboolean use_notifications; /* Show the alarm queue as desktop notifications */
+  TimerNotify *notify; /* Desktop notification client, NULL until needed */
   gboolean nowin_if_alarm; /* Show warning window when alarm command is set */
   gboolean repeat_alarm_command; /* Repeat alarm command*/
   gboolean use_global_command; /* Use a default alarm command if no alarm command is set */
   gchar *global_command; /* The global (default) command to be run when countdown ends */
-  GList *alarm_list; /* List of alarms */
-  GList *selected; /* Selected alarm */
-  guint num_active_timers;
+  gboolean use_snapshot; /* Keep a binary copy of the settings */
+  gboolean skip_missed; /* Drop alarms that came due while the panel was not running */
+  gchar *journal_path; /* State journal of the running alarms */
+  guint journal_idle; /* Source ID of the pending journal write */
+  TimerHistory *history; /* Log of the alarm firings */
+  gboolean settings_dirty; /* Settings changed since they were saved */
+  guint load_idle; /* Source ID of the deferred settings load */
+  gint64 startup_time; /* When the plugin was created (monotonic) */
+  TimerCore *core; /* The alarms and their scheduling */
+  TimerDBus *dbus; /* D-Bus control interface, NULL until the alarms are loaded */
+  alarm_t *selected; /* Selected alarm */
+  guint update_timeout; /* Timeout ID for the tooltip/pbar update */
+  gboolean hovered; /* Pointer is over the plugin, tooltip may be shown */
+  gboolean menu_open; /* Popup menu is shown */
+  GString *tooltip; /* Tooltip text, built from the alarms' tip_line */
+  gboolean tooltip_dirty; /* A line was added, removed or rewritten */
+  guint wakeups; /* Wakeups since wakeups_since */
+  gint64 wakeups_since; /* Start of the current wakeup count (monotonic) */
+  guint expiry_wakeups; /* Core wakeups counted so far */
 } plugin_data;
 
 typedef struct
@@ -0,0 +1,207 @@
+/*
+ *
+ *  Copyright (C) 2005-2014 Kemal Ilgar Eroglu <ilgar_eroglu@yahoo.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * Unit tests of the rc file: whatever is written has to read back
+ * the same, however odd the strings in it.
+ **/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <unistd.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "timerconfig.h"
+
+
+
+/* Strings that are easily lost on the way */
+static const gchar *const values[] =
+{
+  "Tea",
+  "",
+  " leading",
+  "trailing ",
+  "  both  ",
+  "   ",
+  "inner  spaces",
+  "back\\slash\\",
+  "\\n is no line break",
+  "two\nlines",
+  "\ttab\t",
+  "a=b=c",
+  "=",
+  "# not a comment",
+  "[G7]",
+};
+
+typedef struct
+{
+  GPtrArray *alarms; /* Copies of the TimerConfigAlarm read */
+} Loaded;
+
+
+
+static void
+loaded_alarm (const TimerConfigAlarm *alarm, gpointer data)
+{
+  Loaded *loaded = (Loaded *) data;
+  TimerConfigAlarm *copy;
+
+  copy = g_new (TimerConfigAlarm, 1);
+  *copy = *alarm;
+  g_ptr_array_add (loaded->alarms, copy);
+}
+
+
+
+/* Writes an alarm per value, and the last value as global command */
+static gchar *
+write_rc (void)
+{
+  TimerConfigOptions options = { .repetitions = 3, .repeat_interval = 10 };
+  TimerConfigWriter *writer;
+  TimerConfigAlarm alarm;
+  GError *error = NULL;
+  gchar *path;
+  guint i;
+  gint fd;
+
+  fd = g_file_open_tmp ("test-config-XXXXXX", &path, &error);
+  g_assert_no_error (error);
+  close (fd);
+
+  writer = timer_config_writer_new ();
+  for (i = 0; i < G_N_ELEMENTS (values); i++)
+    {
+      alarm.name = (gchar *) values[i];
+      alarm.info = (gchar *) values[(i + 1) % G_N_ELEMENTS (values)];
+      alarm.command = (gchar *) values[(i + 2) % G_N_ELEMENTS (values)];
+      alarm.time = i * 60;
+      alarm.is_countdown = i % 2 == 0;
+      alarm.is_recurring = i % 3 == 0;
+      alarm.is_auto_start = i % 5 == 0;
+      timer_config_writer_add_alarm (writer, &alarm);
+    }
+
+  options.use_global_command = TRUE;
+  options.global_command = (gchar *) values[G_N_ELEMENTS (values) - 1];
+  g_assert_true (timer_config_writer_finish (writer, &options, path, &error));
+  g_assert_no_error (error);
+
+  return path;
+}
+
+
+
+static void
+test_round_trip (void)
+{
+  TimerConfigOptions options = { 0 };
+  TimerConfigAlarm *alarm;
+  Loaded loaded;
+  GError *error = NULL;
+  gchar *path, *contents;
+  guint i;
+
+  path = write_rc ();
+  g_file_get_contents (path, &contents, NULL, &error);
+  g_assert_no_error (error);
+
+  loaded.alarms = g_ptr_array_new_with_free_func (g_free);
+  timer_config_parse (contents, &options, loaded_alarm, &loaded);
+
+  g_assert_cmpuint (loaded.alarms->len, ==, G_N_ELEMENTS (values));
+  for (i = 0; i < G_N_ELEMENTS (values); i++)
+    {
+      alarm = g_ptr_array_index (loaded.alarms, i);
+      g_assert_cmpstr (alarm->name, ==, values[i]);
+      g_assert_cmpstr (alarm->info, ==,
+                       values[(i + 1) % G_N_ELEMENTS (values)]);
+      g_assert_cmpstr (alarm->command, ==,
+                       values[(i + 2) % G_N_ELEMENTS (values)]);
+      g_assert_cmpint (alarm->time, ==, i * 60);
+      g_assert_cmpint (alarm->is_countdown, ==, i % 2 == 0);
+      g_assert_cmpint (alarm->is_recurring, ==, i % 3 == 0);
+      g_assert_cmpint (alarm->is_auto_start, ==, i % 5 == 0);
+    }
+
+  g_assert_true (options.use_global_command);
+  g_assert_cmpstr (options.global_command, ==,
+                   values[G_N_ELEMENTS (values) - 1]);
+  g_assert_cmpint (options.repetitions, ==, 3);
+  g_assert_cmpint (options.repeat_interval, ==, 10);
+
+  g_ptr_array_unref (loaded.alarms);
+  g_free (contents);
+  g_unlink (path);
+  g_free (path);
+}
+
+
+
+/* Hand edits: padding around '=' goes, escaped blanks stay */
+static void
+test_hand_edit (void)
+{
+  TimerConfigOptions options = { 0 };
+  TimerConfigAlarm *alarm;
+  Loaded loaded;
+  gchar *contents;
+
+  contents = g_strdup ("# An rc file written by hand\n"
+                       "  [G0]  \n"
+                       "  timername  =  \\s Tea\\s  \n"
+                       "time=300\r\n"
+                       "timercommand = play \\\\ bell\n"
+                       "\n"
+                       "[others]\n"
+                       "repetitions = 4\n");
+
+  loaded.alarms = g_ptr_array_new_with_free_func (g_free);
+  timer_config_parse (contents, &options, loaded_alarm, &loaded);
+
+  g_assert_cmpuint (loaded.alarms->len, ==, 1);
+  alarm = g_ptr_array_index (loaded.alarms, 0);
+  g_assert_cmpstr (alarm->name, ==, "  Tea ");
+  g_assert_cmpint (alarm->time, ==, 300);
+  g_assert_cmpstr (alarm->command, ==, "play \\ bell");
+  g_assert_null (alarm->info);
+  g_assert_cmpint (options.repetitions, ==, 4);
+
+  g_ptr_array_unref (loaded.alarms);
+  g_free (contents);
+}
+
+
+
+int
+main (int argc, char **argv)
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/config/round-trip", test_round_trip);
+  g_test_add_func ("/config/hand-edit", test_hand_edit);
+
+  return g_test_run ();
+}
@@ -0,0 +1,439 @@
+/*
+ *
+ *  Copyright (C) 2005-2014 Kemal Ilgar Eroglu <ilgar_eroglu@yahoo.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * Unit tests of the timer core, run on the simulated clock so that
+ * every firing can be checked to the microsecond.
+ **/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib.h>
+
+#include "timercore.h"
+#include "timersim.h"
+
+
+
+#define SEC(s) ((gint64) (s) * G_USEC_PER_SEC)
+
+typedef struct
+{
+  TimerCore *core;
+  TimerSimClock *sim;
+  guint fired[8]; /* Per alarm id */
+  gint64 fired_at[8]; /* Monotonic time of the last firing, per alarm id */
+  guint commands[8]; /* Alarm commands run, per alarm id */
+  guint changed; /* Times 'changed' was called */
+} Fixture;
+
+
+
+static void
+fixture_fired (TimerCore *core, TimerAlarm *alarm, gpointer data)
+{
+  Fixture *f = (Fixture *) data;
+
+  g_assert_cmpuint (alarm->id, <, G_N_ELEMENTS (f->fired));
+  f->fired[alarm->id]++;
+  f->fired_at[alarm->id] = timer_sim_clock_now (f->sim);
+}
+
+
+
+static void
+fixture_changed (TimerCore *core, gpointer data)
+{
+  ((Fixture *) data)->changed++;
+}
+
+
+
+static void
+fixture_run_command (TimerCore *core, TimerAlarm *alarm, gchar **argv,
+                     gpointer data)
+{
+  Fixture *f = (Fixture *) data;
+
+  f->commands[alarm->id]++;
+}
+
+
+
+/* Local time of day 10:00 on 2020-01-01, where the tests start */
+static gint64
+start_real (void)
+{
+  GDateTime *start;
+  gint64 real;
+
+  start = g_date_time_new_local (2020, 1, 1, 10, 0, 0);
+  real = g_date_time_to_unix (start) * G_USEC_PER_SEC;
+  g_date_time_unref (start);
+
+  return real;
+}
+
+
+
+static void
+fixture_setup (Fixture *f, gconstpointer data)
+{
+  static const TimerCoreCallbacks callbacks =
+    { fixture_fired, NULL, fixture_changed, fixture_run_command };
+
+  f->core = timer_core_new (&callbacks, f);
+  f->sim = timer_sim_clock_new (f->core, start_real ());
+}
+
+
+
+static void
+fixture_teardown (Fixture *f, gconstpointer data)
+{
+  timer_sim_clock_free (f->sim);
+  timer_core_free (f->core);
+}
+
+
+
+/* A countdown of 'seconds', or an "At" alarm for 'seconds' minutes of the day */
+static TimerAlarm *
+add_alarm (Fixture *f, gboolean countdown, gint time, gboolean recurring,
+           const gchar *command)
+{
+  TimerAlarm *alarm;
+
+  alarm = timer_core_add (f->core);
+  timer_core_set_name (f->core, alarm, "Test");
+  timer_core_set_info (f->core, alarm, "");
+  timer_core_set_command (f->core, alarm, command);
+  alarm->is_countdown = countdown;
+  alarm->is_recurring = recurring;
+  alarm->time = time;
+
+  return alarm;
+}
+
+
+
+static gint64
+remaining (Fixture *f, TimerAlarm *alarm)
+{
+  return timer_core_remaining (f->core, alarm, timer_sim_clock_now (f->sim));
+}
+
+
+
+static void
+test_start_stop (Fixture *f, gconstpointer data)
+{
+  TimerAlarm *alarm = add_alarm (f, TRUE, 60, FALSE, "");
+
+  timer_core_start (f->core, alarm);
+  g_assert_cmpuint (timer_core_n_running (f->core), ==, 1);
+  g_assert_cmpint (timer_core_next_event (f->core), ==, SEC (60));
+
+  timer_sim_clock_advance (f->sim, SEC (20));
+  g_assert_cmpint (remaining (f, alarm), ==, SEC (40));
+
+  timer_core_stop (f->core, alarm);
+  g_assert_cmpuint (timer_core_get_state (f->core, alarm), ==, 0);
+  g_assert_cmpuint (timer_core_n_running (f->core), ==, 0);
+  g_assert_cmpint (timer_core_next_event (f->core), ==, -1);
+
+  timer_sim_clock_advance (f->sim, SEC (120));
+  g_assert_cmpuint (f->fired[alarm->id], ==, 0);
+
+  /* Started again, it counts down from the start */
+  timer_core_start (f->core, alarm);
+  timer_sim_clock_advance (f->sim, SEC (60));
+  g_assert_cmpuint (f->fired[alarm->id], ==, 1);
+  g_assert_cmpint (f->fired_at[alarm->id], ==, SEC (200));
+  g_assert_cmpint (alarm->lateness, ==, 0);
+  g_assert_cmpuint (timer_core_n_running (f->core), ==, 0);
+}
+
+
+
+static void
+test_pause_resume (Fixture *f, gconstpointer data)
+{
+  TimerAlarm *alarm = add_alarm (f, TRUE, 60, FALSE, "");
+
+  timer_core_start (f->core, alarm);
+  timer_sim_clock_advance (f->sim, SEC (30));
+
+  timer_core_pause (f->core, alarm);
+  g_assert_cmpuint (timer_core_get_state (f->core, alarm), ==,
+                    TIMER_ALARM_RUNNING | TIMER_ALARM_PAUSED);
+  g_assert_cmpint (timer_core_next_event (f->core), ==, -1);
+
+  /* Paused, it neither fires nor loses time */
+  timer_sim_clock_advance (f->sim, SEC (300));
+  g_assert_cmpuint (f->fired[alarm->id], ==, 0);
+  g_assert_cmpint (remaining (f, alarm), ==, SEC (30));
+  g_assert_true (timer_core_first_to_finish (f->core,
+                                             timer_sim_clock_now (f->sim))
+                 == alarm);
+
+  timer_core_resume (f->core, alarm);
+  g_assert_cmpuint (timer_core_get_state (f->core, alarm), ==,
+                    TIMER_ALARM_RUNNING);
+  timer_sim_clock_advance (f->sim, SEC (29));
+  g_assert_cmpuint (f->fired[alarm->id], ==, 0);
+  timer_sim_clock_advance (f->sim, SEC (1));
+  g_assert_cmpuint (f->fired[alarm->id], ==, 1);
+  g_assert_cmpint (f->fired_at[alarm->id], ==, SEC (360));
+}
+
+
+
+static void
+test_recurring (Fixture *f, gconstpointer data)
+{
+  TimerAlarm *alarm = add_alarm (f, TRUE, 10, TRUE, "");
+
+  timer_core_start (f->core, alarm);
+  timer_sim_clock_advance (f->sim, SEC (35));
+
+  /* Restarted from each deadline, so it does not drift */
+  g_assert_cmpuint (f->fired[alarm->id], ==, 3);
+  g_assert_cmpint (f->fired_at[alarm->id], ==, SEC (30));
+  g_assert_cmpint (remaining (f, alarm), ==, SEC (5));
+  g_assert_cmpuint (timer_core_n_running (f->core), ==, 1);
+  g_assert_cmpint (timer_core_next_event (f->core), ==, SEC (40));
+}
+
+
+
+static void
+test_repeats_after_stop (Fixture *f, gconstpointer data)
+{
+  TimerAlarm *alarm = add_alarm (f, TRUE, 60, TRUE, "true");
+
+  timer_core_set_repeat (f->core, TRUE, 2, 10);
+  timer_core_start (f->core, alarm);
+
+  timer_sim_clock_advance (f->sim, SEC (60));
+  g_assert_cmpuint (f->fired[alarm->id], ==, 1);
+  g_assert_cmpuint (f->commands[alarm->id], ==, 1);
+  g_assert_cmpuint (timer_core_get_state (f->core, alarm), ==,
+                    TIMER_ALARM_RUNNING | TIMER_ALARM_REPEATING);
+
+  /* Stopping the countdown leaves the command repeats alone */
+  timer_core_stop (f->core, alarm);
+  g_assert_cmpuint (timer_core_get_state (f->core, alarm), ==,
+                    TIMER_ALARM_REPEATING);
+
+  timer_sim_clock_advance (f->sim, SEC (10));
+  g_assert_cmpuint (f->commands[alarm->id], ==, 2);
+  timer_sim_clock_advance (f->sim, SEC (10));
+  g_assert_cmpuint (f->commands[alarm->id], ==, 3);
+
+  /* All repeats done */
+  timer_sim_clock_advance (f->sim, SEC (100));
+  g_assert_cmpuint (f->commands[alarm->id], ==, 3);
+  g_assert_cmpuint (f->fired[alarm->id], ==, 1);
+  g_assert_cmpuint (timer_core_get_state (f->core, alarm), ==, 0);
+  g_assert_cmpint (timer_core_next_event (f->core), ==, -1);
+}
+
+
+
+static void
+test_snooze (Fixture *f, gconstpointer data)
+{
+  TimerAlarm *alarm = add_alarm (f, TRUE, 60, FALSE, "true");
+
+  timer_core_set_repeat (f->core, TRUE, 5, 10);
+  timer_core_start (f->core, alarm);
+  timer_sim_clock_advance (f->sim, SEC (60));
+  g_assert_cmpuint (f->fired[alarm->id], ==, 1);
+
+  /* Snoozing a fired alarm runs it again and ends the repeats */
+  timer_core_snooze (f->core, alarm, 30);
+  g_assert_cmpuint (alarm->snoozes, ==, 1);
+  g_assert_cmpuint (timer_core_get_state (f->core, alarm), ==,
+                    TIMER_ALARM_RUNNING);
+  g_assert_cmpuint (timer_core_n_running (f->core), ==, 1);
+
+  timer_sim_clock_advance (f->sim, SEC (29));
+  g_assert_cmpuint (f->fired[alarm->id], ==, 1);
+  g_assert_cmpuint (f->commands[alarm->id], ==, 1);
+  timer_sim_clock_advance (f->sim, SEC (1));
+  g_assert_cmpuint (f->fired[alarm->id], ==, 2);
+  g_assert_cmpint (f->fired_at[alarm->id], ==, SEC (90));
+
+  /* Snoozing a running one moves its deadline, a paused one resumes */
+  timer_core_stop (f->core, alarm);
+  timer_core_start (f->core, alarm);
+  g_assert_cmpuint (alarm->snoozes, ==, 0);
+  timer_core_pause (f->core, alarm);
+  timer_core_snooze (f->core, alarm, 5);
+  g_assert_cmpuint (timer_core_get_state (f->core, alarm), ==,
+                    TIMER_ALARM_RUNNING);
+  timer_sim_clock_advance (f->sim, SEC (5));
+  g_assert_cmpuint (f->fired[alarm->id], ==, 3);
+  g_assert_cmpuint (alarm->snoozes, ==, 1);
+}
+
+
+
+static void
+test_remove_running (Fixture *f, gconstpointer data)
+{
+  TimerAlarm *first, *second, *third;
+  guint second_id;
+
+  first = add_alarm (f, TRUE, 10, FALSE, "");
+  second = add_alarm (f, TRUE, 20, TRUE, "true");
+  third = add_alarm (f, TRUE, 30, FALSE, "");
+  second_id = second->id;
+
+  timer_core_set_repeat (f->core, TRUE, 3, 1);
+  timer_core_start (f->core, first);
+  timer_core_start (f->core, second);
+  timer_core_start (f->core, third);
+
+  timer_sim_clock_advance (f->sim, SEC (20));
+  g_assert_cmpuint (f->commands[second_id], ==, 1);
+
+  /* Running and repeating; its slot is reused by the last one */
+  timer_core_remove (f->core, 1);
+  g_assert_null (timer_core_lookup (f->core, second_id));
+  g_assert_cmpuint (timer_core_n_alarms (f->core), ==, 2);
+  g_assert_cmpuint (timer_core_n_running (f->core), ==, 1);
+  g_assert_cmpuint (timer_core_position (f->core, third), ==, 1);
+
+  timer_sim_clock_advance (f->sim, SEC (60));
+  g_assert_cmpuint (f->fired[first->id], ==, 1);
+  g_assert_cmpuint (f->fired[second_id], ==, 1);
+  g_assert_cmpuint (f->commands[second_id], ==, 1);
+  g_assert_cmpuint (f->fired[third->id], ==, 1);
+  g_assert_cmpint (f->fired_at[third->id], ==, SEC (30));
+  g_assert_cmpint (timer_core_next_event (f->core), ==, -1);
+}
+
+
+
+static void
+test_at_clock_step (Fixture *f, gconstpointer data)
+{
+  TimerAlarm *alarm = add_alarm (f, FALSE, 10 * 60 + 30, FALSE, "");
+  gint64 real = timer_sim_clock_real_now (f->sim);
+
+  timer_core_start (f->core, alarm);
+  g_assert_cmpint (alarm->wall_deadline, ==, real + SEC (30 * 60));
+  g_assert_cmpint (timer_core_next_event (f->core), ==, SEC (30 * 60));
+
+  /* The wall clock jumps 20 minutes ahead: 10 are left, not 30 */
+  timer_sim_clock_set_real (f->sim, real + SEC (20 * 60));
+  g_assert_cmpint (timer_core_next_event (f->core), ==, SEC (10 * 60));
+  timer_sim_clock_advance (f->sim, SEC (10 * 60) - 1);
+  g_assert_cmpuint (f->fired[alarm->id], ==, 0);
+  timer_sim_clock_advance (f->sim, 1);
+  g_assert_cmpuint (f->fired[alarm->id], ==, 1);
+  g_assert_cmpint (timer_sim_clock_real_now (f->sim), ==,
+                   alarm->wall_deadline);
+
+  /* And back by an hour: it fires on the wall clock, an hour later */
+  timer_core_start (f->core, alarm);
+  real = timer_sim_clock_real_now (f->sim);
+  g_assert_cmpint (alarm->wall_deadline, ==, real + SEC (24 * 3600));
+  timer_sim_clock_set_real (f->sim, real - SEC (3600));
+  g_assert_cmpint (timer_core_next_event (f->core), ==,
+                   timer_sim_clock_now (f->sim) + SEC (25 * 3600));
+}
+
+
+
+static void
+test_at_coalesced (Fixture *f, gconstpointer data)
+{
+  TimerAlarm *early = add_alarm (f, TRUE, 59, FALSE, "");
+  TimerAlarm *alarm = add_alarm (f, FALSE, 10 * 60 + 1, TRUE, "");
+  gint64 deadline = timer_sim_clock_real_now (f->sim) + SEC (60);
+
+  /* Going off with the countdown, a second early, it is done for the day */
+  timer_core_set_coalesce (f->core, 2000);
+  timer_core_start (f->core, early);
+  timer_core_start (f->core, alarm);
+  timer_sim_clock_advance (f->sim, SEC (59));
+  g_assert_cmpuint (f->fired[early->id], ==, 1);
+  g_assert_cmpuint (f->fired[alarm->id], ==, 1);
+  g_assert_cmpint (alarm->wall_deadline, ==, deadline + SEC (24 * 3600));
+
+  timer_sim_clock_advance (f->sim, SEC (3600));
+  g_assert_cmpuint (f->fired[alarm->id], ==, 1);
+}
+
+
+
+static void
+test_freeze (Fixture *f, gconstpointer data)
+{
+  TimerAlarm *first = add_alarm (f, TRUE, 60, FALSE, "");
+  TimerAlarm *second = add_alarm (f, TRUE, 90, FALSE, "");
+
+  timer_core_start (f->core, first);
+  g_assert_cmpuint (f->changed, ==, 1);
+
+  /* Nested, 'changed' comes once at the outer thaw */
+  timer_core_freeze (f->core);
+  timer_core_stop (f->core, first);
+  timer_core_freeze (f->core);
+  timer_core_start (f->core, second);
+  timer_core_thaw (f->core);
+  timer_core_start (f->core, first);
+  g_assert_cmpuint (f->changed, ==, 1);
+  timer_core_thaw (f->core);
+  g_assert_cmpuint (f->changed, ==, 2);
+  g_assert_cmpuint (timer_core_n_running (f->core), ==, 2);
+
+  /* Nothing changed, nothing to tell */
+  timer_core_freeze (f->core);
+  timer_core_thaw (f->core);
+  g_assert_cmpuint (f->changed, ==, 2);
+}
+
+
+
+int
+main (int argc, char **argv)
+{
+  g_test_init (&argc, &argv, NULL);
+
+#define ADD_TEST(path, func) \
+  g_test_add (path, Fixture, NULL, fixture_setup, func, fixture_teardown)
+
+  ADD_TEST ("/core/start-stop", test_start_stop);
+  ADD_TEST ("/core/pause-resume", test_pause_resume);
+  ADD_TEST ("/core/recurring", test_recurring);
+  ADD_TEST ("/core/repeats-after-stop", test_repeats_after_stop);
+  ADD_TEST ("/core/snooze", test_snooze);
+  ADD_TEST ("/core/remove-running", test_remove_running);
+  ADD_TEST ("/core/at-clock-step", test_at_clock_step);
+  ADD_TEST ("/core/at-coalesced", test_at_coalesced);
+  ADD_TEST ("/core/freeze", test_freeze);
+
+  return g_test_run ();
+}
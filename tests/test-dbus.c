@@ -0,0 +1,322 @@
+/*
+ *
+ *  Copyright (C) 2005-2014 Kemal Ilgar Eroglu <ilgar_eroglu@yahoo.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * Drives the org.xfce.TimerPlugin interface over a session bus, as
+ * a script would. Meant to run under dbus-run-session, so that it has
+ * a bus of its own; it is skipped if there is no session bus at all.
+ *
+ * The service runs on the main loop of the main thread, the client
+ * makes blocking calls from a thread of its own over a connection
+ * of its own, so every call really goes through the bus.
+ **/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <gio/gio.h>
+
+#include "timercore.h"
+#include "timerdbus.h"
+
+
+
+#define TEST_PATH TIMER_DBUS_PATH "/test"
+
+typedef struct
+{
+  GMainLoop *loop; /* The service's */
+  gchar *service; /* Unique name of the service connection */
+  GDBusConnection *connection; /* The client's */
+  GMainContext *context; /* Where the client gets the signals */
+  guint fired_id; /* Id of the last Fired signal, 0 if none */
+  gboolean timed_out;
+} Test;
+
+static TimerDBus *dbus;
+
+
+
+static void
+core_fired (TimerCore *core, TimerAlarm *alarm, gpointer data)
+{
+  timer_dbus_emit_fired (dbus, alarm);
+}
+
+
+
+/* Calls a method of the service, NULL and *error set if it failed */
+static GVariant *
+call (Test *t, const gchar *method, GVariant *parameters,
+      const gchar *reply_type, GError **error)
+{
+  return g_dbus_connection_call_sync (t->connection, t->service, TEST_PATH,
+                                      TIMER_DBUS_INTERFACE, method, parameters,
+                                      reply_type ? G_VARIANT_TYPE (reply_type)
+                                                 : NULL,
+                                      G_DBUS_CALL_FLAGS_NONE, 5000, NULL,
+                                      error);
+}
+
+
+
+/* Like call(), but the call has to succeed */
+static GVariant *
+call_ok (Test *t, const gchar *method, GVariant *parameters,
+         const gchar *reply_type)
+{
+  GError *error = NULL;
+  GVariant *reply;
+
+  reply = call (t, method, parameters, reply_type, &error);
+  g_assert_no_error (error);
+
+  return reply;
+}
+
+
+
+/* Calls a method that only takes a timer id and returns nothing */
+static void
+call_id (Test *t, const gchar *method, guint id)
+{
+  g_variant_unref (call_ok (t, method, g_variant_new ("(u)", id), NULL));
+}
+
+
+
+/**
+ * Finds a timer in ListTimers. Returns FALSE if it is not listed,
+ * else puts its state and remaining seconds in the pointers.
+ **/
+static gboolean
+list_find (Test *t, guint id, guint *state, gint *remaining)
+{
+  GVariant *reply;
+  GVariantIter *iter;
+  const gchar *name, *info;
+  gboolean found = FALSE;
+  guint listed_id, listed_state;
+  gint listed_remaining;
+
+  reply = call_ok (t, "ListTimers", NULL, "(a(ussui))");
+  g_variant_get (reply, "(a(ussui))", &iter);
+  while (g_variant_iter_loop (iter, "(u&s&sui)", &listed_id, &name, &info,
+                              &listed_state, &listed_remaining))
+    if (listed_id == id)
+      {
+        *state = listed_state;
+        *remaining = listed_remaining;
+        found = TRUE;
+      }
+  g_variant_iter_free (iter);
+  g_variant_unref (reply);
+
+  return found;
+}
+
+
+
+static void
+fired_signal (GDBusConnection *connection, const gchar *sender,
+              const gchar *object_path, const gchar *interface_name,
+              const gchar *signal_name, GVariant *parameters,
+              gpointer user_data)
+{
+  Test *t = (Test *) user_data;
+  const gchar *name;
+
+  g_variant_get (parameters, "(u&s)", &t->fired_id, &name);
+  g_assert_cmpstr (name, ==, "Tea");
+}
+
+
+
+static gboolean
+fired_timeout (gpointer data)
+{
+  ((Test *) data)->timed_out = TRUE;
+  return G_SOURCE_REMOVE;
+}
+
+
+
+/* The service exports the object once it is on the bus */
+static void
+wait_for_service (Test *t)
+{
+  GError *error = NULL;
+  GVariant *reply;
+  guint i;
+
+  for (i = 0; i < 500; i++)
+    {
+      reply = call (t, "ListTimers", NULL, "(a(ussui))", &error);
+      if (reply != NULL)
+        {
+          g_variant_unref (reply);
+          return;
+        }
+      g_clear_error (&error);
+      g_usleep (10000);
+    }
+
+  g_error ("The service did not show up on the bus");
+}
+
+
+
+static gpointer
+client_thread (gpointer data)
+{
+  Test *t = (Test *) data;
+  GError *error = NULL;
+  GVariant *reply;
+  GSource *timeout;
+  guint id, at_id, state, snoozes, subscription;
+  gint remaining;
+
+  g_main_context_push_thread_default (t->context);
+  subscription = g_dbus_connection_signal_subscribe (
+      t->connection, t->service, TIMER_DBUS_INTERFACE, "Fired", TEST_PATH,
+      NULL, G_DBUS_SIGNAL_FLAGS_NONE, fired_signal, t, NULL);
+
+  wait_for_service (t);
+
+  /* Add a two second countdown and start it */
+  reply = call_ok (t, "Add", g_variant_new ("(sbis)", "Tea", TRUE, 2, ""),
+                   "(u)");
+  g_variant_get (reply, "(u)", &id);
+  g_variant_unref (reply);
+  g_assert_true (list_find (t, id, &state, &remaining));
+  g_assert_cmpuint (state, ==, 0);
+  g_assert_cmpint (remaining, ==, -1);
+
+  call_id (t, "Start", id);
+  g_assert_true (list_find (t, id, &state, &remaining));
+  g_assert_cmpuint (state, ==, TIMER_ALARM_RUNNING);
+  g_assert_cmpint (remaining, >, 0);
+  g_assert_cmpint (remaining, <=, 2);
+
+  /* An "At" alarm cannot be paused */
+  reply = call_ok (t, "Add", g_variant_new ("(sbis)", "Noon", FALSE, 12 * 60,
+                                            ""), "(u)");
+  g_variant_get (reply, "(u)", &at_id);
+  g_variant_unref (reply);
+  call_id (t, "Start", at_id);
+  reply = call (t, "Pause", g_variant_new ("(u)", at_id), NULL, &error);
+  g_assert_null (reply);
+  g_assert_error (error, G_DBUS_ERROR, G_DBUS_ERROR_NOT_SUPPORTED);
+  g_clear_error (&error);
+  call_id (t, "Remove", at_id);
+  g_assert_false (list_find (t, at_id, &state, &remaining));
+
+  /* Snoozed, it goes off a second from now */
+  reply = call_ok (t, "Snooze", g_variant_new ("(ui)", id, 1), "(u)");
+  g_variant_get (reply, "(u)", &snoozes);
+  g_variant_unref (reply);
+  g_assert_cmpuint (snoozes, ==, 1);
+
+  timeout = g_timeout_source_new_seconds (10);
+  g_source_set_callback (timeout, fired_timeout, t, NULL);
+  g_source_attach (timeout, t->context);
+  while (t->fired_id == 0 && !t->timed_out)
+    g_main_context_iteration (t->context, TRUE);
+  g_source_destroy (timeout);
+  g_source_unref (timeout);
+  g_assert_cmpuint (t->fired_id, ==, id);
+
+  g_assert_true (list_find (t, id, &state, &remaining));
+  g_assert_cmpuint (state, ==, 0);
+
+  call_id (t, "Remove", id);
+  g_assert_false (list_find (t, id, &state, &remaining));
+  reply = call (t, "Remove", g_variant_new ("(u)", id), NULL, &error);
+  g_assert_null (reply);
+  g_assert_error (error, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS);
+  g_clear_error (&error);
+
+  g_dbus_connection_signal_unsubscribe (t->connection, subscription);
+  g_main_context_pop_thread_default (t->context);
+  g_main_loop_quit (t->loop);
+
+  return NULL;
+}
+
+
+
+static void
+test_interface (void)
+{
+  static const TimerCoreCallbacks callbacks = { core_fired };
+  GDBusConnection *service;
+  TimerCore *core;
+  GThread *thread;
+  GError *error = NULL;
+  gchar *address;
+  Test t = { NULL };
+
+  core = timer_core_new (&callbacks, NULL);
+  dbus = timer_dbus_new (core, TEST_PATH, NULL, NULL);
+
+  /* The shared connection timer_dbus_new() owns the name on */
+  service = g_bus_get_sync (G_BUS_TYPE_SESSION, NULL, &error);
+  g_assert_no_error (error);
+  t.service = g_strdup (g_dbus_connection_get_unique_name (service));
+
+  address = g_dbus_address_get_for_bus_sync (G_BUS_TYPE_SESSION, NULL, &error);
+  g_assert_no_error (error);
+  t.connection = g_dbus_connection_new_for_address_sync (
+      address, G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT
+               | G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION,
+      NULL, NULL, &error);
+  g_assert_no_error (error);
+  g_free (address);
+
+  t.loop = g_main_loop_new (NULL, FALSE);
+  t.context = g_main_context_new ();
+  thread = g_thread_new ("client", client_thread, &t);
+  g_main_loop_run (t.loop);
+  g_thread_join (thread);
+
+  g_main_loop_unref (t.loop);
+  g_main_context_unref (t.context);
+  g_object_unref (t.connection);
+  g_object_unref (service);
+  g_free (t.service);
+  timer_dbus_free (dbus);
+  timer_core_free (core);
+}
+
+
+
+int
+main (int argc, char **argv)
+{
+  g_test_init (&argc, &argv, NULL);
+
+  /* Skipped, as automake sees it */
+  if (g_getenv ("DBUS_SESSION_BUS_ADDRESS") == NULL)
+    return 77;
+
+  g_test_add_func ("/dbus/interface", test_interface);
+
+  return g_test_run ();
+}
@@ -0,0 +1,245 @@
+/*
+ *
+ *  Copyright (C) 2005-2014 Kemal Ilgar Eroglu <ilgar_eroglu@yahoo.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * Unit tests of the alarm command runner: real commands, run by the
+ * shell, on the main loop.
+ **/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <glib.h>
+
+#include "timerexec.h"
+
+/* Where libtimercore logs to */
+#define CORE_LOG_DOMAIN "xfce4-timer-plugin"
+
+
+
+typedef struct
+{
+  guint n_done; /* Commands that are over */
+  guint tags[8]; /* Their tags, in the order they ended */
+  GPid pids[8];
+  gint statuses[8];
+} Done;
+
+
+
+static void
+command_done (guint tag, GPid pid, gint status, gint64 duration,
+              gpointer data)
+{
+  Done *done = (Done *) data;
+
+  g_assert_cmpuint (done->n_done, <, G_N_ELEMENTS (done->tags));
+  done->tags[done->n_done] = tag;
+  done->pids[done->n_done] = pid;
+  done->statuses[done->n_done] = status;
+  done->n_done++;
+}
+
+
+
+static gboolean
+wait_timeout (gpointer data)
+{
+  g_error ("The commands did not end in time");
+  return G_SOURCE_REMOVE;
+}
+
+
+
+/* Runs the main loop until n commands are over */
+static void
+wait_done (Done *done, guint n)
+{
+  guint timeout;
+
+  timeout = g_timeout_add_seconds (10, wait_timeout, NULL);
+  while (done->n_done < n)
+    g_main_context_iteration (NULL, TRUE);
+  g_source_remove (timeout);
+}
+
+
+
+static gboolean
+run_shell (TimerExec *exec, const gchar *script, guint tag)
+{
+  gchar *argv[] = { "sh", "-c", (gchar *) script, NULL };
+
+  return timer_exec_run (exec, argv, tag);
+}
+
+
+
+static void
+test_status (void)
+{
+  TimerExec *exec;
+  Done done = { 0 };
+
+  exec = timer_exec_new (TIMER_EXEC_MAX_RUNNING, command_done, &done);
+  g_assert_true (run_shell (exec, "exit 3", 1));
+  wait_done (&done, 1);
+
+  g_assert_cmpuint (done.tags[0], ==, 1);
+  g_assert_cmpint (done.pids[0], >, 0);
+  g_assert_true (WIFEXITED (done.statuses[0]));
+  g_assert_cmpint (WEXITSTATUS (done.statuses[0]), ==, 3);
+
+  timer_exec_free (exec);
+}
+
+
+
+/* A command that is not there is refused at once, with a warning */
+static void
+test_missing (void)
+{
+  gchar *argv[] = { "timer-test-no-such-command", NULL };
+  TimerExec *exec;
+  Done done = { 0 };
+
+  exec = timer_exec_new (TIMER_EXEC_MAX_RUNNING, command_done, &done);
+  g_test_expect_message (CORE_LOG_DOMAIN, G_LOG_LEVEL_WARNING,
+                         "Could not run 'timer-test-no-such-command'*");
+  g_assert_false (timer_exec_run (exec, argv, 1));
+  g_test_assert_expected_messages ();
+
+  g_assert_cmpuint (done.n_done, ==, 1);
+  g_assert_cmpint (done.pids[0], ==, 0);
+  g_assert_cmpint (done.statuses[0], ==, TIMER_EXEC_FAILED);
+
+  timer_exec_free (exec);
+}
+
+
+
+/* A descriptor the panel left open does not reach the command */
+static void
+test_fds (void)
+{
+  TimerExec *exec;
+  Done done = { 0 };
+  gchar *script, *path;
+  gint fd;
+
+  if (!g_file_test ("/proc/self/fd", G_FILE_TEST_IS_DIR))
+    {
+      g_test_skip ("No /proc/self/fd to look at");
+      return;
+    }
+
+  fd = open ("/dev/null", O_RDONLY);
+  g_assert_cmpint (fd, >, 2);
+  path = g_strdup_printf ("/proc/self/fd/%d", fd);
+  g_assert_true (g_file_test (path, G_FILE_TEST_EXISTS));
+
+  exec = timer_exec_new (TIMER_EXEC_MAX_RUNNING, command_done, &done);
+  script = g_strdup_printf ("test ! -e %s", path);
+  g_assert_true (run_shell (exec, script, 1));
+  wait_done (&done, 1);
+  g_assert_true (WIFEXITED (done.statuses[0]));
+  g_assert_cmpint (WEXITSTATUS (done.statuses[0]), ==, 0);
+
+  timer_exec_free (exec);
+  close (fd);
+  g_free (script);
+  g_free (path);
+}
+
+
+
+/* With one slot, the commands take turns, in order */
+static void
+test_queue (void)
+{
+  TimerExec *exec;
+  Done done = { 0 };
+  guint i;
+
+  exec = timer_exec_new (1, command_done, &done);
+  for (i = 1; i <= 3; i++)
+    g_assert_true (run_shell (exec, "sleep 0.1", i));
+  g_assert_cmpuint (done.n_done, ==, 0);
+  wait_done (&done, 3);
+
+  for (i = 0; i < 3; i++)
+    {
+      g_assert_cmpuint (done.tags[i], ==, i + 1);
+      g_assert_true (WIFEXITED (done.statuses[i]));
+    }
+
+  timer_exec_free (exec);
+}
+
+
+
+/* Past the queue limit commands are dropped, and so are those queued at free */
+static void
+test_drop (void)
+{
+  TimerExec *exec;
+  Done done = { 0 };
+  guint i;
+
+  exec = timer_exec_new (1, command_done, &done);
+  g_assert_true (run_shell (exec, "sleep 0.1", 0));
+  for (i = 1; i <= TIMER_EXEC_MAX_PENDING; i++)
+    g_assert_true (run_shell (exec, "exit 0", i == 1 ? 1 : 0));
+  g_test_expect_message (CORE_LOG_DOMAIN, G_LOG_LEVEL_WARNING,
+                         "Too many alarm commands waiting*");
+  g_assert_false (run_shell (exec, "exit 0", 2));
+  g_test_assert_expected_messages ();
+  g_assert_cmpuint (done.n_done, ==, 1);
+  g_assert_cmpuint (done.tags[0], ==, 2);
+  g_assert_cmpint (done.pids[0], ==, 0);
+  g_assert_cmpint (done.statuses[0], ==, TIMER_EXEC_DROPPED);
+
+  /* Freed, the queued commands are dropped too; the running one is reaped */
+  timer_exec_free (exec);
+  g_assert_cmpuint (done.n_done, ==, 2);
+  g_assert_cmpuint (done.tags[1], ==, 1);
+  g_assert_cmpint (done.statuses[1], ==, TIMER_EXEC_DROPPED);
+}
+
+
+
+int
+main (int argc, char **argv)
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/exec/status", test_status);
+  g_test_add_func ("/exec/missing", test_missing);
+  g_test_add_func ("/exec/fds", test_fds);
+  g_test_add_func ("/exec/queue", test_queue);
+  g_test_add_func ("/exec/drop", test_drop);
+
+  return g_test_run ();
+}
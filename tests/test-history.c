@@ -0,0 +1,248 @@
+/*
+ *
+ *  Copyright (C) 2005-2014 Kemal Ilgar Eroglu <ilgar_eroglu@yahoo.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * Unit tests of the firing history, in memory and in a log of its
+ * own in a temporary directory. Freeing the history waits for the
+ * writer, so the log is complete once it is freed.
+ **/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "timerhistory.h"
+
+
+
+/* Size of the log header, as TimerHistory writes it */
+#define HEADER_SIZE 16
+
+typedef struct
+{
+  gchar *dir;
+  gchar *path, *rotated_path; /* Of the log */
+  GArray *events; /* TimerHistoryEvent, as timer_history_foreach() gave them */
+} Fixture;
+
+
+
+static void
+fixture_setup (Fixture *f, gconstpointer data)
+{
+  GError *error = NULL;
+
+  f->dir = g_dir_make_tmp ("test-history-XXXXXX", &error);
+  g_assert_no_error (error);
+  f->path = g_build_filename (f->dir, "history", NULL);
+  f->rotated_path = g_strconcat (f->path, ".1", NULL);
+  f->events = g_array_new (FALSE, FALSE, sizeof (TimerHistoryEvent));
+}
+
+
+
+static void
+fixture_teardown (Fixture *f, gconstpointer data)
+{
+  g_unlink (f->path);
+  g_unlink (f->rotated_path);
+  g_rmdir (f->dir);
+  g_free (f->dir);
+  g_free (f->path);
+  g_free (f->rotated_path);
+  g_array_free (f->events, TRUE);
+}
+
+
+
+static void
+collect (const TimerHistoryEvent *event, gpointer data)
+{
+  g_array_append_val ((GArray *) data, *event);
+}
+
+
+
+static TimerHistoryEvent *
+event_at (Fixture *f, guint i)
+{
+  g_assert_cmpuint (i, <, f->events->len);
+  return &g_array_index (f->events, TimerHistoryEvent, i);
+}
+
+
+
+/* Reads the history back, as a panel started later would */
+static void
+read_back (Fixture *f, const gchar *path)
+{
+  TimerHistory *history;
+
+  history = timer_history_new (path, TIMER_HISTORY_MAX_SIZE);
+  g_array_set_size (f->events, 0);
+  timer_history_foreach (history, collect, f->events);
+  timer_history_free (history);
+}
+
+
+
+static gsize
+file_size (const gchar *path)
+{
+  GStatBuf st;
+
+  if (g_stat (path, &st) != 0)
+    return 0;
+
+  return st.st_size;
+}
+
+
+
+/* Without a log only the ring is there, oldest first */
+static void
+test_memory (Fixture *f, gconstpointer data)
+{
+  TimerHistory *history;
+  guint seq[3];
+
+  history = timer_history_new (NULL, 0);
+  timer_history_fired (history, 1, 100, 150, FALSE);
+  seq[1] = timer_history_fired (history, 2, 200, 210, TRUE);
+  seq[2] = timer_history_fired (history, 3, 300, 300, TRUE);
+  timer_history_done (history, seq[1], 42, 0, 1000);
+  timer_history_dropped (history, seq[2]);
+
+  timer_history_foreach (history, collect, f->events);
+  timer_history_free (history);
+
+  g_assert_cmpuint (f->events->len, ==, 3);
+  g_assert_cmpuint (event_at (f, 0)->alarm_id, ==, 1);
+  g_assert_cmpint (event_at (f, 0)->due, ==, 100);
+  g_assert_cmpint (event_at (f, 0)->fired, ==, 150);
+  g_assert_cmpuint (event_at (f, 0)->flags, ==, TIMER_HISTORY_DONE);
+
+  g_assert_cmpuint (event_at (f, 1)->flags, ==,
+                    TIMER_HISTORY_COMMAND | TIMER_HISTORY_DONE);
+  g_assert_cmpint (event_at (f, 1)->pid, ==, 42);
+  g_assert_cmpint (event_at (f, 1)->duration, ==, 1000);
+
+  g_assert_cmpuint (event_at (f, 2)->flags, ==,
+                    TIMER_HISTORY_COMMAND | TIMER_HISTORY_DONE
+                    | TIMER_HISTORY_DROPPED);
+}
+
+
+
+/* The log outlives the panel; a command still running is logged unfinished */
+static void
+test_log (Fixture *f, gconstpointer data)
+{
+  TimerHistory *history;
+  guint seq;
+
+  history = timer_history_new (f->path, TIMER_HISTORY_MAX_SIZE);
+  timer_history_fired (history, 1, 100, 150, FALSE);
+  seq = timer_history_fired (history, 2, 200, 210, TRUE);
+  timer_history_done (history, seq, 0, 0, 0);
+  timer_history_fired (history, 3, 300, 300, TRUE);
+  timer_history_free (history);
+
+  read_back (f, f->path);
+  g_assert_cmpuint (f->events->len, ==, 3);
+  g_assert_cmpuint (event_at (f, 0)->alarm_id, ==, 1);
+  g_assert_cmpuint (event_at (f, 1)->flags, ==,
+                    TIMER_HISTORY_COMMAND | TIMER_HISTORY_DONE
+                    | TIMER_HISTORY_FAILED);
+  g_assert_cmpuint (event_at (f, 2)->alarm_id, ==, 3);
+  g_assert_cmpuint (event_at (f, 2)->flags, ==, TIMER_HISTORY_COMMAND);
+  g_assert_false (g_file_test (f->rotated_path, G_FILE_TEST_EXISTS));
+}
+
+
+
+/**
+ * With room for four events, ten make the log rotate twice: the
+ * first four are gone, the next four are in <path>.1 and the last
+ * two in a new log.
+ **/
+static void
+test_rotation (Fixture *f, gconstpointer data)
+{
+  const gsize max_size = HEADER_SIZE + 4 * sizeof (TimerHistoryEvent);
+  TimerHistory *history;
+  guint i;
+
+  history = timer_history_new (f->path, max_size);
+  for (i = 1; i <= 10; i++)
+    timer_history_fired (history, i, i * 100, i * 100, FALSE);
+  timer_history_free (history);
+
+  g_assert_cmpuint (file_size (f->rotated_path), ==, max_size);
+  g_assert_cmpuint (file_size (f->path), ==,
+                    HEADER_SIZE + 2 * sizeof (TimerHistoryEvent));
+
+  read_back (f, f->path);
+  g_assert_cmpuint (f->events->len, ==, 6);
+  for (i = 0; i < 6; i++)
+    g_assert_cmpuint (event_at (f, i)->alarm_id, ==, i + 5);
+}
+
+
+
+/* However small max_size is, the log is only rotated after each event */
+static void
+test_rotation_min (Fixture *f, gconstpointer data)
+{
+  TimerHistory *history;
+
+  history = timer_history_new (f->path, 1);
+  timer_history_fired (history, 1, 100, 100, FALSE);
+  timer_history_fired (history, 2, 200, 200, FALSE);
+  timer_history_free (history);
+
+  g_assert_cmpuint (file_size (f->rotated_path), ==,
+                    HEADER_SIZE + sizeof (TimerHistoryEvent));
+  g_assert_false (g_file_test (f->path, G_FILE_TEST_EXISTS));
+
+  read_back (f, f->path);
+  g_assert_cmpuint (f->events->len, ==, 1);
+  g_assert_cmpuint (event_at (f, 0)->alarm_id, ==, 2);
+}
+
+
+
+int
+main (int argc, char **argv)
+{
+  g_test_init (&argc, &argv, NULL);
+
+#define ADD_TEST(path, func) \
+  g_test_add (path, Fixture, NULL, fixture_setup, func, fixture_teardown)
+
+  ADD_TEST ("/history/memory", test_memory);
+  ADD_TEST ("/history/log", test_log);
+  ADD_TEST ("/history/rotation", test_rotation);
+  ADD_TEST ("/history/rotation-min", test_rotation_min);
+
+  return g_test_run ();
+}
@@ -0,0 +1,208 @@
+/*
+ *
+ *  Copyright (C) 2005-2014 Kemal Ilgar Eroglu <ilgar_eroglu@yahoo.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * Unit tests of the alarm import: CSV quoting, and the checks that
+ * turn a whole file down for one bad entry. JSON is only read if
+ * json-glib was found.
+ **/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <unistd.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "timerimport.h"
+
+
+
+/* A CSV file that is wrong on the given line, and why */
+typedef struct
+{
+  const gchar *contents;
+  const gchar *message;
+} Invalid;
+
+static const Invalid invalid[] =
+{
+  { "Tea,countdown,3:00\nPasta,soon,10:00\n",
+    "Line 2: invalid type \"soon\"" },
+  { "Tea,countdown\n", "Line 1: missing type or time" },
+  { "Tea\n", "Line 1: missing type or time" },
+  { "Tea,countdown,\n", "Line 1: invalid time \"\"" },
+  { "Tea,countdown,1:60\n", "Line 1: invalid time \"1:60\"" },
+  { "Tea,countdown,1:2:3:4\n", "Line 1: invalid time \"1:2:3:4\"" },
+  { "Tea,countdown,24:00:00\n", "Line 1: invalid time \"24:00:00\"" },
+  { "Tea,countdown,-5\n", "Line 1: invalid time \"-5\"" },
+  { "Tea,countdown,5s\n", "Line 1: invalid time \"5s\"" },
+  { "Tea,at,24:00\n", "Line 1: invalid time \"24:00\"" },
+  { "Tea,at,600\n", "Line 1: invalid time \"600\"" },
+  { "Tea,countdown,60,,maybe\n",
+    "Line 1: invalid recurring flag \"maybe\"" },
+  { "Tea,countdown,60,,yes,2\n",
+    "Line 1: invalid autostart flag \"2\"" },
+  { "# Comment\n\n\"Tea\nfor two\",countdown,60\nPasta,at,noon\n",
+    "Line 5: invalid time \"noon\"" },
+  { "Tea,countdown,60\n\"Pasta,countdown,60\n",
+    "Line 2: unterminated quote" },
+};
+
+
+
+/* Writes contents to a temporary file and imports it */
+static TimerImport *
+import_string (const gchar *contents, GError **error)
+{
+  TimerImport *import;
+  gchar *path;
+  gint fd;
+
+  fd = g_file_open_tmp ("test-import-XXXXXX", &path, NULL);
+  g_assert_cmpint (fd, >=, 0);
+  close (fd);
+  g_assert_true (g_file_set_contents (path, contents, -1, NULL));
+
+  import = timer_import_read (path, error);
+
+  g_unlink (path);
+  g_free (path);
+
+  return import;
+}
+
+
+
+static void
+test_csv (void)
+{
+  const TimerConfigAlarm *alarm;
+  TimerImport *import;
+  GError *error = NULL;
+
+  import = import_string ("name,type,time,command,recurring,autostart\n"
+                          "# Comment, skipped\n"
+                          "\n"
+                          "  Tea  , countdown , 3:00\n"
+                          "\"Pasta, al dente\",COUNTDOWN,10:30,"
+                          "\"notify-send \"\"Pasta\"\"\",no,yes\n"
+                          "\"Two\nlines\",at,07:05,,true,,extra,columns\n"
+                          "Long,countdown,23:59:59,\"\",1,0\n"
+                          "Seconds,countdown,90,bell\n",
+                          &error);
+  g_assert_no_error (error);
+  g_assert_nonnull (import);
+  g_assert_cmpuint (timer_import_n_alarms (import), ==, 5);
+
+  alarm = timer_import_get (import, 0);
+  g_assert_cmpstr (alarm->name, ==, "Tea");
+  g_assert_true (alarm->is_countdown);
+  g_assert_cmpint (alarm->time, ==, 180);
+  g_assert_null (alarm->command);
+  g_assert_false (alarm->is_recurring);
+  g_assert_false (alarm->is_auto_start);
+
+  alarm = timer_import_get (import, 1);
+  g_assert_cmpstr (alarm->name, ==, "Pasta, al dente");
+  g_assert_cmpint (alarm->time, ==, 630);
+  g_assert_cmpstr (alarm->command, ==, "notify-send \"Pasta\"");
+  g_assert_false (alarm->is_recurring);
+  g_assert_true (alarm->is_auto_start);
+
+  alarm = timer_import_get (import, 2);
+  g_assert_cmpstr (alarm->name, ==, "Two\nlines");
+  g_assert_false (alarm->is_countdown);
+  g_assert_cmpint (alarm->time, ==, 7 * 60 + 5);
+  g_assert_cmpstr (alarm->command, ==, "");
+  g_assert_true (alarm->is_recurring);
+  g_assert_false (alarm->is_auto_start);
+
+  alarm = timer_import_get (import, 3);
+  g_assert_cmpint (alarm->time, ==, 24 * 3600 - 1);
+  g_assert_true (alarm->is_recurring);
+
+  alarm = timer_import_get (import, 4);
+  g_assert_cmpint (alarm->time, ==, 90);
+  g_assert_cmpstr (alarm->command, ==, "bell");
+
+  timer_import_free (import);
+}
+
+
+
+/* One bad entry and nothing is imported; the error tells where */
+static void
+test_invalid (void)
+{
+  TimerImport *import;
+  GError *error = NULL;
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (invalid); i++)
+    {
+      import = import_string (invalid[i].contents, &error);
+      g_assert_null (import);
+      g_assert_error (error, TIMER_IMPORT_ERROR, TIMER_IMPORT_ERROR_INVALID);
+      g_assert_cmpstr (error->message, ==, invalid[i].message);
+      g_clear_error (&error);
+    }
+}
+
+
+
+static void
+test_json (void)
+{
+  TimerImport *import;
+  GError *error = NULL;
+
+  import = import_string ("  [ { \"name\": \"Tea\", \"type\": \"countdown\","
+                          " \"time\": 180, \"recurring\": true } ]",
+                          &error);
+
+#ifdef HAVE_JSON_GLIB
+  g_assert_no_error (error);
+  g_assert_cmpuint (timer_import_n_alarms (import), ==, 1);
+  g_assert_cmpstr (timer_import_get (import, 0)->name, ==, "Tea");
+  g_assert_cmpint (timer_import_get (import, 0)->time, ==, 180);
+  g_assert_true (timer_import_get (import, 0)->is_recurring);
+  timer_import_free (import);
+#else
+  g_assert_null (import);
+  g_assert_error (error, TIMER_IMPORT_ERROR, TIMER_IMPORT_ERROR_UNSUPPORTED);
+  g_clear_error (&error);
+#endif
+}
+
+
+
+int
+main (int argc, char **argv)
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/import/csv", test_csv);
+  g_test_add_func ("/import/invalid", test_invalid);
+  g_test_add_func ("/import/json", test_json);
+
+  return g_test_run ();
+}
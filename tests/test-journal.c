@@ -0,0 +1,371 @@
+/*
+ *
+ *  Copyright (C) 2005-2014 Kemal Ilgar Eroglu <ilgar_eroglu@yahoo.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * Unit tests of the state journal. A panel is run on the simulated
+ * clock, saves its journal and goes away; a second one with the same
+ * alarms starts later and restores it.
+ **/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <unistd.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "timercore.h"
+#include "timerjournal.h"
+#include "timersim.h"
+
+/* Where libtimercore logs to */
+#define CORE_LOG_DOMAIN "xfce4-timer-plugin"
+
+#define SEC(s) ((gint64) (s) * G_USEC_PER_SEC)
+
+/* The alarms of both panels, in list order */
+enum
+{
+  TEA, /* Countdown of a minute */
+  PASTA, /* Countdown of ten minutes */
+  MEETING, /* At 10:30 */
+  STRETCH, /* Recurring countdown of five minutes */
+  IDLE, /* Countdown that is never started */
+  N_ALARMS
+};
+
+typedef struct
+{
+  TimerCore *core;
+  TimerSimClock *sim;
+  TimerAlarm *alarms[N_ALARMS];
+  guint fired[N_ALARMS];
+} Panel;
+
+typedef struct
+{
+  gchar *path; /* Of the journal */
+  Panel before, after; /* The panel that saved it, and the restarted one */
+} Fixture;
+
+
+
+static void
+panel_fired (TimerCore *core, TimerAlarm *alarm, gpointer data)
+{
+  Panel *panel = (Panel *) data;
+  guint i;
+
+  for (i = 0; i < N_ALARMS; i++)
+    if (panel->alarms[i] == alarm)
+      panel->fired[i]++;
+}
+
+
+
+/* Local time of day 10:00 on 2020-01-01, when the first panel starts */
+static gint64
+start_real (void)
+{
+  GDateTime *start;
+  gint64 real;
+
+  start = g_date_time_new_local (2020, 1, 1, 10, 0, 0);
+  real = g_date_time_to_unix (start) * G_USEC_PER_SEC;
+  g_date_time_unref (start);
+
+  return real;
+}
+
+
+
+static TimerAlarm *
+panel_add (Panel *panel, const gchar *name, gboolean countdown, gint time,
+           gboolean recurring)
+{
+  TimerAlarm *alarm;
+
+  alarm = timer_core_add (panel->core);
+  timer_core_set_name (panel->core, alarm, name);
+  timer_core_set_info (panel->core, alarm, "");
+  timer_core_set_command (panel->core, alarm, "");
+  alarm->is_countdown = countdown;
+  alarm->is_recurring = recurring;
+  alarm->time = time;
+
+  return alarm;
+}
+
+
+
+/* Starts a panel 'late' seconds after 10:00, with an extra alarm first */
+static void
+panel_start (Panel *panel, gint late, const gchar *extra)
+{
+  static const TimerCoreCallbacks callbacks = { panel_fired };
+
+  panel->core = timer_core_new (&callbacks, panel);
+  panel->sim = timer_sim_clock_new (panel->core, start_real () + SEC (late));
+
+  if (extra != NULL)
+    panel_add (panel, extra, TRUE, 1, FALSE);
+
+  panel->alarms[TEA] = panel_add (panel, "Tea", TRUE, 60, FALSE);
+  panel->alarms[PASTA] = panel_add (panel, "Pasta", TRUE, 600, FALSE);
+  panel->alarms[MEETING] = panel_add (panel, "Meeting", FALSE, 10 * 60 + 30,
+                                      FALSE);
+  panel->alarms[STRETCH] = panel_add (panel, "Stretch", TRUE, 300, TRUE);
+  panel->alarms[IDLE] = panel_add (panel, "Idle", TRUE, 30, FALSE);
+}
+
+
+
+static void
+panel_stop (Panel *panel)
+{
+  if (panel->core == NULL)
+    return;
+
+  timer_sim_clock_free (panel->sim);
+  timer_core_free (panel->core);
+  panel->core = NULL;
+}
+
+
+
+static guint8
+state (Panel *panel, guint i)
+{
+  return timer_core_get_state (panel->core, panel->alarms[i]);
+}
+
+
+
+static gint64
+remaining (Panel *panel, guint i)
+{
+  return timer_core_remaining (panel->core, panel->alarms[i],
+                               timer_sim_clock_now (panel->sim));
+}
+
+
+
+static void
+fixture_setup (Fixture *f, gconstpointer data)
+{
+  GError *error = NULL;
+  gint fd;
+
+  fd = g_file_open_tmp ("test-journal-XXXXXX", &f->path, &error);
+  g_assert_no_error (error);
+  close (fd);
+}
+
+
+
+static void
+fixture_teardown (Fixture *f, gconstpointer data)
+{
+  panel_stop (&f->before);
+  panel_stop (&f->after);
+  g_unlink (f->path);
+  g_free (f->path);
+}
+
+
+
+/**
+ * The first panel starts Tea, Pasta, the meeting and Stretch at
+ * 10:00, pauses Pasta 20 s later and saves its journal.
+ **/
+static void
+save_before (Fixture *f)
+{
+  GError *error = NULL;
+
+  panel_start (&f->before, 0, NULL);
+  timer_core_start (f->before.core, f->before.alarms[TEA]);
+  timer_core_start (f->before.core, f->before.alarms[PASTA]);
+  timer_core_start (f->before.core, f->before.alarms[MEETING]);
+  timer_core_start (f->before.core, f->before.alarms[STRETCH]);
+
+  timer_sim_clock_advance (f->before.sim, SEC (20));
+  timer_core_pause (f->before.core, f->before.alarms[PASTA]);
+
+  g_assert_true (timer_journal_save (f->before.core, f->path, &error));
+  g_assert_no_error (error);
+  panel_stop (&f->before);
+}
+
+
+
+/* Restarted 10 s later, everything goes on where it was */
+static void
+test_restore (Fixture *f, gconstpointer data)
+{
+  save_before (f);
+
+  panel_start (&f->after, 30, NULL);
+  g_assert_cmpuint (timer_journal_restore (f->after.core, f->path,
+                                           TIMER_CATCH_UP_FIRE), ==, 4);
+
+  g_assert_cmpuint (state (&f->after, TEA), ==, TIMER_ALARM_RUNNING);
+  g_assert_cmpint (remaining (&f->after, TEA), ==, SEC (30));
+  g_assert_cmpuint (state (&f->after, PASTA), ==,
+                    TIMER_ALARM_RUNNING | TIMER_ALARM_PAUSED);
+  g_assert_cmpint (remaining (&f->after, PASTA), ==, SEC (580));
+  g_assert_cmpint (remaining (&f->after, MEETING), ==, SEC (29 * 60 + 30));
+  g_assert_cmpint (remaining (&f->after, STRETCH), ==, SEC (270));
+  g_assert_cmpuint (state (&f->after, IDLE), ==, 0);
+  g_assert_cmpint (f->after.alarms[PASTA]->timeout_period_in_sec, ==, 600);
+
+  timer_sim_clock_advance (f->after.sim, SEC (30));
+  g_assert_cmpuint (f->after.fired[TEA], ==, 1);
+  g_assert_cmpuint (f->after.fired[STRETCH], ==, 0);
+}
+
+
+
+/* Restarted an hour later: what came due fires at once, late */
+static void
+test_catch_up_fire (Fixture *f, gconstpointer data)
+{
+  save_before (f);
+
+  panel_start (&f->after, 3600, NULL);
+  g_assert_cmpuint (timer_journal_restore (f->after.core, f->path,
+                                           TIMER_CATCH_UP_FIRE), ==, 4);
+
+  timer_sim_clock_advance (f->after.sim, 0);
+  g_assert_cmpuint (f->after.fired[TEA], ==, 1);
+  g_assert_cmpuint (f->after.fired[MEETING], ==, 1);
+  g_assert_cmpuint (f->after.fired[STRETCH], ==, 1);
+  g_assert_cmpuint (f->after.fired[PASTA], ==, 0);
+  g_assert_cmpuint (state (&f->after, TEA), ==, 0);
+  g_assert_cmpuint (state (&f->after, PASTA), ==,
+                    TIMER_ALARM_RUNNING | TIMER_ALARM_PAUSED);
+  g_assert_cmpint (remaining (&f->after, STRETCH), ==, SEC (300));
+}
+
+
+
+/* Restarted an hour later: what came due is skipped, recurring ones restart */
+static void
+test_catch_up_skip (Fixture *f, gconstpointer data)
+{
+  save_before (f);
+
+  panel_start (&f->after, 3600, NULL);
+  g_assert_cmpuint (timer_journal_restore (f->after.core, f->path,
+                                           TIMER_CATCH_UP_SKIP), ==, 2);
+
+  timer_sim_clock_advance (f->after.sim, 0);
+  g_assert_cmpuint (f->after.fired[TEA], ==, 0);
+  g_assert_cmpuint (f->after.fired[MEETING], ==, 0);
+  g_assert_cmpuint (f->after.fired[STRETCH], ==, 0);
+  g_assert_cmpuint (state (&f->after, TEA), ==, 0);
+  g_assert_cmpuint (state (&f->after, MEETING), ==, 0);
+  g_assert_cmpuint (state (&f->after, PASTA), ==,
+                    TIMER_ALARM_RUNNING | TIMER_ALARM_PAUSED);
+  g_assert_cmpint (remaining (&f->after, STRETCH), ==, SEC (300));
+}
+
+
+
+/* An alarm added in front meanwhile: the records find theirs by fingerprint */
+static void
+test_moved (Fixture *f, gconstpointer data)
+{
+  save_before (f);
+
+  panel_start (&f->after, 30, "Added");
+  g_assert_cmpuint (timer_journal_restore (f->after.core, f->path,
+                                           TIMER_CATCH_UP_FIRE), ==, 4);
+
+  g_assert_cmpuint (state (&f->after, TEA), ==, TIMER_ALARM_RUNNING);
+  g_assert_cmpint (remaining (&f->after, TEA), ==, SEC (30));
+  g_assert_cmpuint (state (&f->after, PASTA), ==,
+                    TIMER_ALARM_RUNNING | TIMER_ALARM_PAUSED);
+  g_assert_cmpuint (state (&f->after, IDLE), ==, 0);
+  g_assert_cmpuint (timer_core_get_state (f->after.core,
+                                          timer_core_get (f->after.core, 0)),
+                    ==, 0);
+}
+
+
+
+/* With nothing running there is no journal */
+static void
+test_nothing_running (Fixture *f, gconstpointer data)
+{
+  GError *error = NULL;
+
+  panel_start (&f->before, 0, NULL);
+  g_assert_true (g_file_test (f->path, G_FILE_TEST_EXISTS));
+  g_assert_true (timer_journal_save (f->before.core, f->path, &error));
+  g_assert_no_error (error);
+  g_assert_false (g_file_test (f->path, G_FILE_TEST_EXISTS));
+
+  g_assert_cmpuint (timer_journal_restore (f->before.core, f->path,
+                                           TIMER_CATCH_UP_FIRE), ==, 0);
+  g_assert_cmpuint (timer_core_n_running (f->before.core), ==, 0);
+}
+
+
+
+/* A damaged journal is ignored, with a warning */
+static void
+test_invalid (Fixture *f, gconstpointer data)
+{
+  GError *error = NULL;
+
+  save_before (f);
+  g_file_set_contents (f->path, "XFTIMJNL but not quite", -1, &error);
+  g_assert_no_error (error);
+
+  panel_start (&f->after, 30, NULL);
+  g_test_expect_message (CORE_LOG_DOMAIN, G_LOG_LEVEL_WARNING,
+                         "Ignoring the invalid state journal*");
+  g_assert_cmpuint (timer_journal_restore (f->after.core, f->path,
+                                           TIMER_CATCH_UP_FIRE), ==, 0);
+  g_test_assert_expected_messages ();
+  g_assert_cmpuint (timer_core_n_running (f->after.core), ==, 0);
+}
+
+
+
+int
+main (int argc, char **argv)
+{
+  g_test_init (&argc, &argv, NULL);
+
+#define ADD_TEST(path, func) \
+  g_test_add (path, Fixture, NULL, fixture_setup, func, fixture_teardown)
+
+  ADD_TEST ("/journal/restore", test_restore);
+  ADD_TEST ("/journal/catch-up-fire", test_catch_up_fire);
+  ADD_TEST ("/journal/catch-up-skip", test_catch_up_skip);
+  ADD_TEST ("/journal/moved", test_moved);
+  ADD_TEST ("/journal/nothing-running", test_nothing_running);
+  ADD_TEST ("/journal/invalid", test_invalid);
+
+  return g_test_run ();
+}
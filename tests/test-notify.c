@@ -0,0 +1,277 @@
+/*
+ *
+ *  Copyright (C) 2005-2014 Kemal Ilgar Eroglu <ilgar_eroglu@yahoo.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * Shows notifications through a fake org.freedesktop.Notifications
+ * on a session bus of its own, as under dbus-run-session; skipped if
+ * there is no session bus at all.
+ *
+ * The fake daemon owns the name on a connection of its own and runs
+ * on the same main loop as the client, which only makes async calls.
+ **/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <gio/gio.h>
+
+#include "timernotify.h"
+
+
+
+/* The fake notification daemon */
+typedef struct
+{
+  GDBusConnection *connection;
+  gboolean markup; /* Whether it has the "body-markup" capability */
+  gchar *summary, *body; /* Text of the last Notify */
+  guint32 id; /* Id of the last Notify, 0 if none yet */
+} Server;
+
+static const gchar server_xml[] =
+  "<node>"
+  "  <interface name='" TIMER_NOTIFY_INTERFACE "'>"
+  "    <method name='GetCapabilities'>"
+  "      <arg type='as' name='capabilities' direction='out'/>"
+  "    </method>"
+  "    <method name='Notify'>"
+  "      <arg type='s' name='app_name' direction='in'/>"
+  "      <arg type='u' name='replaces_id' direction='in'/>"
+  "      <arg type='s' name='app_icon' direction='in'/>"
+  "      <arg type='s' name='summary' direction='in'/>"
+  "      <arg type='s' name='body' direction='in'/>"
+  "      <arg type='as' name='actions' direction='in'/>"
+  "      <arg type='a{sv}' name='hints' direction='in'/>"
+  "      <arg type='i' name='expire_timeout' direction='in'/>"
+  "      <arg type='u' name='id' direction='out'/>"
+  "    </method>"
+  "    <method name='CloseNotification'>"
+  "      <arg type='u' name='id' direction='in'/>"
+  "    </method>"
+  "    <signal name='ActionInvoked'>"
+  "      <arg type='u' name='id'/>"
+  "      <arg type='s' name='action_key'/>"
+  "    </signal>"
+  "    <signal name='NotificationClosed'>"
+  "      <arg type='u' name='id'/>"
+  "      <arg type='u' name='reason'/>"
+  "    </signal>"
+  "  </interface>"
+  "</node>";
+
+static Server server;
+
+typedef struct
+{
+  GMainLoop *loop;
+  gchar *action; /* Key of the action the client heard of, or NULL */
+} Test;
+
+
+
+static void
+server_method_call (GDBusConnection *connection, const gchar *sender,
+                    const gchar *object_path, const gchar *interface_name,
+                    const gchar *method_name, GVariant *parameters,
+                    GDBusMethodInvocation *invocation, gpointer user_data)
+{
+  const gchar *capabilities[] = { "body", "actions", NULL, NULL };
+  const gchar *summary, *body;
+
+  if (g_strcmp0 (method_name, "GetCapabilities") == 0)
+    {
+      if (server.markup)
+        capabilities[2] = "body-markup";
+      g_dbus_method_invocation_return_value (
+          invocation, g_variant_new ("(^as)", capabilities));
+    }
+  else if (g_strcmp0 (method_name, "Notify") == 0)
+    {
+      g_variant_get (parameters, "(&su&s&s&sasa{sv}i)", NULL, NULL, NULL,
+                     &summary, &body, NULL, NULL, NULL);
+      g_free (server.summary);
+      g_free (server.body);
+      server.summary = g_strdup (summary);
+      server.body = g_strdup (body);
+      g_dbus_method_invocation_return_value (
+          invocation, g_variant_new ("(u)", ++server.id));
+
+      /* The user picks the action at once */
+      g_dbus_connection_emit_signal (connection, NULL, TIMER_NOTIFY_PATH,
+                                     TIMER_NOTIFY_INTERFACE, "ActionInvoked",
+                                     g_variant_new ("(us)", server.id,
+                                                    "default"),
+                                     NULL);
+    }
+  else
+    g_dbus_method_invocation_return_value (invocation, NULL);
+}
+
+
+
+static const GDBusInterfaceVTable server_vtable =
+{
+  server_method_call, NULL, NULL
+};
+
+
+
+/* Puts the fake daemon on the bus, under the well-known name */
+static void
+server_start (void)
+{
+  GDBusNodeInfo *node_info;
+  GVariant *reply;
+  GError *error = NULL;
+  gchar *address;
+  guint32 result;
+
+  address = g_dbus_address_get_for_bus_sync (G_BUS_TYPE_SESSION, NULL, &error);
+  g_assert_no_error (error);
+  server.connection = g_dbus_connection_new_for_address_sync (
+      address, G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT
+               | G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION,
+      NULL, NULL, &error);
+  g_assert_no_error (error);
+  g_free (address);
+
+  node_info = g_dbus_node_info_new_for_xml (server_xml, &error);
+  g_assert_no_error (error);
+  g_dbus_connection_register_object (server.connection, TIMER_NOTIFY_PATH,
+                                     node_info->interfaces[0], &server_vtable,
+                                     NULL, NULL, &error);
+  g_assert_no_error (error);
+  g_dbus_node_info_unref (node_info);
+
+  /* Flag 4 is "do not queue", reply 1 "primary owner" */
+  reply = g_dbus_connection_call_sync (
+      server.connection, "org.freedesktop.DBus", "/org/freedesktop/DBus",
+      "org.freedesktop.DBus", "RequestName",
+      g_variant_new ("(su)", TIMER_NOTIFY_NAME, 4), G_VARIANT_TYPE ("(u)"),
+      G_DBUS_CALL_FLAGS_NONE, -1, NULL, &error);
+  g_assert_no_error (error);
+  g_variant_get (reply, "(u)", &result);
+  g_variant_unref (reply);
+  g_assert_cmpuint (result, ==, 1);
+}
+
+
+
+static void
+client_action (TimerNotify *notify, const gchar *key, gpointer data)
+{
+  Test *t = (Test *) data;
+
+  t->action = g_strdup (key);
+  g_main_loop_quit (t->loop);
+}
+
+
+
+static void
+client_failed (TimerNotify *notify, gpointer data)
+{
+  g_error ("The notification could not be shown");
+}
+
+
+
+static gboolean
+show_timeout (gpointer data)
+{
+  g_error ("The notification was not acted on in time");
+  return G_SOURCE_REMOVE;
+}
+
+
+
+/* Shows a notification and waits until its action comes back */
+static void
+show (const gchar *summary, const gchar *body)
+{
+  static const TimerNotifyCallbacks callbacks =
+    { client_action, NULL, client_failed };
+  static const gchar * const actions[] = { "default", "Stop", NULL };
+  TimerNotify *notify;
+  Test t = { NULL };
+  guint timeout;
+
+  t.loop = g_main_loop_new (NULL, FALSE);
+  notify = timer_notify_new ("Timer test", "", &callbacks, &t);
+  timer_notify_show (notify, summary, body, actions);
+
+  timeout = g_timeout_add_seconds (10, show_timeout, NULL);
+  g_main_loop_run (t.loop);
+  g_source_remove (timeout);
+
+  g_assert_cmpstr (t.action, ==, "default");
+  g_free (t.action);
+  timer_notify_free (notify);
+  g_main_loop_unref (t.loop);
+}
+
+
+
+static void
+test_markup (void)
+{
+  server.markup = TRUE;
+  show ("Tea & <cake>", "Ready at <b>5</b>");
+  g_assert_cmpstr (server.summary, ==, "Tea & <cake>");
+  g_assert_cmpstr (server.body, ==, "Ready at &lt;b&gt;5&lt;/b&gt;");
+}
+
+
+
+static void
+test_plain (void)
+{
+  server.markup = FALSE;
+  show ("Tea & <cake>", "Ready at <b>5</b>");
+  g_assert_cmpstr (server.summary, ==, "Tea & <cake>");
+  g_assert_cmpstr (server.body, ==, "Ready at <b>5</b>");
+}
+
+
+
+int
+main (int argc, char **argv)
+{
+  gint status;
+
+  g_test_init (&argc, &argv, NULL);
+
+  /* Skipped, as automake sees it */
+  if (g_getenv ("DBUS_SESSION_BUS_ADDRESS") == NULL)
+    return 77;
+
+  server_start ();
+
+  g_test_add_func ("/notify/markup", test_markup);
+  g_test_add_func ("/notify/plain", test_plain);
+
+  status = g_test_run ();
+
+  g_object_unref (server.connection);
+  g_free (server.summary);
+  g_free (server.body);
+
+  return status;
+}